@@ -1,61 +1,308 @@
 #include "third_party/blink/renderer/modules/minishell/mini_shell.h"
 
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "base/barrier_callback.h"
+#include "mojo/public/cpp/bindings/callback_helpers.h"
+
 namespace blink {
 
-FileBuffer::FileBuffer(
-    mojo::PendingRemote<mojom::cfs::blink::CodegateFile> new_file_remote,
-    ScriptPromiseResolver<IDLString>* resolver)
-    : remote_(ExecutionContext::From(resolver->GetScriptState())), idx_(0) {
-  remote_.Bind(std::move(new_file_remote),
-               ExecutionContext::From(resolver->GetScriptState())
-                   ->GetTaskRunner(TaskType::kInternalDefault));
-  GetRemote()->Read(WTF::BindOnce(
-      [](FileBuffer* filebuffer, ScriptPromiseResolver<IDLString>* resolver,
-         bool success, const std::optional<WTF::Vector<uint8_t>>& content) {
-        if (success) {
-          filebuffer->write(content.value());
-          resolver->Resolve("File opened");
-        } else {
-          resolver->Reject(MakeGarbageCollected<DOMException>(
-              DOMExceptionCode::kOperationError, "Failed to open file."));
-        }
-      },
-      WrapPersistent(this), WrapPersistent(resolver)));
+FileBuffer::FileBuffer(ItemHandle* handle,
+                       ScriptPromiseResolver<IDLString>* resolver)
+    : handle_(handle),
+      idx_(0),
+      size_(0),
+      open_resolver_(resolver),
+      task_runner_(ExecutionContext::From(resolver->GetScriptState())
+                       ->GetTaskRunner(TaskType::kInternalDefault)),
+      stream_size_(0),
+      load_offset_(0),
+      loaded_(false),
+      load_failed_(false),
+      flushes_in_flight_(0),
+      flush_failed_(false),
+      flush_timer_(task_runner_, this, &FileBuffer::OnFlushTimer) {
+  // A reply lost to a disconnect counts as a failed load or write, so the
+  // open promise always settles and unacknowledged ranges stay dirty.
+  GetRemote()->ReadStream(mojo::WrapCallbackWithDefaultInvokeIfNotRun(
+      WTF::BindOnce(&FileBuffer::OnReadStream, WrapPersistent(this)), false,
+      uint64_t{0}, mojo::ScopedDataPipeConsumerHandle()));
 }
 
 Vector<uint8_t> FileBuffer::read(uint64_t count) {
-  Vector<uint8_t> res(count);
-
-  if (count > FILESIZE_MAX) {
+  if (idx_ >= size_) {
     return Vector<uint8_t>();
   }
 
-  for (uint64_t i = 0; i < count; i++) {
-    res[i] = buffer_[idx_ + i];
-  }
+  Vector<uint8_t> res(static_cast<wtf_size_t>(std::min(count, size_ - idx_)));
+  CopyOut(idx_, base::span(res));
   return res;
 }
 
-void FileBuffer::write(const Vector<uint8_t>& data) {
-  if (data.size() > FILESIZE_MAX) {
-    return;
+bool FileBuffer::write(const Vector<uint8_t>& data) {
+  if (idx_ > FILESIZE_MAX || data.size() > FILESIZE_MAX - idx_) {
+    return false;
   }
 
-  for (uint64_t i = 0; i < data.size(); i++) {
-    buffer_[idx_ + i] = data[i];
+  size_t done = 0;
+  while (done < data.size()) {
+    base::span<uint8_t> page = GetPageSpan(idx_ + done);
+    size_t count = std::min<size_t>(page.size(), data.size() - done);
+    page.first(count).copy_from(base::span(data).subspan(done, count));
+    done += count;
   }
+
+  size_ = std::max<uint64_t>(size_, idx_ + data.size());
+  if (!data.empty()) {
+    MarkDirty(idx_, idx_ + data.size());
+    if (write_behind_delay_.is_positive()) {
+      // Restarting the timer on every write coalesces bursts into one flush.
+      flush_timer_.StartOneShot(write_behind_delay_, FROM_HERE);
+    }
+  }
+  return true;
 }
 
 void FileBuffer::SetIdx(uint64_t idx) {
   idx_ = idx;
 }
 
+mojo_base::BigBuffer FileBuffer::Serialize() const {
+  mojo_base::BigBuffer buffer(static_cast<size_t>(size_));
+  CopyOut(0, base::span(buffer));
+  return buffer;
+}
+
+void FileBuffer::ReleasePages() {
+  flush_timer_.Stop();
+  dirty_.clear();
+  pages_.clear();
+  pages_.shrink_to_fit();
+  size_ = 0;
+  idx_ = 0;
+}
+
+void FileBuffer::Flush(base::OnceCallback<void(bool)> callback) {
+  flush_timer_.Stop();
+
+  if (dirty_.empty()) {
+    if (!callback) {
+      return;
+    }
+    if (flushes_in_flight_ == 0) {
+      std::move(callback).Run(true);
+    } else {
+      flush_waiters_.push_back(std::move(callback));
+    }
+    return;
+  }
+
+  if (callback) {
+    flush_waiters_.push_back(std::move(callback));
+  }
+
+  Vector<DirtyRange> ranges = std::move(dirty_);
+  dirty_.clear();
+  ++flushes_in_flight_;
+
+  uint64_t dirty_bytes = 0;
+  for (const auto& range : ranges) {
+    dirty_bytes += range.end - range.start;
+  }
+
+  // Once most of the file has changed a single whole-file write is cheaper
+  // than one WriteAt per range.
+  if (dirty_bytes * 2 >= size_) {
+    GetRemote()->WriteBuffer(
+        Serialize(), mojo::WrapCallbackWithDefaultInvokeIfNotRun(
+                         WTF::BindOnce(&FileBuffer::OnFlushDone,
+                                       WrapPersistent(this), std::move(ranges)),
+                         false));
+    return;
+  }
+
+  auto barrier = base::BarrierCallback<bool>(
+      ranges.size(),
+      WTF::BindOnce(
+          [](FileBuffer* filebuffer, Vector<DirtyRange> ranges,
+             const std::vector<bool>& results) {
+            filebuffer->OnFlushDone(std::move(ranges),
+                                    std::ranges::all_of(results,
+                                                        std::identity()));
+          },
+          WrapPersistent(this), ranges));
+
+  for (const auto& range : ranges) {
+    Vector<uint8_t> bytes(static_cast<wtf_size_t>(range.end - range.start));
+    CopyOut(range.start, base::span(bytes));
+    GetRemote()->WriteAt(range.start, bytes,
+                         mojo::WrapCallbackWithDefaultInvokeIfNotRun(
+                             base::OnceCallback<void(bool)>(barrier), false));
+  }
+}
+
+void FileBuffer::SetWriteBehind(base::TimeDelta delay) {
+  write_behind_delay_ = delay;
+  if (!write_behind_delay_.is_positive()) {
+    flush_timer_.Stop();
+  } else if (!dirty_.empty()) {
+    flush_timer_.StartOneShot(write_behind_delay_, FROM_HERE);
+  }
+}
+
 void FileBuffer::Trace(Visitor* visitor) const {
-  visitor->Trace(remote_);
+  visitor->Trace(handle_);
+  visitor->Trace(open_resolver_);
+  visitor->Trace(flush_timer_);
 }
 
 mojom::cfs::blink::CodegateFile* FileBuffer::GetRemote() {
-  return remote_.get();
+  return handle_->file();
+}
+
+void FileBuffer::OnReadStream(bool success,
+                              uint64_t size,
+                              mojo::ScopedDataPipeConsumerHandle stream) {
+  if (!success || !stream || size > FILESIZE_MAX) {
+    open_resolver_->Reject(MakeGarbageCollected<DOMException>(
+        DOMExceptionCode::kOperationError, "Failed to open file."));
+    open_resolver_ = nullptr;
+    load_failed_ = true;
+    return;
+  }
+
+  // Only the page table is sized up front; pages are filled as bytes arrive.
+  pages_.resize(static_cast<wtf_size_t>((size + FILE_PAGE_SIZE - 1) /
+                                        FILE_PAGE_SIZE));
+  stream_size_ = size;
+  stream_ = std::move(stream);
+  stream_watcher_ = std::make_unique<mojo::SimpleWatcher>(
+      FROM_HERE, mojo::SimpleWatcher::ArmingPolicy::MANUAL, task_runner_);
+  stream_watcher_->Watch(
+      stream_.get(), MOJO_HANDLE_SIGNAL_READABLE,
+      WTF::BindRepeating(&FileBuffer::OnStreamReadable,
+                         WrapWeakPersistent(this)));
+  stream_watcher_->ArmOrNotify();
+}
+
+void FileBuffer::OnStreamReadable(MojoResult result) {
+  while (result == MOJO_RESULT_OK && load_offset_ < stream_size_) {
+    base::span<uint8_t> page = GetPageSpan(load_offset_);
+    page = page.first(
+        std::min<size_t>(page.size(), stream_size_ - load_offset_));
+
+    size_t bytes_read = 0;
+    MojoResult rv =
+        stream_->ReadData(MOJO_READ_DATA_FLAG_NONE, page, bytes_read);
+    if (rv == MOJO_RESULT_SHOULD_WAIT) {
+      stream_watcher_->ArmOrNotify();
+      return;
+    }
+    if (rv != MOJO_RESULT_OK) {
+      // The browser closed the pipe early because the file got shorter.
+      break;
+    }
+    load_offset_ += bytes_read;
+  }
+
+  FinishLoad();
+}
+
+void FileBuffer::FinishLoad() {
+  stream_watcher_.reset();
+  stream_.reset();
+  // Short if the browser ended the stream early.
+  size_ = load_offset_;
+  loaded_ = true;
+  if (open_resolver_) {
+    open_resolver_->Resolve("File opened");
+    open_resolver_ = nullptr;
+  }
+}
+
+void FileBuffer::MarkDirty(uint64_t start, uint64_t end) {
+  Vector<DirtyRange> merged;
+  merged.reserve(dirty_.size() + 1);
+  bool inserted = false;
+
+  for (const auto& range : dirty_) {
+    if (range.end < start) {
+      merged.push_back(range);
+    } else if (range.start > end) {
+      if (!inserted) {
+        merged.push_back(DirtyRange{start, end});
+        inserted = true;
+      }
+      merged.push_back(range);
+    } else {
+      start = std::min(start, range.start);
+      end = std::max(end, range.end);
+    }
+  }
+  if (!inserted) {
+    merged.push_back(DirtyRange{start, end});
+  }
+
+  dirty_ = std::move(merged);
+}
+
+void FileBuffer::OnFlushDone(Vector<DirtyRange> ranges, bool success) {
+  if (!success) {
+    // Keep the bytes dirty so the next flush retries them.
+    flush_failed_ = true;
+    for (const auto& range : ranges) {
+      MarkDirty(range.start, range.end);
+    }
+  }
+
+  if (--flushes_in_flight_ > 0) {
+    return;
+  }
+
+  bool all_succeeded = !flush_failed_;
+  flush_failed_ = false;
+  Vector<base::OnceCallback<void(bool)>> waiters = std::move(flush_waiters_);
+  flush_waiters_.clear();
+  for (auto& waiter : waiters) {
+    std::move(waiter).Run(all_succeeded);
+  }
+}
+
+void FileBuffer::OnFlushTimer(TimerBase*) {
+  Flush(base::OnceCallback<void(bool)>());
+}
+
+base::span<uint8_t> FileBuffer::GetPageSpan(uint64_t offset) {
+  wtf_size_t page_idx = static_cast<wtf_size_t>(offset / FILE_PAGE_SIZE);
+  if (page_idx >= pages_.size()) {
+    pages_.resize(page_idx + 1);
+  }
+  if (!pages_[page_idx]) {
+    pages_[page_idx] = std::make_unique<Page>();
+  }
+  return base::span(*pages_[page_idx]).subspan(offset % FILE_PAGE_SIZE);
+}
+
+void FileBuffer::CopyOut(uint64_t offset, base::span<uint8_t> out) const {
+  size_t done = 0;
+  while (done < out.size()) {
+    uint64_t pos = offset + done;
+    wtf_size_t page_idx = static_cast<wtf_size_t>(pos / FILE_PAGE_SIZE);
+    size_t page_offset = pos % FILE_PAGE_SIZE;
+    size_t count = std::min<size_t>(out.size() - done,
+                                    FILE_PAGE_SIZE - page_offset);
+
+    base::span<uint8_t> dest = out.subspan(done, count);
+    if (page_idx < pages_.size() && pages_[page_idx]) {
+      dest.copy_from(
+          base::span(*pages_[page_idx]).subspan(page_offset, count));
+    } else {
+      std::ranges::fill(dest, 0);
+    }
+    done += count;
+  }
 }
 
 }  // namespace blink
@@ -3,6 +3,7 @@
 #include "third_party/blink/renderer/modules/minishell/mini_shell.h"
 
 #include "base/memory/raw_ptr.h"
+#include "mojo/public/cpp/bindings/callback_helpers.h"
 #include "third_party/blink/renderer/platform/wtf/text/string_builder.h"
 
 namespace blink {
@@ -70,16 +71,42 @@ Vector<WTF::String> ParseShellArguments(const WTF::String& input) {
   return cmd_input;
 }
 
+namespace {
+
+// Wraps the reply |callback| of a call made for |resolver| so that the
+// promise is rejected if the pipe goes away before the reply comes. The
+// browser drops pipes it thinks were forgotten, and nothing else would
+// settle the promise then.
+template <typename... Args>
+base::OnceCallback<void(Args...)> RejectOnDrop(
+    ScriptPromiseResolver<IDLString>* resolver,
+    base::OnceCallback<void(Args...)> callback) {
+  return mojo::WrapCallbackWithDropHandler(
+      std::move(callback),
+      WTF::BindOnce(
+          [](ScriptPromiseResolver<IDLString>* resolver) {
+            resolver->Reject(MakeGarbageCollected<DOMException>(
+                DOMExceptionCode::kInvalidStateError, "Dead Pipe"));
+          },
+          WrapPersistent(resolver)));
+}
+
+}  // namespace
+
 MiniShell::MiniShell(
     ScriptState* script_state,
     mojo::PendingRemote<mojom::cfs::blink::CodegateDirectory> new_remote,
     uint32_t id)
-    : dir_remote_(ExecutionContext::From(script_state)),
+    : current_dir_(
+          MakeGarbageCollected<ItemHandle>(ExecutionContext::From(script_state),
+                                           String(),
+                                           std::move(new_remote))),
       file_descriptor_(nullptr),
-      shell_id_(id) {
-  dir_remote_.Bind(std::move(new_remote),
-                   ExecutionContext::From(script_state)
-                       ->GetTaskRunner(TaskType::kInternalDefault));
+      shell_id_(id),
+      observer_receiver_(this, ExecutionContext::From(script_state)),
+      listing_cache_valid_(false) {
+  WatchDirectory(ExecutionContext::From(script_state));
+  RefreshCwdPath();
 }
 
 MiniShell::~MiniShell() = default;
@@ -96,7 +123,7 @@ ScriptPromise<IDLString> MiniShell::execute(ScriptState* script_state,
       MakeGarbageCollected<ScriptPromiseResolver<IDLString>>(script_state);
   ScriptPromise<IDLString> promise = resolver->Promise();
 
-  if (!dir_remote_.is_bound()) {
+  if (!current_dir_->is_connected()) {
     resolver->Reject(MakeGarbageCollected<DOMException>(
         DOMExceptionCode::kInvalidStateError, "Dead Pipe"));
     return promise;
@@ -142,6 +169,20 @@ ScriptPromise<IDLString> MiniShell::execute(ScriptState* script_state,
     FUNC_SEEK(resolver, cmd_input);
   } else if (command == "save") {
     FUNC_SAVE(resolver, cmd_input);
+  } else if (command == "close") {
+    FUNC_CLOSE(resolver, cmd_input);
+  } else if (command == "writebehind") {
+    FUNC_WRITEBEHIND(resolver, cmd_input);
+  } else if (command == "rm") {
+    FUNC_RM(resolver, cmd_input);
+  } else if (command == "cp") {
+    FUNC_CP(resolver, cmd_input);
+  } else if (command == "du") {
+    FUNC_DU(resolver, cmd_input);
+  } else if (command == "find") {
+    FUNC_FIND(resolver, cmd_input);
+  } else if (command == "grep") {
+    FUNC_GREP(resolver, cmd_input);
   } else {
     resolver->Reject(MakeGarbageCollected<DOMException>(
         DOMExceptionCode::kSyntaxError, "Unknown command: " + command));
@@ -149,6 +190,94 @@ ScriptPromise<IDLString> MiniShell::execute(ScriptState* script_state,
   return promise;
 }
 
+ScriptPromise<IDLString> MiniShell::execute_batch(
+    ScriptState* script_state,
+    const Vector<String>& raw_inputs,
+    bool atomic,
+    ExceptionState& exception_state) {
+  auto* resolver =
+      MakeGarbageCollected<ScriptPromiseResolver<IDLString>>(script_state);
+  ScriptPromise<IDLString> promise = resolver->Promise();
+
+  if (!current_dir_->is_connected()) {
+    resolver->Reject(MakeGarbageCollected<DOMException>(
+        DOMExceptionCode::kInvalidStateError, "Dead Pipe"));
+    return promise;
+  }
+
+  Vector<mojom::cfs::blink::BatchOpPtr> ops;
+  // Index and resolved source path of every op that deletes, renames or
+  // moves an item, for dropping cached handles afterwards.
+  Vector<wtf_size_t> moving_ops;
+  Vector<String> moved_paths;
+  for (const auto& raw_input : raw_inputs) {
+    Vector<String> cmd_input = ParseShellArguments(raw_input);
+    String command = cmd_input.empty() ? String() : cmd_input[0];
+    blink::mojom::cfs::BatchOpType type;
+    String target = g_empty_string;
+
+    if (command == "touch" && cmd_input.size() == 2) {
+      type = blink::mojom::cfs::BatchOpType::kCreateFile;
+    } else if (command == "mkdir" && cmd_input.size() == 2) {
+      type = blink::mojom::cfs::BatchOpType::kCreateDir;
+    } else if (command == "delete" && cmd_input.size() == 2) {
+      if (GetBuffer()) {
+        resolver->Reject(MakeGarbageCollected<DOMException>(
+            DOMExceptionCode::kAbortError, "Close File First"));
+        return promise;
+      }
+      type = blink::mojom::cfs::BatchOpType::kDelete;
+    } else if (command == "rename" && cmd_input.size() == 3) {
+      type = blink::mojom::cfs::BatchOpType::kRename;
+      target = cmd_input[2];
+    } else if (command == "mvdir" && cmd_input.size() == 3) {
+      type = blink::mojom::cfs::BatchOpType::kMove;
+      target = cmd_input[2];
+    } else {
+      resolver->Reject(MakeGarbageCollected<DOMException>(
+          DOMExceptionCode::kSyntaxError,
+          "Unsupported batch command: " + raw_input));
+      return promise;
+    }
+
+    if (type == blink::mojom::cfs::BatchOpType::kDelete ||
+        type == blink::mojom::cfs::BatchOpType::kRename ||
+        type == blink::mojom::cfs::BatchOpType::kMove) {
+      moving_ops.push_back(ops.size());
+      moved_paths.push_back(ResolveCachePath(cmd_input[1]));
+    }
+    ops.push_back(mojom::cfs::blink::BatchOp::New(type, cmd_input[1], target));
+  }
+
+  GetDirectoryRemote()->ExecuteBatch(
+      std::move(ops), atomic,
+      RejectOnDrop(resolver, WTF::BindOnce(
+          [](MiniShell* minishell, ScriptPromiseResolver<IDLString>* resolver,
+             const Vector<String>& raw_inputs,
+             const Vector<wtf_size_t>& moving_ops,
+             const Vector<String>& moved_paths, bool committed,
+             const Vector<bool>& results) {
+            for (wtf_size_t i = 0; committed && i < moving_ops.size(); ++i) {
+              if (moving_ops[i] < results.size() && results[moving_ops[i]]) {
+                minishell->InvalidateCachedHandles(moved_paths[i]);
+              }
+            }
+            StringBuilder output;
+            for (wtf_size_t i = 0; i < raw_inputs.size(); ++i) {
+              output.Append(raw_inputs[i]);
+              output.Append(i < results.size() && results[i] ? ": ok\n"
+                                                             : ": failed\n");
+            }
+            if (!committed) {
+              output.Append("Batch rolled back.\n");
+            }
+            resolver->Resolve(output.ToString());
+          },
+          WrapPersistent(this), WrapPersistent(resolver), raw_inputs,
+          std::move(moving_ops), std::move(moved_paths))));
+  return promise;
+}
+
 void MiniShell::FUNC_HELP(ScriptPromiseResolver<IDLString>* resolver,
                           const Vector<String>& cmd_input) {
   if (cmd_input.size() != 1) {
@@ -160,20 +289,27 @@ void MiniShell::FUNC_HELP(ScriptPromiseResolver<IDLString>* resolver,
   res.Append("Available commands:\n");
   res.Append("  help\n");
   res.Append("  pwd\n");
-  res.Append("  ls\n");
-  res.Append("  mkdir <dirname>\n");
+  res.Append("  ls [-l]\n");
+  res.Append("  mkdir [-p] <dirname>\n");
   res.Append("  cd <path>\n");
   res.Append("  touch <filename>\n");
-  res.Append("  delete <filename>\n");
-  res.Append("  rename <oldname> <newname>\n");
+  res.Append("  delete <path>\n");
+  res.Append("  rename <path> <newname>\n");
   res.Append("  exec <filename>\n");
-  res.Append("  mvdir <src> <dst_parent_dir | new_dir_name_if_renaming>\n");
+  res.Append("  mvdir <src_path> <dst_dir_path>\n");
+  res.Append("  rm [-r] <path>\n");
+  res.Append("  cp [-r] <src_path> <dst_path>\n");
+  res.Append("  du [path]\n");
+  res.Append("  find <path> -name <glob> [-type f|d]\n");
+  res.Append("  grep <pattern> [path]\n");
 
   res.Append("  open <filepath>\n");
   res.Append("  read <count>\n");
   res.Append("  write <count> {hex1} {hex2} {hex3} . . .\n");
   res.Append("  seek <idx>\n");
   res.Append("  save\n");
+  res.Append("  close\n");
+  res.Append("  writebehind <delay_ms | off>\n");
   resolver->Resolve(res.ToString());
   return;
 }
@@ -186,44 +322,131 @@ void MiniShell::FUNC_PWD(ScriptPromiseResolver<IDLString>* resolver,
     return;
   }
 
-  GetDirectoryRemote()->GetPwd(WTF::BindOnce(
+  GetDirectoryRemote()->GetPwd(RejectOnDrop(resolver, WTF::BindOnce(
       [](MiniShell* minishell, ScriptPromiseResolver<IDLString>* resolver,
          const String& current_path) { resolver->Resolve(current_path); },
-      WrapPersistent(this), WrapPersistent(resolver)));
+      WrapPersistent(this), WrapPersistent(resolver))));
 }
 
 void MiniShell::FUNC_LS(ScriptPromiseResolver<IDLString>* resolver,
                         const Vector<String>& cmd_input) {
-  if (cmd_input.size() != 1) {
+  bool detailed = cmd_input.size() == 2 && cmd_input[1] == "-l";
+  if (cmd_input.size() != 1 && !detailed) {
     resolver->Reject(MakeGarbageCollected<DOMException>(
-        DOMExceptionCode::kSyntaxError, "ls: too many arguments."));
+        DOMExceptionCode::kSyntaxError, "ls [-l]"));
     return;
   }
-  GetDirectoryRemote()->ListItems(WTF::BindOnce(
-      [](MiniShell* minishell, ScriptPromiseResolver<IDLString>* resolver,
-         const Vector<String>& entries) {
-        StringBuilder output;
-        for (const auto& entry : entries) {
-          output.Append(entry);
-          output.Append("\n");
-        }
-        resolver->Resolve(output.ToString());
-      },
-      WrapPersistent(this), WrapPersistent(resolver)));
+
+  if (detailed) {
+    ListItemsDetailedFrom(resolver, current_dir_, 0,
+                          std::make_unique<StringBuilder>());
+    return;
+  }
+
+  if (listing_cache_valid_) {
+    StringBuilder output;
+    for (const auto& entry : listing_cache_) {
+      output.Append(entry);
+      output.Append("\n");
+    }
+    resolver->Resolve(output.ToString());
+    return;
+  }
+
+  ListItemsFrom(resolver, current_dir_, 0, std::make_unique<StringBuilder>());
+}
+
+void MiniShell::ListItemsFrom(ScriptPromiseResolver<IDLString>* resolver,
+                              ItemHandle* directory,
+                              uint64_t cursor,
+                              std::unique_ptr<StringBuilder> output) {
+  directory->directory()->ListItemsPage(
+      cursor, LS_PAGE_SIZE,
+      RejectOnDrop(resolver, WTF::BindOnce(
+          [](MiniShell* minishell, ScriptPromiseResolver<IDLString>* resolver,
+             ItemHandle* directory, std::unique_ptr<StringBuilder> output,
+             const Vector<String>& entries, uint64_t next_cursor, bool done) {
+            for (const auto& entry : entries) {
+              output->Append(entry);
+              output->Append("\n");
+            }
+            if (done) {
+              resolver->Resolve(output->ToString());
+              return;
+            }
+            minishell->ListItemsFrom(resolver, directory, next_cursor,
+                                     std::move(output));
+          },
+          WrapPersistent(this), WrapPersistent(resolver),
+          WrapPersistent(directory), std::move(output))));
+}
+
+void MiniShell::ListItemsDetailedFrom(
+    ScriptPromiseResolver<IDLString>* resolver,
+    ItemHandle* directory,
+    uint64_t cursor,
+    std::unique_ptr<StringBuilder> output) {
+  directory->directory()->ListItemsDetailed(
+      cursor, LS_PAGE_SIZE,
+      RejectOnDrop(resolver, WTF::BindOnce(
+          [](MiniShell* minishell, ScriptPromiseResolver<IDLString>* resolver,
+             ItemHandle* directory, std::unique_ptr<StringBuilder> output,
+             Vector<mojom::cfs::blink::ItemStatPtr> items,
+             uint64_t next_cursor, bool done) {
+            // <type> <size> <child count> <modifications> <name>
+            for (const auto& item : items) {
+              bool is_dir = item->type == blink::mojom::cfs::ITEMTYPE::kDir;
+              output->Append(is_dir ? "d\t" : "-\t");
+              output->AppendNumber(item->size);
+              output->Append("\t");
+              output->AppendNumber(item->child_count);
+              output->Append("\t");
+              output->AppendNumber(item->mod_count);
+              output->Append(is_dir ? "\t/" : "\t");
+              output->Append(item->name);
+              output->Append("\n");
+            }
+            if (done) {
+              resolver->Resolve(output->ToString());
+              return;
+            }
+            minishell->ListItemsDetailedFrom(resolver, directory, next_cursor,
+                                             std::move(output));
+          },
+          WrapPersistent(this), WrapPersistent(resolver),
+          WrapPersistent(directory), std::move(output))));
 }
 
 void MiniShell::FUNC_MKDIR(ScriptPromiseResolver<IDLString>* resolver,
                            const Vector<String>& cmd_input) {
-  if (cmd_input.size() != 2) {
+  bool parents = cmd_input.size() == 3 && cmd_input[1] == "-p";
+  if (cmd_input.size() != 2 && !parents) {
     resolver->Reject(MakeGarbageCollected<DOMException>(
-        DOMExceptionCode::kSyntaxError, "mkdir <dirname>"));
+        DOMExceptionCode::kSyntaxError, "mkdir [-p] <dirname>"));
+    return;
+  }
+
+  if (parents) {
+    GetDirectoryRemote()->CreateDirectories(
+        cmd_input[2],
+        RejectOnDrop(resolver, WTF::BindOnce(
+            [](ScriptPromiseResolver<IDLString>* resolver, bool success) {
+              if (success) {
+                resolver->Resolve("Directory created.");
+              } else {
+                resolver->Reject(MakeGarbageCollected<DOMException>(
+                    DOMExceptionCode::kOperationError,
+                    "Failed to create directory."));
+              }
+            },
+            WrapPersistent(resolver))));
     return;
   }
   String dirname = cmd_input[1];
 
   GetDirectoryRemote()->CreateItem(
       dirname, blink::mojom::cfs::ITEMTYPE::kDir,
-      WTF::BindOnce(
+      RejectOnDrop(resolver, WTF::BindOnce(
           [](MiniShell* minishell, ScriptPromiseResolver<IDLString>* resolver,
              blink::mojom::cfs::ITEMTYPE type,
              blink::mojom::cfs::blink::CodegateItemResponsePtr item) {
@@ -235,7 +458,7 @@ void MiniShell::FUNC_MKDIR(ScriptPromiseResolver<IDLString>* resolver,
                   "Failed to create directory."));
             }
           },
-          WrapPersistent(this), WrapPersistent(resolver)));
+          WrapPersistent(this), WrapPersistent(resolver))));
 }
 
 void MiniShell::FUNC_CD(ScriptPromiseResolver<IDLString>* resolver,
@@ -247,15 +470,47 @@ void MiniShell::FUNC_CD(ScriptPromiseResolver<IDLString>* resolver,
   }
 
   String path = cmd_input[1];
+  String resolved_path = ResolveCachePath(path);
+  if (ItemHandle* cached = TakeCachedHandle(resolved_path, true)) {
+    cached->directory()->GetPwd(RejectOnDrop(resolver, WTF::BindOnce(
+        [](MiniShell* minishell, ScriptPromiseResolver<IDLString>* resolver,
+           ItemHandle* cached, const String& path, const String& resolved_path,
+           const String& current_path) {
+          if (current_path != resolved_path) {
+            // Renamed or moved through another shell; |path| may now name
+            // another directory.
+            cached->Reset();
+            minishell->OpenDirectory(resolver, path, resolved_path);
+            return;
+          }
+          minishell->SetDirectory(cached, resolver->GetExecutionContext());
+          resolver->Resolve("Changed directory");
+        },
+        WrapPersistent(this), WrapPersistent(resolver), WrapPersistent(cached),
+        path, resolved_path)));
+    return;
+  }
+
+  OpenDirectory(resolver, path, resolved_path);
+}
+
+void MiniShell::OpenDirectory(ScriptPromiseResolver<IDLString>* resolver,
+                              const String& path,
+                              const String& resolved_path) {
   GetDirectoryRemote()->GetItemHandle(
       path,
-      WTF::BindOnce(
+      RejectOnDrop(resolver, WTF::BindOnce(
           [](MiniShell* minishell, ScriptPromiseResolver<IDLString>* resolver,
-             blink::mojom::cfs::ITEMTYPE type,
+             const String& resolved_path, blink::mojom::cfs::ITEMTYPE type,
              blink::mojom::cfs::blink::CodegateItemResponsePtr item) {
             if (type == blink::mojom::cfs::ITEMTYPE::kDir) {
-              minishell->SetDirectory(std::move(item->get_remote_dir()),
-                                      resolver->GetExecutionContext());
+              ExecutionContext* execution_context =
+                  resolver->GetExecutionContext();
+              minishell->SetDirectory(
+                  MakeGarbageCollected<ItemHandle>(
+                      execution_context, resolved_path,
+                      std::move(item->get_remote_dir())),
+                  execution_context);
               resolver->Resolve("Changed directory");
             } else if (type == blink::mojom::cfs::ITEMTYPE::kFile) {
               resolver->Reject(MakeGarbageCollected<DOMException>(
@@ -268,7 +523,7 @@ void MiniShell::FUNC_CD(ScriptPromiseResolver<IDLString>* resolver,
               return;
             }
           },
-          WrapPersistent(this), WrapPersistent(resolver)));
+          WrapPersistent(this), WrapPersistent(resolver), resolved_path)));
 }
 
 void MiniShell::FUNC_TOUCH(ScriptPromiseResolver<IDLString>* resolver,
@@ -282,7 +537,7 @@ void MiniShell::FUNC_TOUCH(ScriptPromiseResolver<IDLString>* resolver,
 
   GetDirectoryRemote()->CreateItem(
       filename, blink::mojom::cfs::ITEMTYPE::kFile,
-      WTF::BindOnce(
+      RejectOnDrop(resolver, WTF::BindOnce(
           [](MiniShell* minishell, ScriptPromiseResolver<IDLString>* resolver,
              blink::mojom::cfs::ITEMTYPE type,
              blink::mojom::cfs::blink::CodegateItemResponsePtr item) {
@@ -293,20 +548,20 @@ void MiniShell::FUNC_TOUCH(ScriptPromiseResolver<IDLString>* resolver,
                   DOMExceptionCode::kOperationError, "Failed to touch file."));
             }
           },
-          WrapPersistent(this), WrapPersistent(resolver)));
+          WrapPersistent(this), WrapPersistent(resolver))));
 }
 
 void MiniShell::FUNC_DELETE(ScriptPromiseResolver<IDLString>* resolver,
                             const Vector<String>& cmd_input) {
   if (cmd_input.size() != 2) {
     resolver->Reject(MakeGarbageCollected<DOMException>(
-        DOMExceptionCode::kSyntaxError, "delete <filename>"));
+        DOMExceptionCode::kSyntaxError, "delete <path>"));
     return;
   }
 
   if (GetBuffer()) {
     resolver->Reject(MakeGarbageCollected<DOMException>(
-        DOMExceptionCode::kAbortError, "Save File First"));
+        DOMExceptionCode::kAbortError, "Close File First"));
     return;
   }
 
@@ -314,24 +569,26 @@ void MiniShell::FUNC_DELETE(ScriptPromiseResolver<IDLString>* resolver,
 
   GetDirectoryRemote()->DeleteItem(
       filename_to_delete,
-      WTF::BindOnce(
+      RejectOnDrop(resolver, WTF::BindOnce(
           [](MiniShell* minishell, ScriptPromiseResolver<IDLString>* resolver,
-             bool success) {
+             const String& resolved_path, bool success) {
             if (success) {
+              minishell->InvalidateCachedHandles(resolved_path);
               resolver->Resolve("File deleted.");
             } else {
               resolver->Reject(MakeGarbageCollected<DOMException>(
                   DOMExceptionCode::kOperationError, "Failed to delete file."));
             }
           },
-          WrapPersistent(this), WrapPersistent(resolver)));
+          WrapPersistent(this), WrapPersistent(resolver),
+          ResolveCachePath(filename_to_delete))));
 }
 
 void MiniShell::FUNC_RENAME(ScriptPromiseResolver<IDLString>* resolver,
                             const Vector<String>& cmd_input) {
   if (cmd_input.size() != 3) {
     resolver->Reject(MakeGarbageCollected<DOMException>(
-        DOMExceptionCode::kSyntaxError, "rename <oldname> <newname>"));
+        DOMExceptionCode::kSyntaxError, "rename <path> <newname>"));
     return;
   }
   String old_name = cmd_input[1];
@@ -339,17 +596,19 @@ void MiniShell::FUNC_RENAME(ScriptPromiseResolver<IDLString>* resolver,
 
   GetDirectoryRemote()->RenameItem(
       old_name, new_name,
-      WTF::BindOnce(
+      RejectOnDrop(resolver, WTF::BindOnce(
           [](MiniShell* minishell, ScriptPromiseResolver<IDLString>* resolver,
-             bool success) {
+             const String& resolved_path, bool success) {
             if (success) {
+              minishell->InvalidateCachedHandles(resolved_path);
               resolver->Resolve("File renamed.");
             } else {
               resolver->Reject(MakeGarbageCollected<DOMException>(
                   DOMExceptionCode::kOperationError, "Failed to rename file."));
             }
           },
-          WrapPersistent(this), WrapPersistent(resolver)));
+          WrapPersistent(this), WrapPersistent(resolver),
+          ResolveCachePath(old_name))));
 }
 
 void MiniShell::FUNC_EXEC(ScriptPromiseResolver<IDLString>* resolver,
@@ -370,18 +629,186 @@ void MiniShell::FUNC_MVDIR(ScriptPromiseResolver<IDLString>* resolver,
 
   GetDirectoryRemote()->ChangeItemLocation(
       source, destination,
-      WTF::BindOnce(
+      RejectOnDrop(resolver, WTF::BindOnce(
           [](MiniShell* minishell, ScriptPromiseResolver<IDLString>* resolver,
-             blink::mojom::cfs::ITEMTYPE type,
+             const String& resolved_path, blink::mojom::cfs::ITEMTYPE type,
              blink::mojom::cfs::blink::CodegateItemResponsePtr item) {
             if (type == blink::mojom::cfs::ITEMTYPE::kFailed) {
               resolver->Reject(MakeGarbageCollected<DOMException>(
                   DOMExceptionCode::kOperationError, "Failed to move."));
             } else {
+              minishell->InvalidateCachedHandles(resolved_path);
               resolver->Resolve("Moved successfully.");
             }
           },
-          WrapPersistent(this), WrapPersistent(resolver)));
+          WrapPersistent(this), WrapPersistent(resolver),
+          ResolveCachePath(source))));
+}
+
+void MiniShell::FUNC_RM(ScriptPromiseResolver<IDLString>* resolver,
+                        const Vector<String>& cmd_input) {
+  bool recursive = cmd_input.size() == 3 && cmd_input[1] == "-r";
+  if (cmd_input.size() != 2 && !recursive) {
+    resolver->Reject(MakeGarbageCollected<DOMException>(
+        DOMExceptionCode::kSyntaxError, "rm [-r] <path>"));
+    return;
+  }
+
+  if (GetBuffer()) {
+    resolver->Reject(MakeGarbageCollected<DOMException>(
+        DOMExceptionCode::kAbortError, "Close File First"));
+    return;
+  }
+
+  String path = cmd_input[cmd_input.size() - 1];
+  GetDirectoryRemote()->RemoveItem(
+      path, recursive,
+      RejectOnDrop(resolver, WTF::BindOnce(
+          [](MiniShell* minishell, ScriptPromiseResolver<IDLString>* resolver,
+             const String& resolved_path, bool success,
+             uint64_t removed_items) {
+            if (!success) {
+              resolver->Reject(MakeGarbageCollected<DOMException>(
+                  DOMExceptionCode::kOperationError, "Failed to remove."));
+              return;
+            }
+            minishell->InvalidateCachedHandles(resolved_path);
+            resolver->Resolve("Removed " + String::Number(removed_items) +
+                              " item(s).");
+          },
+          WrapPersistent(this), WrapPersistent(resolver),
+          ResolveCachePath(path))));
+}
+
+void MiniShell::FUNC_CP(ScriptPromiseResolver<IDLString>* resolver,
+                        const Vector<String>& cmd_input) {
+  bool recursive = cmd_input.size() == 4 && cmd_input[1] == "-r";
+  if (cmd_input.size() != 3 && !recursive) {
+    resolver->Reject(MakeGarbageCollected<DOMException>(
+        DOMExceptionCode::kSyntaxError, "cp [-r] <src> <dst>"));
+    return;
+  }
+
+  wtf_size_t src_idx = recursive ? 2 : 1;
+  GetDirectoryRemote()->CopyItem(
+      cmd_input[src_idx], cmd_input[src_idx + 1], recursive,
+      RejectOnDrop(resolver, WTF::BindOnce(
+          [](ScriptPromiseResolver<IDLString>* resolver, bool success) {
+            if (success) {
+              resolver->Resolve("Copied successfully.");
+            } else {
+              resolver->Reject(MakeGarbageCollected<DOMException>(
+                  DOMExceptionCode::kOperationError, "Failed to copy."));
+            }
+          },
+          WrapPersistent(resolver))));
+}
+
+void MiniShell::FUNC_DU(ScriptPromiseResolver<IDLString>* resolver,
+                        const Vector<String>& cmd_input) {
+  if (cmd_input.size() > 2) {
+    resolver->Reject(MakeGarbageCollected<DOMException>(
+        DOMExceptionCode::kSyntaxError, "du [path]"));
+    return;
+  }
+
+  String path = cmd_input.size() == 2 ? cmd_input[1] : String(".");
+  GetDirectoryRemote()->GetDiskUsage(
+      path,
+      RejectOnDrop(resolver, WTF::BindOnce(
+          [](ScriptPromiseResolver<IDLString>* resolver, const String& path,
+             bool success, uint64_t bytes, uint64_t items) {
+            if (!success) {
+              resolver->Reject(MakeGarbageCollected<DOMException>(
+                  DOMExceptionCode::kNotFoundError, "Item not found."));
+              return;
+            }
+            resolver->Resolve(String::Number(bytes) + "\t" +
+                              String::Number(items) + "\t" + path);
+          },
+          WrapPersistent(resolver), path)));
+}
+
+void MiniShell::FUNC_FIND(ScriptPromiseResolver<IDLString>* resolver,
+                          const Vector<String>& cmd_input) {
+  bool files = true;
+  bool directories = true;
+  bool valid = (cmd_input.size() == 4 || cmd_input.size() == 6) &&
+               cmd_input[2] == "-name";
+  if (valid && cmd_input.size() == 6) {
+    valid = cmd_input[4] == "-type" &&
+            (cmd_input[5] == "f" || cmd_input[5] == "d");
+    files = valid && cmd_input[5] == "f";
+    directories = valid && cmd_input[5] == "d";
+  }
+  if (!valid) {
+    resolver->Reject(MakeGarbageCollected<DOMException>(
+        DOMExceptionCode::kSyntaxError,
+        "find <path> -name <glob> [-type f|d]"));
+    return;
+  }
+
+  GetDirectoryRemote()->Find(
+      cmd_input[1], cmd_input[3], files, directories, FIND_RESULTS_MAX,
+      RejectOnDrop(resolver, WTF::BindOnce(
+          [](ScriptPromiseResolver<IDLString>* resolver, bool success,
+             const Vector<String>& paths, bool truncated) {
+            if (!success) {
+              resolver->Reject(MakeGarbageCollected<DOMException>(
+                  DOMExceptionCode::kNotFoundError, "Directory not found."));
+              return;
+            }
+            StringBuilder output;
+            for (const String& path : paths) {
+              output.Append(path);
+              output.Append("\n");
+            }
+            if (truncated) {
+              output.Append("(more results not shown)\n");
+            }
+            resolver->Resolve(output.ToString());
+          },
+          WrapPersistent(resolver))));
+}
+
+void MiniShell::FUNC_GREP(ScriptPromiseResolver<IDLString>* resolver,
+                          const Vector<String>& cmd_input) {
+  if (cmd_input.size() != 2 && cmd_input.size() != 3) {
+    resolver->Reject(MakeGarbageCollected<DOMException>(
+        DOMExceptionCode::kSyntaxError, "grep <pattern> [path]"));
+    return;
+  }
+
+  // The browser searches raw bytes, so the pattern goes as UTF-8.
+  std::string utf8 = cmd_input[1].Utf8();
+  Vector<uint8_t> pattern;
+  pattern.AppendRange(utf8.begin(), utf8.end());
+  String path = cmd_input.size() == 3 ? cmd_input[2] : String(".");
+
+  GetDirectoryRemote()->Grep(
+      path, std::move(pattern), GREP_MATCHES_MAX,
+      RejectOnDrop(resolver, WTF::BindOnce(
+          [](ScriptPromiseResolver<IDLString>* resolver, bool success,
+             Vector<mojom::cfs::blink::GrepMatchPtr> matches,
+             bool truncated) {
+            if (!success) {
+              resolver->Reject(MakeGarbageCollected<DOMException>(
+                  DOMExceptionCode::kOperationError, "Failed to search."));
+              return;
+            }
+            StringBuilder output;
+            for (const auto& match : matches) {
+              output.Append(match->path);
+              output.Append(":");
+              output.AppendNumber(match->offset);
+              output.Append("\n");
+            }
+            if (truncated) {
+              output.Append("(more matches not shown)\n");
+            }
+            resolver->Resolve(output.ToString());
+          },
+          WrapPersistent(resolver))));
 }
 
 void MiniShell::FUNC_OPEN(ScriptPromiseResolver<IDLString>* resolver,
@@ -398,22 +825,54 @@ void MiniShell::FUNC_OPEN(ScriptPromiseResolver<IDLString>* resolver,
   }
 
   String filepath = cmd_input[1];
+  String resolved_path = ResolveCachePath(filepath);
+  if (ItemHandle* cached = TakeCachedHandle(resolved_path, false)) {
+    cached->file()->GetPath(RejectOnDrop(resolver, WTF::BindOnce(
+        [](MiniShell* minishell, ScriptPromiseResolver<IDLString>* resolver,
+           ItemHandle* cached, const String& path, const String& resolved_path,
+           const String& current_path) {
+          if (current_path != resolved_path) {
+            cached->Reset();
+            minishell->OpenFile(resolver, path, resolved_path);
+            return;
+          }
+          if (minishell->GetBuffer()) {
+            // Another open won the race while the path was checked.
+            minishell->CacheHandle(cached);
+            resolver->Resolve("Close Current File Handle");
+            return;
+          }
+          minishell->SetBuffer(cached, resolver);
+        },
+        WrapPersistent(this), WrapPersistent(resolver), WrapPersistent(cached),
+        filepath, resolved_path)));
+    return;
+  }
+
+  OpenFile(resolver, filepath, resolved_path);
+}
 
+void MiniShell::OpenFile(ScriptPromiseResolver<IDLString>* resolver,
+                         const String& path,
+                         const String& resolved_path) {
   GetDirectoryRemote()->GetItemHandle(
-      filepath,
-      WTF::BindOnce(
+      path,
+      RejectOnDrop(resolver, WTF::BindOnce(
           [](MiniShell* minishell, ScriptPromiseResolver<IDLString>* resolver,
-             blink::mojom::cfs::ITEMTYPE type,
+             const String& resolved_path, blink::mojom::cfs::ITEMTYPE type,
              blink::mojom::cfs::blink::CodegateItemResponsePtr item) {
             if (type != blink::mojom::cfs::ITEMTYPE::kFile) {
               resolver->Reject(MakeGarbageCollected<DOMException>(
                   DOMExceptionCode::kNotFoundError, "Failed to open file."));
               return;
             }
-            minishell->SetBuffer(std::move(item->get_remote_file()),
-                                 WrapPersistent(resolver));
+            minishell->SetBuffer(
+                MakeGarbageCollected<ItemHandle>(
+                    resolver->GetExecutionContext(), resolved_path,
+                    std::move(item->get_remote_file())),
+                resolver);
           },
-          WrapPersistent(this), WrapPersistent(resolver)));
+          WrapPersistent(this), WrapPersistent(resolver), resolved_path)));
 }
 
 void MiniShell::FUNC_READ(ScriptPromiseResolver<IDLString>* resolver,
@@ -429,6 +888,11 @@ void MiniShell::FUNC_READ(ScriptPromiseResolver<IDLString>* resolver,
         DOMExceptionCode::kAbortError, "Open File First"));
     return;
   }
+  if (!GetBuffer()->is_loaded()) {
+    resolver->Reject(MakeGarbageCollected<DOMException>(
+        DOMExceptionCode::kInvalidStateError, "File Still Opening"));
+    return;
+  }
 
   uint64_t read_size = std::stoull(cmd_input[1].Ascii().c_str());
 
@@ -449,6 +913,11 @@ void MiniShell::FUNC_WRITE(ScriptPromiseResolver<IDLString>* resolver,
         DOMExceptionCode::kAbortError, "Open File First"));
     return;
   }
+  if (!GetBuffer()->is_loaded()) {
+    resolver->Reject(MakeGarbageCollected<DOMException>(
+        DOMExceptionCode::kInvalidStateError, "File Still Opening"));
+    return;
+  }
 
   uint64_t write_size = std::stoull(cmd_input[1].Ascii().c_str());
   if (write_size + 2 != cmd_input.size()) {
@@ -463,7 +932,11 @@ void MiniShell::FUNC_WRITE(ScriptPromiseResolver<IDLString>* resolver,
     write_data.push_back(std::stoul(cmd_input[i].Ascii().c_str(), nullptr, 16));
   }
 
-  GetBuffer()->write(write_data);
+  if (!GetBuffer()->write(write_data)) {
+    resolver->Reject(MakeGarbageCollected<DOMException>(
+        DOMExceptionCode::kQuotaExceededError, "File too large"));
+    return;
+  }
   resolver->Resolve("write successed");
 }
 
@@ -480,6 +953,11 @@ void MiniShell::FUNC_SEEK(ScriptPromiseResolver<IDLString>* resolver,
         DOMExceptionCode::kAbortError, "Open File First"));
     return;
   }
+  if (!GetBuffer()->is_loaded()) {
+    resolver->Reject(MakeGarbageCollected<DOMException>(
+        DOMExceptionCode::kInvalidStateError, "File Still Opening"));
+    return;
+  }
 
   uint64_t seek_idx = std::stoull(cmd_input[1].Ascii().c_str());
   GetBuffer()->SetIdx(seek_idx);
@@ -499,46 +977,408 @@ void MiniShell::FUNC_SAVE(ScriptPromiseResolver<IDLString>* resolver,
         DOMExceptionCode::kAbortError, "Open File First"));
     return;
   }
+  if (!GetBuffer()->is_loaded()) {
+    resolver->Reject(MakeGarbageCollected<DOMException>(
+        DOMExceptionCode::kInvalidStateError, "File Still Opening"));
+    return;
+  }
 
-  Vector<uint8_t> data_write = GetBuffer()->read(FILESIZE_MAX);
-
-  auto file_write_callback = WTF::BindOnce(
-      [](MiniShell* minishell, ScriptPromiseResolver<IDLString>* resolver, bool success) {
+  // Only the dirty ranges go to the browser and the handle stays open.
+  GetBuffer()->Flush(WTF::BindOnce(
+      [](MiniShell* minishell, ScriptPromiseResolver<IDLString>* resolver,
+         bool success) {
         if (success) {
-          minishell->GetFileRemote()->Close(base::NullCallback());
-          minishell->ResetBuffer();
           resolver->Resolve("File saved.");
         } else {
           resolver->Reject(MakeGarbageCollected<DOMException>(
               DOMExceptionCode::kOperationError, "Failed to write."));
         }
       },
-      WrapPersistent(this), WrapPersistent(resolver));
+      WrapPersistent(this), WrapPersistent(resolver)));
+}
+
+void MiniShell::FUNC_CLOSE(ScriptPromiseResolver<IDLString>* resolver,
+                           const Vector<String>& cmd_input) {
+  if (cmd_input.size() != 1) {
+    resolver->Reject(MakeGarbageCollected<DOMException>(
+        DOMExceptionCode::kSyntaxError, "close: too many arguments."));
+    return;
+  }
 
-  GetFileRemote()->Write(data_write, std::move(file_write_callback));
+  if (GetBuffer() == nullptr) {
+    resolver->Reject(MakeGarbageCollected<DOMException>(
+        DOMExceptionCode::kAbortError, "Open File First"));
+    return;
+  }
+  if (!GetBuffer()->is_loaded()) {
+    resolver->Reject(MakeGarbageCollected<DOMException>(
+        DOMExceptionCode::kInvalidStateError, "File Still Opening"));
+    return;
+  }
+
+  GetBuffer()->Flush(WTF::BindOnce(
+      [](MiniShell* minishell, ScriptPromiseResolver<IDLString>* resolver,
+         bool success) {
+        if (!success) {
+          resolver->Reject(MakeGarbageCollected<DOMException>(
+              DOMExceptionCode::kOperationError, "Failed to write."));
+          return;
+        }
+        if (minishell->GetBuffer()) {
+          // The pipe stays open in the handle cache so that reopening the
+          // file skips GetItemHandle.
+          minishell->CacheHandle(minishell->GetBuffer()->handle());
+          minishell->ResetBuffer();
+        }
+        resolver->Resolve("File closed.");
+      },
+      WrapPersistent(this), WrapPersistent(resolver)));
 }
 
-void MiniShell::SetDirectory(
-    mojo::PendingRemote<mojom::cfs::blink::CodegateDirectory> new_dir_remote,
-    ExecutionContext* execution_context) {
-  dir_remote_.reset();
-  dir_remote_.Bind(std::move(new_dir_remote), execution_context->GetTaskRunner(
-                                                  TaskType::kInternalDefault));
+void MiniShell::FUNC_WRITEBEHIND(ScriptPromiseResolver<IDLString>* resolver,
+                                 const Vector<String>& cmd_input) {
+  if (cmd_input.size() != 2) {
+    resolver->Reject(MakeGarbageCollected<DOMException>(
+        DOMExceptionCode::kSyntaxError, "writebehind <delay_ms | off>"));
+    return;
+  }
+
+  if (GetBuffer() == nullptr) {
+    resolver->Reject(MakeGarbageCollected<DOMException>(
+        DOMExceptionCode::kAbortError, "Open File First"));
+    return;
+  }
+  if (!GetBuffer()->is_loaded()) {
+    resolver->Reject(MakeGarbageCollected<DOMException>(
+        DOMExceptionCode::kInvalidStateError, "File Still Opening"));
+    return;
+  }
+
+  if (cmd_input[1] == "off") {
+    GetBuffer()->SetWriteBehind(base::TimeDelta());
+    resolver->Resolve("Write-behind disabled");
+    return;
+  }
+
+  bool ok = false;
+  uint32_t delay_ms = cmd_input[1].ToUInt(&ok);
+  if (!ok || delay_ms == 0) {
+    resolver->Reject(MakeGarbageCollected<DOMException>(
+        DOMExceptionCode::kSyntaxError, "writebehind <delay_ms | off>"));
+    return;
+  }
+
+  GetBuffer()->SetWriteBehind(base::Milliseconds(delay_ms));
+  resolver->Resolve("Write-behind enabled");
+}
+
+void MiniShell::SetDirectory(ItemHandle* new_dir,
+                             ExecutionContext* execution_context) {
+  // The observer is associated with the old directory's pipe, so it has to go
+  // before that pipe is parked in the cache.
+  observer_receiver_.reset();
+  CacheHandle(current_dir_);
+  current_dir_ = new_dir;
+  WatchDirectory(execution_context);
+  if (current_dir_->path().IsNull()) {
+    RefreshCwdPath();
+  }
+}
+
+void MiniShell::WatchDirectory(ExecutionContext* execution_context) {
+  observer_receiver_.reset();
+  listing_cache_.clear();
+  listing_cache_valid_ = false;
+
+  GetDirectoryRemote()->AddObserver(
+      observer_receiver_.BindNewEndpointAndPassRemote(
+          execution_context->GetTaskRunner(TaskType::kInternalDefault)));
+  observer_receiver_.set_disconnect_handler(WTF::BindOnce(
+      &MiniShell::OnObserverDisconnect, WrapWeakPersistent(this)));
+  current_dir_->set_disconnect_handler(WTF::BindOnce(
+      &MiniShell::OnDirectoryDisconnect, WrapWeakPersistent(this),
+      WrapWeakPersistent(current_dir_.Get()),
+      WrapWeakPersistent(execution_context)));
+}
+
+void MiniShell::OnObserverDisconnect() {
+  observer_receiver_.reset();
+  listing_cache_.clear();
+  listing_cache_valid_ = false;
+}
+
+void MiniShell::OnListing(const Vector<String>& entries) {
+  listing_cache_ = entries;
+  listing_cache_valid_ = true;
+}
+
+void MiniShell::OnItemAdded(const String& entry) {
+  listing_cache_.push_back(entry);
+}
+
+void MiniShell::OnItemRemoved(const String& entry) {
+  wtf_size_t idx = listing_cache_.Find(entry);
+  if (idx != kNotFound) {
+    listing_cache_.EraseAt(idx);
+  }
+}
+
+void MiniShell::OnItemRenamed(const String& entry_old,
+                              const String& entry_new) {
+  wtf_size_t idx = listing_cache_.Find(entry_old);
+  if (idx != kNotFound) {
+    listing_cache_[idx] = entry_new;
+  }
 }
 
-void MiniShell::SetBuffer(
-    mojo::PendingRemote<mojom::cfs::blink::CodegateFile> new_file_remote,
-    ScriptPromiseResolver<IDLString>* resolver) {
-  file_descriptor_ =
-      MakeGarbageCollected<FileBuffer>(std::move(new_file_remote), resolver);
+void MiniShell::SetBuffer(ItemHandle* file,
+                          ScriptPromiseResolver<IDLString>* resolver) {
+  file_descriptor_ = MakeGarbageCollected<FileBuffer>(file, resolver);
+  file->set_disconnect_handler(WTF::BindOnce(
+      &MiniShell::OnFileDisconnect, WrapWeakPersistent(this),
+      WrapWeakPersistent(file_descriptor_.Get()),
+      WrapWeakPersistent(
+          ExecutionContext::From(resolver->GetScriptState()))));
+}
+
+void MiniShell::OnDirectoryDisconnect(ItemHandle* dir,
+                                      ExecutionContext* execution_context) {
+  // A handle parked in the cache is dropped when it is next taken out.
+  if (!dir || dir != current_dir_ || !execution_context) {
+    return;
+  }
+  ReopenHandle(
+      dir, execution_context,
+      WTF::BindOnce(
+          [](MiniShell* minishell, ItemHandle* dir,
+             ExecutionContext* execution_context, ItemHandle* reopened) {
+            if (minishell->current_dir_ != dir || !execution_context) {
+              return;
+            }
+            minishell->SetDirectory(reopened, execution_context);
+          },
+          WrapWeakPersistent(this), WrapWeakPersistent(dir),
+          WrapWeakPersistent(execution_context)));
+}
+
+void MiniShell::OnFileDisconnect(FileBuffer* buffer,
+                                 ExecutionContext* execution_context) {
+  // Whatever was in flight failed and is still marked dirty, so the next
+  // save resends it through the reopened handle.
+  if (!buffer || buffer != file_descriptor_ || !buffer->is_loaded() ||
+      !execution_context) {
+    return;
+  }
+  ReopenHandle(
+      buffer->handle(), execution_context,
+      WTF::BindOnce(
+          [](MiniShell* minishell, FileBuffer* buffer,
+             ExecutionContext* execution_context, ItemHandle* reopened) {
+            if (minishell->file_descriptor_ != buffer || !execution_context) {
+              return;
+            }
+            buffer->Reconnect(reopened);
+            reopened->set_disconnect_handler(WTF::BindOnce(
+                &MiniShell::OnFileDisconnect, WrapWeakPersistent(minishell),
+                WrapWeakPersistent(buffer),
+                WrapWeakPersistent(execution_context)));
+          },
+          WrapWeakPersistent(this), WrapWeakPersistent(buffer),
+          WrapWeakPersistent(execution_context)));
+}
+
+void MiniShell::ReopenHandle(ItemHandle* handle,
+                             ExecutionContext* execution_context,
+                             base::OnceCallback<void(ItemHandle*)> callback) {
+  if (handle->path().IsNull()) {
+    return;
+  }
+
+  ItemHandle* via = nullptr;
+  if (current_dir_->is_connected()) {
+    via = current_dir_;
+  } else {
+    for (ItemHandle* cached : handle_cache_) {
+      if (cached->is_directory() && cached->is_connected()) {
+        via = cached;
+        break;
+      }
+    }
+  }
+  if (!via) {
+    return;
+  }
+
+  // The path is absolute, so any directory of the filesystem resolves it.
+  via->directory()->GetItemHandle(
+      handle->path(),
+      WTF::BindOnce(
+          [](ItemHandle* handle, ExecutionContext* execution_context,
+             base::OnceCallback<void(ItemHandle*)> callback,
+             mojom::cfs::blink::ITEMTYPE type,
+             mojom::cfs::blink::CodegateItemResponsePtr item) {
+            if (!execution_context || !item) {
+              return;
+            }
+            if (handle->is_directory() &&
+                type == mojom::cfs::blink::ITEMTYPE::kDir) {
+              std::move(callback).Run(MakeGarbageCollected<ItemHandle>(
+                  execution_context, handle->path(),
+                  std::move(item->get_remote_dir())));
+            } else if (!handle->is_directory() &&
+                       type == mojom::cfs::blink::ITEMTYPE::kFile) {
+              std::move(callback).Run(MakeGarbageCollected<ItemHandle>(
+                  execution_context, handle->path(),
+                  std::move(item->get_remote_file())));
+            }
+          },
+          WrapPersistent(handle), WrapWeakPersistent(execution_context),
+          std::move(callback)));
+}
+
+String MiniShell::ResolveCachePath(const String& path) const {
+  const String& cwd = current_dir_->path();
+  if (cwd.IsNull() || path.empty()) {
+    return String();
+  }
+
+  Vector<String> cwd_components;
+  cwd.Split('/', cwd_components);
+  Vector<String> components;
+  path.Split('/', components);
+  if (cwd_components.empty()) {
+    return String();
+  }
+
+  // Components up to |known_dirs| are directories that exist; anything past
+  // that was only named by |path|. "." or ".." after such a name would make
+  // the browser check that it is a directory, which only it can do.
+  Vector<String> resolved;
+  wtf_size_t idx = 0;
+  if (path[0] == '/') {
+    if (!components.empty()) {
+      if (components[0] != cwd_components[0]) {
+        return String();
+      }
+      idx = 1;
+    }
+    resolved.push_back(cwd_components[0]);
+  } else {
+    resolved = cwd_components;
+  }
+  wtf_size_t known_dirs = resolved.size();
+
+  for (; idx < components.size(); ++idx) {
+    const String& component = components[idx];
+    if (component == "." || component == "..") {
+      if (resolved.size() > known_dirs) {
+        return String();
+      }
+      // ".." at the root stays at the root.
+      if (component == ".." && resolved.size() > 1) {
+        resolved.pop_back();
+        known_dirs = resolved.size();
+      }
+      continue;
+    }
+    resolved.push_back(component);
+  }
+
+  StringBuilder builder;
+  for (const auto& component : resolved) {
+    builder.Append('/');
+    builder.Append(component);
+  }
+  return builder.ToString();
+}
+
+ItemHandle* MiniShell::TakeCachedHandle(const String& path,
+                                        bool want_directory) {
+  if (path.IsNull()) {
+    return nullptr;
+  }
+
+  for (wtf_size_t i = 0; i < handle_cache_.size(); ++i) {
+    ItemHandle* handle = handle_cache_[i];
+    if (handle->path() != path) {
+      continue;
+    }
+    if (handle->is_directory() != want_directory) {
+      return nullptr;
+    }
+
+    handle_cache_.EraseAt(i);
+    if (!handle->is_connected()) {
+      handle->Reset();
+      return nullptr;
+    }
+    return handle;
+  }
+  return nullptr;
+}
+
+void MiniShell::CacheHandle(ItemHandle* handle) {
+  if (handle->path().IsNull() || !handle->is_connected()) {
+    handle->Reset();
+    return;
+  }
+
+  for (wtf_size_t i = 0; i < handle_cache_.size(); ++i) {
+    if (handle_cache_[i]->path() == handle->path()) {
+      handle_cache_[i]->Reset();
+      handle_cache_.EraseAt(i);
+      break;
+    }
+  }
+
+  handle_cache_.push_back(handle);
+  if (handle_cache_.size() > HANDLE_CACHE_SIZE) {
+    handle_cache_.front()->Reset();
+    handle_cache_.EraseAt(0);
+  }
+}
+
+void MiniShell::InvalidateCachedHandles(const String& path) {
+  String prefix = path.IsNull() ? String() : path + "/";
+  auto is_stale = [&](const String& cached_path) {
+    return path.IsNull() || cached_path == path ||
+           cached_path.StartsWith(prefix);
+  };
+
+  HeapVector<Member<ItemHandle>> kept;
+  for (auto& handle : handle_cache_) {
+    if (is_stale(handle->path())) {
+      handle->Reset();
+    } else {
+      kept.push_back(handle);
+    }
+  }
+  handle_cache_ = std::move(kept);
+
+  // Renaming or moving an ancestor changes where the shell itself is.
+  if (!current_dir_->path().IsNull() && is_stale(current_dir_->path())) {
+    RefreshCwdPath();
+  }
+}
+
+void MiniShell::RefreshCwdPath() {
+  ItemHandle* dir = current_dir_;
+  dir->set_path(String());
+  GetDirectoryRemote()->GetPwd(WTF::BindOnce(
+      [](ItemHandle* dir, const String& path) { dir->set_path(path); },
+      WrapPersistent(dir)));
 }
 
 void MiniShell::ResetBuffer() {
+  // Drop the pages now rather than whenever the buffer gets collected.
+  if (file_descriptor_) {
+    file_descriptor_->ReleasePages();
+  }
   file_descriptor_ = nullptr;
 }
 
 mojom::cfs::blink::CodegateDirectory* MiniShell::GetDirectoryRemote() {
-  return dir_remote_.get();
+  return current_dir_->directory();
 }
 
 mojom::cfs::blink::CodegateFile* MiniShell::GetFileRemote() {
@@ -546,13 +1386,67 @@ mojom::cfs::blink::CodegateFile* MiniShell::GetFileRemote() {
 }
 
 FileBuffer* MiniShell::GetBuffer() {
+  // A file whose load failed was never opened.
+  if (file_descriptor_ && file_descriptor_->load_failed()) {
+    ResetBuffer();
+  }
   return file_descriptor_.Get();
 }
 
 void MiniShell::Trace(Visitor* visitor) const {
-  visitor->Trace(dir_remote_);
+  visitor->Trace(current_dir_);
   visitor->Trace(file_descriptor_);
+  visitor->Trace(observer_receiver_);
+  visitor->Trace(handle_cache_);
   ScriptWrappable::Trace(visitor);
 }
 
+ItemHandle::ItemHandle(
+    ExecutionContext* execution_context,
+    const String& path,
+    mojo::PendingRemote<mojom::cfs::blink::CodegateDirectory> remote)
+    : path_(path),
+      dir_remote_(execution_context),
+      file_remote_(execution_context) {
+  dir_remote_.Bind(std::move(remote), execution_context->GetTaskRunner(
+                                          TaskType::kInternalDefault));
+}
+
+ItemHandle::ItemHandle(
+    ExecutionContext* execution_context,
+    const String& path,
+    mojo::PendingRemote<mojom::cfs::blink::CodegateFile> remote)
+    : path_(path),
+      dir_remote_(execution_context),
+      file_remote_(execution_context) {
+  file_remote_.Bind(std::move(remote), execution_context->GetTaskRunner(
+                                           TaskType::kInternalDefault));
+}
+
+bool ItemHandle::is_bound() const {
+  return dir_remote_.is_bound() || file_remote_.is_bound();
+}
+
+bool ItemHandle::is_connected() const {
+  return dir_remote_.is_connected() || file_remote_.is_connected();
+}
+
+void ItemHandle::set_disconnect_handler(base::OnceClosure handler) {
+  if (dir_remote_.is_bound()) {
+    dir_remote_.set_disconnect_handler(std::move(handler));
+  } else {
+    file_remote_.set_disconnect_handler(std::move(handler));
+  }
+}
+
+void ItemHandle::Reset() {
+  dir_remote_.reset();
+  file_remote_.reset();
+}
+
+void ItemHandle::Trace(Visitor* visitor) const {
+  visitor->Trace(dir_remote_);
+  visitor->Trace(file_remote_);
+}
+
 }  // namespace blink
@@ -11,16 +11,39 @@
 #include "third_party/blink/renderer/modules/modules_export.h"
 #include "third_party/blink/renderer/platform/bindings/exception_state.h"
 #include "third_party/blink/renderer/platform/bindings/script_state.h"
+#include "third_party/blink/renderer/platform/heap/collection_support/heap_vector.h"
 #include "third_party/blink/renderer/platform/heap/garbage_collected.h"
+#include "third_party/blink/renderer/platform/mojo/heap_mojo_associated_receiver.h"
 #include "third_party/blink/renderer/platform/mojo/heap_mojo_remote.h"
+#include "third_party/blink/renderer/platform/timer.h"
+#include "third_party/blink/renderer/platform/wtf/text/string_builder.h"
 #include "base/memory/scoped_refptr.h"
+#include "mojo/public/cpp/base/big_buffer.h"
+#include "mojo/public/cpp/system/data_pipe.h"
+#include "mojo/public/cpp/system/simple_watcher.h"
 
-#define FILESIZE_MAX 1024
+#include <array>
+#include <memory>
+
+// Matches CFS_FILESIZE_MAX on the browser side.
+#define FILESIZE_MAX (64 * 1024 * 1024)
+#define FILE_PAGE_SIZE 4096
+// Entries requested per ListItemsPage call when ls has no cached listing.
+#define LS_PAGE_SIZE 256
+// Bound handles MiniShell keeps for reuse by cd and open.
+#define HANDLE_CACHE_SIZE 16
+// Paths find asks the browser for; the rest are reported as truncated.
+#define FIND_RESULTS_MAX 1000
+// Matches grep asks the browser for.
+#define GREP_MATCHES_MAX 1000
 
 namespace blink {
 class FileBuffer;
+class ItemHandle;
 
-class MODULES_EXPORT MiniShell final : public ScriptWrappable {
+class MODULES_EXPORT MiniShell final
+    : public ScriptWrappable,
+      public mojom::cfs::blink::CodegateDirectoryObserver {
   DEFINE_WRAPPERTYPEINFO();
 
  public:
@@ -40,6 +63,19 @@ class MODULES_EXPORT MiniShell final : public ScriptWrappable {
                                    const String& raw_input,
                                    ExceptionState& exception_state);
 
+  // [CallWith=ScriptState, RaisesException] Promise<DOMString>
+  // execute_batch(sequence<DOMString> commands, optional boolean atomic);
+  ScriptPromise<IDLString> execute_batch(ScriptState* script_state,
+                                         const Vector<String>& raw_inputs,
+                                         bool atomic,
+                                         ExceptionState& exception_state);
+
+  // mojom::cfs::blink::CodegateDirectoryObserver
+  void OnListing(const Vector<String>& entries) override;
+  void OnItemAdded(const String& entry) override;
+  void OnItemRemoved(const String& entry) override;
+  void OnItemRenamed(const String& entry_old, const String& entry_new) override;
+
   void Trace(Visitor* visitor) const override;
 
   private:
@@ -74,45 +110,225 @@ class MODULES_EXPORT MiniShell final : public ScriptWrappable {
                  const Vector<String>& cmd_input);
   void FUNC_SAVE(ScriptPromiseResolver<IDLString>* resolver,
                  const Vector<String>& cmd_input);
+  void FUNC_CLOSE(ScriptPromiseResolver<IDLString>* resolver,
+                  const Vector<String>& cmd_input);
+  void FUNC_WRITEBEHIND(ScriptPromiseResolver<IDLString>* resolver,
+                        const Vector<String>& cmd_input);
+  void FUNC_RM(ScriptPromiseResolver<IDLString>* resolver,
+               const Vector<String>& cmd_input);
+  void FUNC_CP(ScriptPromiseResolver<IDLString>* resolver,
+               const Vector<String>& cmd_input);
+  void FUNC_DU(ScriptPromiseResolver<IDLString>* resolver,
+               const Vector<String>& cmd_input);
+  void FUNC_FIND(ScriptPromiseResolver<IDLString>* resolver,
+                 const Vector<String>& cmd_input);
+  void FUNC_GREP(ScriptPromiseResolver<IDLString>* resolver,
+                 const Vector<String>& cmd_input);
+
+  // Switches to, or opens, the item at |path| through GetItemHandle.
+  // |resolved_path| is what ResolveCachePath made of |path|.
+  void OpenDirectory(ScriptPromiseResolver<IDLString>* resolver,
+                     const String& path,
+                     const String& resolved_path);
+  void OpenFile(ScriptPromiseResolver<IDLString>* resolver,
+                const String& path,
+                const String& resolved_path);
 
-  void SetDirectory(
-      mojo::PendingRemote<mojom::cfs::blink::CodegateDirectory> new_dir_remote,
-      ExecutionContext* execution_context);
-  void SetBuffer(
-      mojo::PendingRemote<mojom::cfs::blink::CodegateFile> new_file_remote,
-      ScriptPromiseResolver<IDLString>* resolver);
+  void SetDirectory(ItemHandle* new_dir, ExecutionContext* execution_context);
+  void SetBuffer(ItemHandle* file, ScriptPromiseResolver<IDLString>* resolver);
   void ResetBuffer();
+  // Fetches the listing page of |directory| at |cursor| and keeps going
+  // until the last one, appending each page to |output| as it arrives. Every
+  // page comes from |directory|, even if a cd completes in between.
+  void ListItemsFrom(ScriptPromiseResolver<IDLString>* resolver,
+                     ItemHandle* directory,
+                     uint64_t cursor,
+                     std::unique_ptr<StringBuilder> output);
+  void ListItemsDetailedFrom(ScriptPromiseResolver<IDLString>* resolver,
+                             ItemHandle* directory,
+                             uint64_t cursor,
+                             std::unique_ptr<StringBuilder> output);
+  // Registers |observer_receiver_| on the current directory. Until its first
+  // OnListing arrives, ls falls back to ListItems.
+  void WatchDirectory(ExecutionContext* execution_context);
+  void OnObserverDisconnect();
+  // The browser drops handles it considers forgotten even though their item
+  // lives on. When that hits the current directory or the open file, reopen
+  // it by path; commands sent meanwhile fail with "Dead Pipe".
+  void OnDirectoryDisconnect(ItemHandle* dir,
+                             ExecutionContext* execution_context);
+  void OnFileDisconnect(FileBuffer* buffer,
+                        ExecutionContext* execution_context);
+  // Opens a new handle to the item |handle| was opened at, through any
+  // directory handle still connected, and passes it to |callback|. Does
+  // nothing if the path is unknown or the item is gone or changed kind.
+  void ReopenHandle(ItemHandle* handle,
+                    ExecutionContext* execution_context,
+                    base::OnceCallback<void(ItemHandle*)> callback);
+
+  // Absolute form of |path| as the browser would resolve it from the current
+  // directory, or a null string when that cannot be known without asking,
+  // e.g. when ".." would step out of a component |path| itself named.
+  String ResolveCachePath(const String& path) const;
+  // Removes and returns the cached handle for |path| if it is still connected
+  // and of the wanted kind. Another shell may have renamed or moved its item
+  // since, so callers check the item's current path before using it.
+  ItemHandle* TakeCachedHandle(const String& path, bool want_directory);
+  // Keeps |handle| for reuse, evicting the least recently used entry once the
+  // cache is full.
+  void CacheHandle(ItemHandle* handle);
+  // Drops cached handles at or below |path| after it was deleted, renamed or
+  // moved. |path| comes from ResolveCachePath; a null one drops everything.
+  void InvalidateCachedHandles(const String& path);
+  // Asks the browser for the current directory's path, for when it cannot be
+  // derived locally.
+  void RefreshCwdPath();
 
   mojom::cfs::blink::CodegateDirectory* GetDirectoryRemote();
   mojom::cfs::blink::CodegateFile* GetFileRemote();
   FileBuffer* GetBuffer();
 
-  HeapMojoRemote<mojom::cfs::blink::CodegateDirectory> dir_remote_;
+  Member<ItemHandle> current_dir_;
   Member<FileBuffer> file_descriptor_;
   uint32_t shell_id_;
+
+  // Listing of the current directory, kept up to date by the browser's deltas
+  // so that ls needs no IPC.
+  HeapMojoAssociatedReceiver<mojom::cfs::blink::CodegateDirectoryObserver,
+                             MiniShell>
+      observer_receiver_;
+  Vector<String> listing_cache_;
+  bool listing_cache_valid_;
+
+  // Handles of directories and files used recently, oldest first, keyed by
+  // their absolute path. Changes made through other shells are not seen
+  // here: a handle whose item was deleted reports disconnected and is never
+  // returned, and one whose item was renamed or moved is caught by asking
+  // the browser for its path before it is reused.
+  HeapVector<Member<ItemHandle>> handle_cache_;
 };
 
+// A bound directory or file remote together with the absolute path it was
+// opened at. The path is null while it is unknown.
+class ItemHandle final : public GarbageCollected<ItemHandle> {
+ public:
+  ItemHandle(ExecutionContext* execution_context,
+             const String& path,
+             mojo::PendingRemote<mojom::cfs::blink::CodegateDirectory> remote);
+  ItemHandle(ExecutionContext* execution_context,
+             const String& path,
+             mojo::PendingRemote<mojom::cfs::blink::CodegateFile> remote);
+
+  const String& path() const { return path_; }
+  void set_path(const String& path) { path_ = path; }
+
+  bool is_directory() const { return dir_remote_.is_bound(); }
+  bool is_bound() const;
+  bool is_connected() const;
+  void set_disconnect_handler(base::OnceClosure handler);
+  // Closes the pipe right away instead of when the handle is collected.
+  void Reset();
+
+  mojom::cfs::blink::CodegateDirectory* directory() {
+    return dir_remote_.get();
+  }
+  mojom::cfs::blink::CodegateFile* file() { return file_remote_.get(); }
+
+  void Trace(Visitor* visitor) const;
+
+ private:
+  String path_;
+  HeapMojoRemote<mojom::cfs::blink::CodegateDirectory> dir_remote_;
+  HeapMojoRemote<mojom::cfs::blink::CodegateFile> file_remote_;
+};
+
+// Renderer-side copy of an open file, kept in FILE_PAGE_SIZE pages that are
+// allocated the first time they are written. Pages that were never written
+// read back as zeroes. Writes are remembered as dirty byte ranges so that a
+// save only sends what changed.
 class FileBuffer : public GarbageCollected<FileBuffer> {
 
  public:
-  explicit FileBuffer(
-      mojo::PendingRemote<mojom::cfs::blink::CodegateFile> new_file_remote,
-      ScriptPromiseResolver<IDLString>* resolver);
+  explicit FileBuffer(ItemHandle* handle,
+                      ScriptPromiseResolver<IDLString>* resolver);
+
+  // The file is streamed in after construction. Until it is loaded the buffer
+  // must not be read, written, seeked or flushed; a buffer whose load failed
+  // never becomes usable.
+  bool is_loaded() const { return loaded_; }
+  bool load_failed() const { return load_failed_; }
 
   Vector<uint8_t> read(uint64_t count);
-  void write(const Vector<uint8_t>& data);
+  bool write(const Vector<uint8_t>& data);
 
   void SetIdx(uint64_t idx);
 
+  // Copies the whole file into one buffer for saving.
+  mojo_base::BigBuffer Serialize() const;
+  void ReleasePages();
+
+  // Sends the dirty ranges to the browser and runs |callback| once every
+  // write issued so far has been acknowledged.
+  void Flush(base::OnceCallback<void(bool)> callback);
+  // Flushes automatically |delay| after the last write; zero turns it off.
+  void SetWriteBehind(base::TimeDelta delay);
+  bool HasDirtyRanges() const { return !dirty_.empty(); }
+
   mojom::cfs::blink::CodegateFile* GetRemote();
+  ItemHandle* handle() const { return handle_.Get(); }
+  // Switches to |handle| after the old one disconnected. Dirty ranges are
+  // kept and go out with the next flush.
+  void Reconnect(ItemHandle* handle) { handle_ = handle; }
 
   void Trace(Visitor* visitor) const;
 
  private:
-  HeapMojoRemote<mojom::cfs::blink::CodegateFile> remote_;
+  using Page = std::array<uint8_t, FILE_PAGE_SIZE>;
+
+  // Half-open byte range [start, end) that differs from the browser's copy.
+  struct DirtyRange {
+    uint64_t start;
+    uint64_t end;
+  };
+
+  // Adds [start, end) to |dirty_|, merging it with ranges it overlaps or
+  // touches so that |dirty_| stays sorted and disjoint.
+  void MarkDirty(uint64_t start, uint64_t end);
+  void OnFlushDone(Vector<DirtyRange> ranges, bool success);
+  void OnFlushTimer(TimerBase*);
+
+  void OnReadStream(bool success,
+                    uint64_t size,
+                    mojo::ScopedDataPipeConsumerHandle stream);
+  void OnStreamReadable(MojoResult result);
+  void FinishLoad();
+
+  // Returns the rest of the page holding |offset|, allocating it if needed.
+  base::span<uint8_t> GetPageSpan(uint64_t offset);
+  void CopyOut(uint64_t offset, base::span<uint8_t> out) const;
+
+  Member<ItemHandle> handle_;
   uint64_t idx_;
-  char buffer_[FILESIZE_MAX];
+  uint64_t size_;
+  Vector<std::unique_ptr<Page>> pages_;
+
+  // Initial load, streamed straight into |pages_|.
+  Member<ScriptPromiseResolver<IDLString>> open_resolver_;
+  scoped_refptr<base::SequencedTaskRunner> task_runner_;
+  mojo::ScopedDataPipeConsumerHandle stream_;
+  std::unique_ptr<mojo::SimpleWatcher> stream_watcher_;
+  uint64_t stream_size_;
+  // Bytes received so far; |size_| only takes it over once the load is done.
+  uint64_t load_offset_;
+  bool loaded_;
+  bool load_failed_;
 
+  Vector<DirtyRange> dirty_;
+  uint32_t flushes_in_flight_;
+  Vector<base::OnceCallback<void(bool)>> flush_waiters_;
+  bool flush_failed_;
+  base::TimeDelta write_behind_delay_;
+  HeapTaskRunnerTimer<FileBuffer> flush_timer_;
 };
 }  // namespace blink
 
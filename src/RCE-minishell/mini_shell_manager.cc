@@ -94,10 +94,75 @@ ScriptPromise<MiniShell> MiniShellManager::get(
   return promise;
 }
 
+ScriptPromise<DOMArrayBuffer> MiniShellManager::ExportShell(
+    ScriptState* script_state,
+    uint32_t shell_id,
+    ExceptionState& exception_state) {
+  auto* resolver =
+      MakeGarbageCollected<ScriptPromiseResolver<DOMArrayBuffer>>(script_state);
+  ScriptPromise<DOMArrayBuffer> promise = resolver->Promise();
+
+  GetFSManagerService(script_state)
+      ->ExportFileSystem(
+          shell_id,
+          WTF::BindOnce(
+              [](ScriptPromiseResolver<DOMArrayBuffer>* resolver,
+                 std::optional<mojo_base::BigBuffer> image) {
+                if (!image) {
+                  resolver->Reject(MakeGarbageCollected<DOMException>(
+                      DOMExceptionCode::kOperationError,
+                      "Failed to export file system."));
+                  return;
+                }
+                resolver->Resolve(
+                    DOMArrayBuffer::Create(base::span<const uint8_t>(*image)));
+              },
+              WrapPersistent(resolver)));
+
+  return promise;
+}
+
+ScriptPromise<MiniShell> MiniShellManager::ImportShell(
+    ScriptState* script_state,
+    DOMArrayBuffer* image,
+    ExceptionState& exception_state) {
+  auto* resolver =
+      MakeGarbageCollected<ScriptPromiseResolver<MiniShell>>(script_state);
+  ScriptPromise<MiniShell> promise = resolver->Promise();
+
+  // Large images travel as shared memory, so the browser reads them in place.
+  GetFSManagerService(script_state)
+      ->ImportFileSystem(
+          mojo_base::BigBuffer(image->ByteSpan()),
+          WTF::BindOnce(
+              [](MiniShellManager* minishellmanager,
+                 ScriptPromiseResolver<MiniShell>* resolver, bool success,
+                 uint32_t shell_id,
+                 mojo::PendingRemote<mojom::cfs::blink::CodegateDirectory>
+                     new_dir_remote) {
+                if (!success || !new_dir_remote) {
+                  resolver->Reject(MakeGarbageCollected<DOMException>(
+                      DOMExceptionCode::kOperationError,
+                      "Failed to import file system."));
+                  return;
+                }
+                minishellmanager->OnCreateFileSystem(
+                    resolver, shell_id, std::move(new_dir_remote));
+              },
+              WrapPersistent(this), WrapPersistent(resolver)));
+
+  return promise;
+}
+
 void MiniShellManager::OnCreateFileSystem(
     ScriptPromiseResolver<MiniShell>* resolver,
     uint32_t id,
     mojo::PendingRemote<mojom::cfs::blink::CodegateDirectory> new_remote) {
+  if (!new_remote) {
+    resolver->Reject(MakeGarbageCollected<DOMException>(
+        DOMExceptionCode::kOperationError, "Failed to create file system."));
+    return;
+  }
   auto* new_shell = MakeGarbageCollected<MiniShell>(resolver->GetScriptState(),
                                                     std::move(new_remote), id);
   Add(id, new_shell);
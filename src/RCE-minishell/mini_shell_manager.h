@@ -8,6 +8,7 @@
 #include "third_party/blink/renderer/bindings/core/v8/script_promise.h"
 #include "third_party/blink/renderer/bindings/core/v8/script_promise_resolver.h"
 #include "third_party/blink/renderer/core/execution_context/execution_context.h"
+#include "third_party/blink/renderer/core/typed_arrays/dom_array_buffer.h"
 #include "third_party/blink/renderer/modules/minishell/mini_shell.h"
 #include "third_party/blink/renderer/modules/modules_export.h"
 #include "third_party/blink/renderer/platform/bindings/exception_state.h"
@@ -44,6 +45,18 @@ class MODULES_EXPORT MiniShellManager final : public ScriptWrappable {
                                uint32_t shell_id,
                                ExceptionState& exception_state);
 
+  // [CallWith=ScriptState, RaisesException] Promise<ArrayBuffer>
+  // ExportShell(uint32_t id);
+  ScriptPromise<DOMArrayBuffer> ExportShell(ScriptState* script_state,
+                                            uint32_t shell_id,
+                                            ExceptionState& exception_state);
+
+  // [CallWith=ScriptState, RaisesException] Promise<MiniShell>
+  // ImportShell(ArrayBuffer image);
+  ScriptPromise<MiniShell> ImportShell(ScriptState* script_state,
+                                       DOMArrayBuffer* image,
+                                       ExceptionState& exception_state);
+
   // Callback
   void OnCreateFileSystem(
       ScriptPromiseResolver<MiniShell>* resolver,
@@ -0,0 +1,106 @@
+// content/browser/CFS/cfs_blob_store.cc
+
+// content
+#include "content/browser/CFS/cfs_blob_store.h"
+
+#include <utility>
+
+// base
+#include "base/check.h"
+
+CodegateBlobStore::CodegateBlobStore() = default;
+
+CodegateBlobStore::~CodegateBlobStore() = default;
+
+CodegateBlobStore::BlobId CodegateBlobStore::Acquire(
+    base::span<const uint8_t> data,
+    size_t hash,
+    CodegateFileContent* content) {
+  {
+    base::AutoLock lock(lock_);
+    if (BlobId id = FindLocked(data, hash)) {
+      Blob& blob = blobs_.at(id);
+      ++blob.references;
+      ++references_;
+      logical_bytes_ += data.size();
+      *content = blob.content;
+      return id;
+    }
+  }
+
+  // A new body is chunked outside the lock, so a large write does not hold
+  // up the other filesystems. One of them may add the same body meanwhile,
+  // hence the second lookup.
+  CodegateFileContent new_content;
+  new_content.Assign(data);
+
+  base::AutoLock lock(lock_);
+  BlobId id = FindLocked(data, hash);
+  if (!id) {
+    id = next_blob_id_++;
+    blobs_.emplace(id, Blob{hash, std::move(new_content), 0});
+    blobs_by_hash_.emplace(hash, id);
+    stored_bytes_ += data.size();
+  }
+  Blob& blob = blobs_.at(id);
+  ++blob.references;
+  ++references_;
+  logical_bytes_ += data.size();
+  *content = blob.content;
+  return id;
+}
+
+void CodegateBlobStore::AddReference(BlobId id) {
+  base::AutoLock lock(lock_);
+  Blob& blob = blobs_.at(id);
+  CHECK_GT(blob.references, 0u);
+  ++blob.references;
+  ++references_;
+  logical_bytes_ += blob.content.size();
+}
+
+void CodegateBlobStore::Release(BlobId id) {
+  base::AutoLock lock(lock_);
+  auto it = blobs_.find(id);
+  CHECK(it != blobs_.end());
+  Blob& blob = it->second;
+  --blob.references;
+  --references_;
+  logical_bytes_ -= blob.content.size();
+  if (blob.references > 0) {
+    return;
+  }
+
+  stored_bytes_ -= blob.content.size();
+  auto [begin, end] = blobs_by_hash_.equal_range(blob.hash);
+  for (auto hash_it = begin; hash_it != end; ++hash_it) {
+    if (hash_it->second == id) {
+      blobs_by_hash_.erase(hash_it);
+      break;
+    }
+  }
+  blobs_.erase(it);
+}
+
+blink::mojom::cfs::DedupStatsPtr CodegateBlobStore::GetStats() const {
+  base::AutoLock lock(lock_);
+  auto stats = blink::mojom::cfs::DedupStats::New();
+  stats->logical_bytes = logical_bytes_;
+  stats->stored_bytes = stored_bytes_;
+  stats->blobs = blobs_.size();
+  stats->references = references_;
+  return stats;
+}
+
+CodegateBlobStore::BlobId CodegateBlobStore::FindLocked(
+    base::span<const uint8_t> data,
+    size_t hash) const {
+  auto [begin, end] = blobs_by_hash_.equal_range(hash);
+  for (auto it = begin; it != end; ++it) {
+    const Blob& blob = blobs_.at(it->second);
+    if (blob.content.Equals(data)) {
+      return it->second;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,75 @@
+#ifndef CONTENT_BROWSER_CFS_CFS_BLOB_STORE_H_
+#define CONTENT_BROWSER_CFS_CFS_BLOB_STORE_H_
+
+// library
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+// base
+#include "base/containers/span.h"
+#include "base/memory/ref_counted.h"
+#include "base/synchronization/lock.h"
+#include "base/thread_annotations.h"
+
+// content
+#include "content/browser/CFS/cfs_file_content.h"
+
+// mojo IPC Rule
+#include "third_party/blink/public/mojom/CFS/cfs.mojom.h"
+
+// Content-addressed store of whole file bodies, shared by every in-memory
+// filesystem of one CodegateFSManagerImpl. Bodies are keyed by
+// base::FastHash and compared in full on a hash hit, so identical bodies are
+// kept once however many files hold them. Each holder keeps a reference and
+// a CodegateFileContent sharing the blob's chunks; the blob goes away with
+// its last reference.
+//
+// Filesystems run on sequences of their own, so every method takes a lock.
+class CodegateBlobStore : public base::RefCountedThreadSafe<CodegateBlobStore> {
+ public:
+  // 0 is never a valid id.
+  using BlobId = uint64_t;
+
+  CodegateBlobStore();
+
+  CodegateBlobStore(const CodegateBlobStore&) = delete;
+  CodegateBlobStore& operator=(const CodegateBlobStore&) = delete;
+
+  // Returns the blob holding |data|, whose base::FastHash is |hash|, adding
+  // it if there is none yet, and sets |content| to share its chunks. Takes a
+  // reference for the caller.
+  BlobId Acquire(base::span<const uint8_t> data,
+                 size_t hash,
+                 CodegateFileContent* content);
+  // Takes another reference to a blob the caller already holds one to.
+  void AddReference(BlobId id);
+  void Release(BlobId id);
+
+  blink::mojom::cfs::DedupStatsPtr GetStats() const;
+
+ private:
+  friend class base::RefCountedThreadSafe<CodegateBlobStore>;
+  ~CodegateBlobStore();
+
+  struct Blob {
+    size_t hash;
+    CodegateFileContent content;
+    uint64_t references;
+  };
+
+  // Returns 0 if no blob holds |data|.
+  BlobId FindLocked(base::span<const uint8_t> data, size_t hash) const
+      EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  mutable base::Lock lock_;
+  std::unordered_map<BlobId, Blob> blobs_ GUARDED_BY(lock_);
+  std::unordered_multimap<size_t, BlobId> blobs_by_hash_ GUARDED_BY(lock_);
+  BlobId next_blob_id_ GUARDED_BY(lock_) = 1;
+  // Bytes of every blob counted once per reference, and once overall.
+  uint64_t logical_bytes_ GUARDED_BY(lock_) = 0;
+  uint64_t stored_bytes_ GUARDED_BY(lock_) = 0;
+  uint64_t references_ GUARDED_BY(lock_) = 0;
+};
+
+#endif  // CONTENT_BROWSER_CFS_CFS_BLOB_STORE_H_
@@ -0,0 +1,175 @@
+// content/browser/CFS/cfs_blob_store_unittest.cc
+
+// content
+#include "content/browser/CFS/cfs_blob_store.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "content/browser/CFS/cfs_file_content.h"
+#include "content/browser/CFS/cfs_storage.h"
+
+// base
+#include "base/containers/span.h"
+#include "base/hash/hash.h"
+#include "base/memory/scoped_refptr.h"
+
+// test
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace {
+
+base::span<const uint8_t> Bytes(const std::string& text) {
+  return base::as_byte_span(text);
+}
+
+class CodegateBlobStoreTest : public testing::Test {
+ protected:
+  CodegateBlobStore::BlobId Acquire(const std::string& text,
+                                    CodegateFileContent* content) {
+    return store_->Acquire(Bytes(text), base::FastHash(Bytes(text)), content);
+  }
+
+  void ExpectStats(uint64_t logical_bytes,
+                   uint64_t stored_bytes,
+                   uint64_t blobs,
+                   uint64_t references) {
+    blink::mojom::cfs::DedupStatsPtr stats = store_->GetStats();
+    EXPECT_EQ(stats->logical_bytes, logical_bytes);
+    EXPECT_EQ(stats->stored_bytes, stored_bytes);
+    EXPECT_EQ(stats->blobs, blobs);
+    EXPECT_EQ(stats->references, references);
+  }
+
+  std::unique_ptr<CodegateMemoryFileStorage> CreateStorage(
+      const std::string& text) {
+    auto storage = std::make_unique<CodegateMemoryFileStorage>(store_);
+    EXPECT_TRUE(storage->Assign(Bytes(text)));
+    return storage;
+  }
+
+  scoped_refptr<CodegateBlobStore> store_ =
+      base::MakeRefCounted<CodegateBlobStore>();
+};
+
+TEST_F(CodegateBlobStoreTest, SharesIdenticalBodies) {
+  CodegateFileContent first, second, other;
+  CodegateBlobStore::BlobId id = Acquire("hello", &first);
+  ASSERT_NE(id, 0u);
+  EXPECT_EQ(Acquire("hello", &second), id);
+  CodegateBlobStore::BlobId other_id = Acquire("world", &other);
+  EXPECT_NE(other_id, id);
+  EXPECT_TRUE(second.Equals(Bytes("hello")));
+  ExpectStats(15, 10, 2, 3);
+
+  store_->Release(id);
+  ExpectStats(10, 10, 2, 2);
+  store_->Release(id);
+  ExpectStats(5, 5, 1, 1);
+  store_->Release(other_id);
+  ExpectStats(0, 0, 0, 0);
+}
+
+TEST_F(CodegateBlobStoreTest, ComparesBodiesOnHashHit) {
+  CodegateFileContent first, second;
+  // Same hash passed for different bodies, as in a collision.
+  size_t hash = base::FastHash(Bytes("aaaa"));
+  CodegateBlobStore::BlobId id = store_->Acquire(Bytes("aaaa"), hash, &first);
+  CodegateBlobStore::BlobId other_id =
+      store_->Acquire(Bytes("bbbb"), hash, &second);
+  EXPECT_NE(id, other_id);
+  EXPECT_TRUE(second.Equals(Bytes("bbbb")));
+  ExpectStats(8, 8, 2, 2);
+
+  store_->Release(id);
+  store_->Release(other_id);
+  ExpectStats(0, 0, 0, 0);
+}
+
+TEST_F(CodegateBlobStoreTest, AddReferenceKeepsBlob) {
+  CodegateFileContent content;
+  CodegateBlobStore::BlobId id = Acquire("hello", &content);
+  store_->AddReference(id);
+  ExpectStats(10, 5, 1, 2);
+
+  store_->Release(id);
+  ExpectStats(5, 5, 1, 1);
+  store_->Release(id);
+  ExpectStats(0, 0, 0, 0);
+}
+
+TEST_F(CodegateBlobStoreTest, StoragesShareAndReleaseBlob) {
+  auto first = CreateStorage("body");
+  auto second = CreateStorage("body");
+  ExpectStats(8, 4, 1, 2);
+
+  first.reset();
+  ExpectStats(4, 4, 1, 1);
+  second.reset();
+  ExpectStats(0, 0, 0, 0);
+}
+
+TEST_F(CodegateBlobStoreTest, ReassigningOwnBodyKeepsBlob) {
+  auto storage = CreateStorage("body");
+  ASSERT_TRUE(storage->Assign(Bytes("body")));
+  ExpectStats(4, 4, 1, 1);
+
+  ASSERT_TRUE(storage->Assign(Bytes("other")));
+  ExpectStats(5, 5, 1, 1);
+}
+
+TEST_F(CodegateBlobStoreTest, CloneHoldsReference) {
+  auto storage = CreateStorage("body");
+  std::unique_ptr<CodegateMemoryFileStorage> clone = storage->Clone();
+  ExpectStats(8, 4, 1, 2);
+  EXPECT_TRUE(clone->HasContent(Bytes("body")));
+
+  storage.reset();
+  ExpectStats(4, 4, 1, 1);
+  clone.reset();
+  ExpectStats(0, 0, 0, 0);
+}
+
+TEST_F(CodegateBlobStoreTest, ReaderHoldsNoReference) {
+  auto storage = CreateStorage("body");
+  std::unique_ptr<CodegateFileStorage> reader = storage->CreateReader();
+  ExpectStats(4, 4, 1, 1);
+
+  storage.reset();
+  ExpectStats(0, 0, 0, 0);
+  EXPECT_EQ(reader->size(), 4u);
+}
+
+TEST_F(CodegateBlobStoreTest, PartialChangeLeavesBlob) {
+  auto written = CreateStorage("body");
+  auto resized = CreateStorage("body");
+  auto kept = CreateStorage("body");
+  ExpectStats(12, 4, 1, 3);
+
+  ASSERT_TRUE(written->Write(0, Bytes("B")));
+  ExpectStats(8, 4, 1, 2);
+  ASSERT_TRUE(resized->Resize(2));
+  ExpectStats(4, 4, 1, 1);
+  // Resizing to the same size changes nothing.
+  ASSERT_TRUE(kept->Resize(4));
+  ExpectStats(4, 4, 1, 1);
+
+  // The blob's chunks are untouched by the writes that left it.
+  EXPECT_TRUE(kept->HasContent(Bytes("body")));
+  EXPECT_FALSE(written->HasContent(Bytes("Body")));
+}
+
+TEST_F(CodegateBlobStoreTest, HasContentOnlyForAssignedBody) {
+  auto storage = CreateStorage("body");
+  EXPECT_TRUE(storage->HasContent(Bytes("body")));
+  EXPECT_FALSE(storage->HasContent(Bytes("bod")));
+  EXPECT_FALSE(storage->HasContent(Bytes("boat")));
+
+  // Without a blob store nothing is known about the body.
+  CodegateMemoryFileStorage plain;
+  ASSERT_TRUE(plain.Assign(Bytes("body")));
+  EXPECT_FALSE(plain.HasContent(Bytes("body")));
+}
+
+}  // namespace
@@ -2,28 +2,128 @@
 
 #include "content/browser/CFS/cfs_directory_impl.h"
 
+#include <algorithm>
+#include <optional>
+#include <map>
+#include <tuple>
+#include <utility>
+
 #include "content/browser/CFS/cfs_file_impl.h"
+#include "content/browser/CFS/cfs_journal.h"
 #include "content/browser/CFS/cfs_manager_impl.h"
+#include "content/browser/CFS/cfs_search.h"
 
 // Base
 #include "base/files/file_util.h"
 #include "base/logging.h"
+#include "base/numerics/byte_conversions.h"
+#include "base/numerics/safe_conversions.h"
+#include "base/strings/string_split.h"
 #include "base/strings/utf_string_conversions.h"
 #include "base/task/sequenced_task_runner.h"
 #include "base/task/thread_pool.h"
 
+namespace {
+
+// Upper bound on entries per ListItemsPage reply, whatever the caller asks.
+constexpr size_t kListItemsPageMax = 1024;
+// Upper bound on paths per Find reply.
+constexpr size_t kFindResultsMax = 4096;
+// Upper bounds on Grep's pattern and on matches per reply.
+constexpr size_t kGrepPatternMax = 4096;
+constexpr size_t kGrepMatchesMax = 4096;
+// Upper bound on observers per directory. Each one gets every delta and a
+// full listing when it is added.
+constexpr size_t kObserversPerDirectoryMax = 16;
+
+CodegateJournalRecord::Op ToJournalOp(blink::mojom::cfs::BatchOpType type) {
+  switch (type) {
+    case blink::mojom::cfs::BatchOpType::kCreateFile:
+      return CodegateJournalRecord::Op::kCreateFile;
+    case blink::mojom::cfs::BatchOpType::kCreateDir:
+      return CodegateJournalRecord::Op::kCreateDir;
+    case blink::mojom::cfs::BatchOpType::kDelete:
+      return CodegateJournalRecord::Op::kDelete;
+    case blink::mojom::cfs::BatchOpType::kRename:
+      return CodegateJournalRecord::Op::kRename;
+    case blink::mojom::cfs::BatchOpType::kMove:
+      return CodegateJournalRecord::Op::kMove;
+  }
+}
+
+// Body id of |item| if it is a file kept on disk, otherwise 0.
+uint64_t GetBodyId(const CodegateItem* item) {
+  if (!item || item->GetItemType() != TYPE_FILE) {
+    return 0;
+  }
+  return static_cast<const CodegateFileImpl*>(item)->storage().body_id();
+}
+
+// A logged copy lists the bodies of the copied files, in the order CloneItem
+// creates them.
+std::vector<uint8_t> EncodeBodyIds(const std::vector<uint64_t>& body_ids) {
+  std::vector<uint8_t> data;
+  data.reserve(body_ids.size() * sizeof(uint64_t));
+  for (uint64_t body_id : body_ids) {
+    auto bytes = base::U64ToLittleEndian(body_id);
+    data.insert(data.end(), bytes.begin(), bytes.end());
+  }
+  return data;
+}
+
+std::optional<std::vector<uint64_t>> DecodeBodyIds(
+    base::span<const uint8_t> data) {
+  if (data.size() % sizeof(uint64_t)) {
+    return std::nullopt;
+  }
+  std::vector<uint64_t> body_ids;
+  body_ids.reserve(data.size() / sizeof(uint64_t));
+  for (size_t pos = 0; pos < data.size(); pos += sizeof(uint64_t)) {
+    body_ids.push_back(
+        base::U64FromLittleEndian(data.subspan(pos).first<sizeof(uint64_t)>()));
+  }
+  return body_ids;
+}
+
+}  // namespace
+
 CodegateDirectoryImpl::CodegateDirectoryImpl(const std::string& path)
     : CodegateItem(path, TYPE_DIRECTORY) {}
 
-CodegateDirectoryImpl::~CodegateDirectoryImpl() = default;
+CodegateDirectoryImpl::~CodegateDirectoryImpl() {
+  if (GetFileSystem()) {
+    GetFileSystem()->name_index().Remove(this);
+  }
+
+  // Tears the subtree down one item at a time rather than through nested
+  // destructors, so that a deep tree cannot exhaust the stack.
+  std::vector<std::unique_ptr<CodegateItem>> pending;
+  auto take_children = [&pending](CodegateDirectoryImpl* directory) {
+    directory->item_index_.clear();
+    for (auto& [seq, item] : directory->item_list_) {
+      item->SetParentDir(nullptr);
+      pending.push_back(std::move(item));
+    }
+    directory->item_list_.clear();
+  };
+
+  take_children(this);
+  while (!pending.empty()) {
+    std::unique_ptr<CodegateItem> item = std::move(pending.back());
+    pending.pop_back();
+    if (item->GetItemType() == TYPE_DIRECTORY) {
+      take_children(static_cast<CodegateDirectoryImpl*>(item.get()));
+    }
+  }
+}
 
-void CodegateDirectoryImpl::GetItemHandle(const std::string& itemname,
+void CodegateDirectoryImpl::GetItemHandle(const std::string& path,
                                           GetItemHandleCallback callback) {
   blink::mojom::cfs::ITEMTYPE item_type;
 
-  CodegateItem* item = FindItemByName(itemname);
+  CodegateItem* item = ResolvePath(path);
   if (!item) {
-    LOG(ERROR) << "Failed to find item: " << itemname;
+    LOG(ERROR) << "Failed to find item: " << path;
     item_type = blink::mojom::cfs::ITEMTYPE::kFailed;
     std::move(callback).Run(item_type, nullptr);
     return;
@@ -35,6 +135,10 @@ void CodegateDirectoryImpl::GetItemHandle(const std::string& itemname,
       item_type = blink::mojom::cfs::ITEMTYPE::kFile;
       auto* file = static_cast<CodegateFileImpl*>(item);
       auto remote_file = file->GenerateConnection();
+      if (!remote_file) {
+        std::move(callback).Run(blink::mojom::cfs::ITEMTYPE::kFailed, nullptr);
+        return;
+      }
       blink::mojom::cfs::CodegateItemResponsePtr response =
           blink::mojom::cfs::CodegateItemResponse::NewRemoteFile(
               std::move(remote_file));
@@ -44,6 +148,10 @@ void CodegateDirectoryImpl::GetItemHandle(const std::string& itemname,
       item_type = blink::mojom::cfs::ITEMTYPE::kDir;
       auto* dir = static_cast<CodegateDirectoryImpl*>(item);
       auto remote_dir = dir->GenerateConnection();
+      if (!remote_dir) {
+        std::move(callback).Run(blink::mojom::cfs::ITEMTYPE::kFailed, nullptr);
+        return;
+      }
       blink::mojom::cfs::CodegateItemResponsePtr response =
           blink::mojom::cfs::CodegateItemResponse::NewRemoteDir(
               std::move(remote_dir));
@@ -56,206 +164,1097 @@ void CodegateDirectoryImpl::GetItemHandle(const std::string& itemname,
   }
 }
 
-void CodegateDirectoryImpl::CreateItem(const std::string& itemname,
+void CodegateDirectoryImpl::CreateItem(const std::string& path,
                                        blink::mojom::cfs::ITEMTYPE type,
                                        CreateItemCallback callback) {
+  // The reply waits until the mutation is in the journal for good.
+  callback = CodegateJournal::HoldReply(GetJournal(), std::move(callback));
   blink::mojom::cfs::ITEMTYPE item_type;
   switch (type) {
     case blink::mojom::cfs::ITEMTYPE::kFile: {
-      auto new_file = std::make_unique<CodegateFileImpl>(itemname);
-      auto remote_file = new_file->GenerateConnection();
-      if (AddItemInternal(std::move(new_file))) {
+      auto record =
+          MakeJournalRecord(CodegateJournalRecord::Op::kCreateFile, path, "");
+      auto* new_file = static_cast<CodegateFileImpl*>(
+          CreateItemInternal(path, TYPE_FILE, nullptr));
+      if (new_file) {
+        if (record) {
+          record->items = new_file->storage().body_id();
+        }
+        AppendToJournal(record);
         item_type = blink::mojom::cfs::ITEMTYPE::kFile;
-
-        blink::mojom::cfs::CodegateItemResponsePtr response =
-            blink::mojom::cfs::CodegateItemResponse::NewRemoteFile(
-                std::move(remote_file));
+        // The item exists either way; without a free receiver the caller
+        // just gets no handle to it.
+        auto remote_file = new_file->GenerateConnection();
+        blink::mojom::cfs::CodegateItemResponsePtr response;
+        if (remote_file) {
+          response = blink::mojom::cfs::CodegateItemResponse::NewRemoteFile(
+              std::move(remote_file));
+        }
         std::move(callback).Run(item_type, std::move(response));
+        return;
       }
     } break;
 
     case blink::mojom::cfs::ITEMTYPE::kDir: {
-      auto new_directory = std::make_unique<CodegateDirectoryImpl>(itemname);
-      auto remote_dir = new_directory->GenerateConnection();
-      if (AddItemInternal(std::move(new_directory))) {
+      auto record =
+          MakeJournalRecord(CodegateJournalRecord::Op::kCreateDir, path, "");
+      auto* new_directory = static_cast<CodegateDirectoryImpl*>(
+          CreateItemInternal(path, TYPE_DIRECTORY, nullptr));
+      if (new_directory) {
+        AppendToJournal(record);
         item_type = blink::mojom::cfs::ITEMTYPE::kDir;
-        blink::mojom::cfs::CodegateItemResponsePtr response =
-            blink::mojom::cfs::CodegateItemResponse::NewRemoteDir(
-                std::move(remote_dir));
+        auto remote_dir = new_directory->GenerateConnection();
+        blink::mojom::cfs::CodegateItemResponsePtr response;
+        if (remote_dir) {
+          response = blink::mojom::cfs::CodegateItemResponse::NewRemoteDir(
+              std::move(remote_dir));
+        }
         std::move(callback).Run(item_type, std::move(response));
+        return;
       }
     } break;
 
     default:
-      item_type = blink::mojom::cfs::ITEMTYPE::kFailed;
-      LOG(ERROR) << "Failed to create item: " << itemname;
-      std::move(callback).Run(item_type,
-                              blink::mojom::cfs::CodegateItemResponsePtr());
-
       break;
   }
+
+  item_type = blink::mojom::cfs::ITEMTYPE::kFailed;
+  LOG(ERROR) << "Failed to create item: " << path;
+  std::move(callback).Run(item_type,
+                          blink::mojom::cfs::CodegateItemResponsePtr());
 }
 
-void CodegateDirectoryImpl::DeleteItem(const std::string& itemname,
+void CodegateDirectoryImpl::DeleteItem(const std::string& path,
                                        DeleteItemCallback callback) {
-  std::unique_ptr<CodegateItem> removed_item = RemoveItemByName(itemname);
-  bool success = (removed_item != nullptr);
-
+  callback = CodegateJournal::HoldReply(GetJournal(), std::move(callback));
+  auto record = MakeJournalRecord(CodegateJournalRecord::Op::kDelete, path, "");
+  bool success = DeleteItemInternal(path, nullptr);
+  if (success) {
+    AppendToJournal(record);
+  }
   std::move(callback).Run(success);
 }
 
-void CodegateDirectoryImpl::RenameItem(const std::string& filename_orig,
-                                       const std::string& filename_new,
+void CodegateDirectoryImpl::RenameItem(const std::string& path_orig,
+                                       const std::string& itemname_new,
                                        RenameItemCallback callback) {
-  if (!IsItemNameExists(filename_orig) && IsItemNameExists(filename_new)) {
-    std::move(callback).Run(false);
-    return;
+  callback = CodegateJournal::HoldReply(GetJournal(), std::move(callback));
+  auto record = MakeJournalRecord(CodegateJournalRecord::Op::kRename,
+                                  path_orig, itemname_new);
+  bool success = RenameItemByPath(path_orig, itemname_new, nullptr);
+  if (success) {
+    AppendToJournal(record);
   }
-
-  CodegateItem* target_file = FindItemByName(filename_orig);
-  target_file->SetItemName(filename_new);
-
-  std::move(callback).Run(true);
+  std::move(callback).Run(success);
 }
 
 void CodegateDirectoryImpl::ChangeItemLocation(
-    const std::string& filename_src,
-    const std::string& dst_dir,
+    const std::string& path_src,
+    const std::string& path_dst,
     ChangeItemLocationCallback callback) {
-  CodegateDirectoryImpl* destination_directory =
-      ValidateChangeLocation(filename_src, dst_dir);
+  callback = CodegateJournal::HoldReply(GetJournal(), std::move(callback));
+  blink::mojom::cfs::ITEMTYPE item_type = blink::mojom::cfs::ITEMTYPE::kFailed;
+  // Built up front: the move may take this directory along with it.
+  auto record =
+      MakeJournalRecord(CodegateJournalRecord::Op::kMove, path_src, path_dst);
+  CodegateItem* moved_item = MoveItemInternal(path_src, path_dst, nullptr);
+  if (moved_item) {
+    AppendToJournal(record);
+    item_type = moved_item->GetItemType() == TYPE_DIRECTORY
+                    ? blink::mojom::cfs::ITEMTYPE::kDir
+                    : blink::mojom::cfs::ITEMTYPE::kFile;
+  }
 
-  if (!destination_directory) {
-    blink::mojom::cfs::ITEMTYPE item_type =
-        blink::mojom::cfs::ITEMTYPE::kFailed;
-    std::move(callback).Run(item_type,
-                            blink::mojom::cfs::CodegateItemResponsePtr());
+  std::move(callback).Run(item_type,
+                          blink::mojom::cfs::CodegateItemResponsePtr());
+}
+
+void CodegateDirectoryImpl::ListItems(ListItemsCallback callback) {
+  std::vector<std::string> item_list = GetItemNameList();
+  std::move(callback).Run(item_list);
+}
+
+void CodegateDirectoryImpl::ListItemsPage(uint64_t cursor,
+                                          uint32_t max_entries,
+                                          ListItemsPageCallback callback) {
+  size_t limit = std::clamp<size_t>(max_entries, 1, kListItemsPageMax);
+  std::vector<std::string> entries;
+  entries.reserve(std::min(limit, item_list_.size()));
+
+  // The cursor is a sequence number, not an index, so it stays put when
+  // entries before it come and go.
+  auto it = item_list_.lower_bound(cursor);
+  for (; it != item_list_.end() && entries.size() < limit; ++it) {
+    entries.push_back(GetListingEntry(*it->second));
+  }
+
+  bool done = it == item_list_.end();
+  uint64_t next_cursor = done ? next_item_seq_ : it->first;
+  std::move(callback).Run(std::move(entries), next_cursor, done);
+}
+
+void CodegateDirectoryImpl::ListItemsDetailed(
+    uint64_t cursor,
+    uint32_t max_entries,
+    ListItemsDetailedCallback callback) {
+  size_t limit = std::clamp<size_t>(max_entries, 1, kListItemsPageMax);
+  std::vector<blink::mojom::cfs::ItemStatPtr> items;
+  items.reserve(std::min(limit, item_list_.size()));
+
+  auto it = item_list_.lower_bound(cursor);
+  for (; it != item_list_.end() && items.size() < limit; ++it) {
+    items.push_back(GetItemStat(*it->second));
+  }
+
+  bool done = it == item_list_.end();
+  uint64_t next_cursor = done ? next_item_seq_ : it->first;
+  std::move(callback).Run(std::move(items), next_cursor, done);
+}
+
+void CodegateDirectoryImpl::GetPwd(GetPwdCallback callback) {
+  std::move(callback).Run(GetAbsolutePath());
+}
+
+void CodegateDirectoryImpl::ExecuteBatch(
+    std::vector<blink::mojom::cfs::BatchOpPtr> ops,
+    bool atomic,
+    ExecuteBatchCallback callback) {
+  callback = CodegateJournal::HoldReply(GetJournal(), std::move(callback));
+  std::vector<bool> results(ops.size(), false);
+  std::vector<BatchUndo> undo_log;
+  std::vector<CodegateJournalRecord> journal_records;
+  bool committed = true;
+
+  for (size_t idx = 0; idx < ops.size(); ++idx) {
+    auto record = MakeJournalRecord(ToJournalOp(ops[idx]->type),
+                                    ops[idx]->path, ops[idx]->target);
+    results[idx] = ApplyBatchOp(*ops[idx], atomic ? &undo_log : nullptr);
+    if (results[idx] && record) {
+      // A created file is logged with the body it got.
+      if (record->op == CodegateJournalRecord::Op::kCreateFile) {
+        record->items = GetBodyId(ResolvePath(ops[idx]->path));
+      }
+      journal_records.push_back(std::move(*record));
+    }
+    if (!results[idx] && atomic) {
+      RollbackBatch(&undo_log);
+      committed = false;
+      break;
+    }
+  }
+
+  // A rolled back batch leaves nothing to log.
+  if (committed) {
+    for (const auto& record : journal_records) {
+      GetFileSystem()->journal()->Append(record);
+    }
+  }
+  std::move(callback).Run(committed, results);
+}
+
+void CodegateDirectoryImpl::AddObserver(
+    mojo::PendingAssociatedRemote<blink::mojom::cfs::CodegateDirectoryObserver>
+        observer) {
+  // A refused observer is dropped, which the renderer sees as a disconnect.
+  if (observers_.size() >= kObserversPerDirectoryMax) {
     return;
   }
+  mojo::RemoteSetElementId id = observers_.Add(std::move(observer));
+  observers_.Get(id)->OnListing(GetItemNameList());
+}
 
-  std::unique_ptr<CodegateItem> file_to_move = RemoveItemByName(filename_src);
+void CodegateDirectoryImpl::RemoveItem(const std::string& path,
+                                       bool recursive,
+                                       RemoveItemCallback callback) {
+  callback = CodegateJournal::HoldReply(GetJournal(), std::move(callback));
+  CodegateItem* item = ResolvePath(path);
+  uint64_t bytes = 0, items = 0;
+  if (item) {
+    GetItemUsage(*item, &bytes, &items);
+  }
+  // More than one item means a directory with entries.
+  if (!item || (items > 1 && !recursive)) {
+    std::move(callback).Run(false, 0);
+    return;
+  }
 
-  struct backup backup_info;
-  backup_info.itemname = file_to_move->GetItemName();
-  backup_info.filetype = file_to_move->GetItemType();
+  auto record = MakeJournalRecord(CodegateJournalRecord::Op::kDelete, path, "");
+  if (!DeleteItemInternal(path, nullptr)) {
+    std::move(callback).Run(false, 0);
+    return;
+  }
+  AppendToJournal(record);
+  std::move(callback).Run(true, items);
+}
 
-  if (!destination_directory->AddItemInternal(std::move(file_to_move))) {
-    base::SequencedTaskRunner::GetCurrentDefault()->PostTask(
-        FROM_HERE, base::BindOnce(&CodegateDirectoryImpl::RecoverItem,
-                                  weak_factory_.GetWeakPtr(), backup_info,
-                                  destination_directory, std::move(callback)));
+void CodegateDirectoryImpl::CopyItem(const std::string& path_src,
+                                     const std::string& path_dst,
+                                     bool recursive,
+                                     CopyItemCallback callback) {
+  callback = CodegateJournal::HoldReply(GetJournal(), std::move(callback));
+  auto record =
+      MakeJournalRecord(CodegateJournalRecord::Op::kCopy, path_src, path_dst);
+  std::vector<uint64_t> body_ids;
+  bool success = CopyItemInternal(path_src, path_dst, recursive, &body_ids,
+                                  false) != nullptr;
+  if (success) {
+    if (record) {
+      record->data = EncodeBodyIds(body_ids);
+    }
+    AppendToJournal(record);
+  }
+  std::move(callback).Run(success);
+}
+
+void CodegateDirectoryImpl::GetDiskUsage(const std::string& path,
+                                         GetDiskUsageCallback callback) {
+  CodegateItem* item = ResolvePath(path);
+  if (!item) {
+    std::move(callback).Run(false, 0, 0);
     return;
   }
 
-  blink::mojom::cfs::ITEMTYPE item_type = blink::mojom::cfs::ITEMTYPE::kFailed;
-  std::move(callback).Run(item_type,
-                          blink::mojom::cfs::CodegateItemResponsePtr());
+  uint64_t bytes, items;
+  GetItemUsage(*item, &bytes, &items);
+  std::move(callback).Run(true, bytes, items);
 }
 
-void CodegateDirectoryImpl::ListItems(ListItemsCallback callback) {
-  std::vector<std::string> item_list = GetItemNameList();
-  std::move(callback).Run(item_list);
+void CodegateDirectoryImpl::CreateDirectories(
+    const std::string& path,
+    CreateDirectoriesCallback callback) {
+  callback = CodegateJournal::HoldReply(GetJournal(), std::move(callback));
+  std::vector<std::string> components;
+  CodegateDirectoryImpl* directory = SplitPath(path, &components);
+  if (!directory) {
+    std::move(callback).Run(false);
+    return;
+  }
+
+  // Each directory created is logged on its own, so a failure halfway
+  // leaves the parents made so far in place, as mkdir -p does.
+  for (const std::string& component : components) {
+    if (component == ".") {
+      continue;
+    }
+    if (component == "..") {
+      if (directory->GetParentDir()) {
+        directory = directory->GetParentDir();
+      }
+      continue;
+    }
+
+    CodegateItem* item = directory->FindItemByName(component);
+    if (!item) {
+      item = directory->CreateChild(component, TYPE_DIRECTORY);
+      if (!item) {
+        std::move(callback).Run(false);
+        return;
+      }
+      directory = static_cast<CodegateDirectoryImpl*>(item);
+      AppendToJournal(
+          CodegateJournalRecord(CodegateJournalRecord::Op::kCreateDir,
+                                directory->BuildAbsolutePath()));
+      continue;
+    }
+    if (item->GetItemType() != TYPE_DIRECTORY) {
+      std::move(callback).Run(false);
+      return;
+    }
+    directory = static_cast<CodegateDirectoryImpl*>(item);
+  }
+  std::move(callback).Run(true);
 }
 
-void CodegateDirectoryImpl::GetPwd(GetPwdCallback callback) {
-  std::string full_path;
-  CodegateDirectoryImpl* current_directory = this;
+void CodegateDirectoryImpl::Find(const std::string& path,
+                                 const std::string& pattern,
+                                 bool files,
+                                 bool directories,
+                                 uint32_t max_results,
+                                 FindCallback callback) {
+  CodegateItem* item = ResolvePath(path);
+  CodegateFileSystem* file_system = GetFileSystem();
+  if (!item || item->GetItemType() != TYPE_DIRECTORY || !file_system) {
+    std::move(callback).Run(false, {}, false);
+    return;
+  }
 
-  while (current_directory != nullptr) {
-    full_path = "/" + current_directory->GetItemName() + full_path;
-    current_directory = current_directory->GetParentDir();
+  auto* directory = static_cast<CodegateDirectoryImpl*>(item);
+  size_t limit = std::clamp<size_t>(max_results, 1, kFindResultsMax);
+  std::vector<std::string> paths;
+  bool truncated = false;
+  file_system->name_index().Match(pattern, [&](CodegateItem* match) {
+    if (!(match->GetItemType() == TYPE_FILE ? files : directories)) {
+      return true;
+    }
+    CodegateDirectoryImpl* parent = match->GetParentDir();
+    if (!parent || !parent->IsWithin(directory)) {
+      return true;
+    }
+    if (paths.size() == limit) {
+      truncated = true;
+      return false;
+    }
+    paths.push_back(parent->BuildAbsolutePath() + "/" + match->GetItemName());
+    return true;
+  });
+  std::move(callback).Run(true, std::move(paths), truncated);
+}
+
+void CodegateDirectoryImpl::Grep(const std::string& path,
+                                 const std::vector<uint8_t>& pattern,
+                                 uint32_t max_matches,
+                                 GrepCallback callback) {
+  CodegateItem* item = ResolvePath(path);
+  if (!item || pattern.empty() || pattern.size() > kGrepPatternMax) {
+    std::move(callback).Run(false, {}, false);
+    return;
   }
 
-  std::move(callback).Run(full_path);
+  size_t limit = std::clamp<size_t>(max_matches, 1, kGrepMatchesMax);
+  std::vector<blink::mojom::cfs::GrepMatchPtr> matches;
+  bool truncated = false;
+  std::vector<CodegateItem*> stack = {item};
+  while (!stack.empty() && !truncated) {
+    CodegateItem* current = stack.back();
+    stack.pop_back();
+    if (current->GetItemType() == TYPE_DIRECTORY) {
+      const ItemMap& children =
+          static_cast<CodegateDirectoryImpl*>(current)->item_list_;
+      for (auto it = children.rbegin(); it != children.rend(); ++it) {
+        stack.push_back(it->second.get());
+      }
+      continue;
+    }
+
+    std::string file_path;
+    SearchFileStorage(
+        static_cast<CodegateFileImpl*>(current)->storage(), pattern,
+        [&](uint64_t offset) {
+          if (matches.size() == limit) {
+            truncated = true;
+            return false;
+          }
+          if (file_path.empty()) {
+            file_path = current->GetParentDir()->BuildAbsolutePath() + "/" +
+                        current->GetItemName();
+          }
+          matches.push_back(
+              blink::mojom::cfs::GrepMatch::New(file_path, offset));
+          return true;
+        });
+  }
+  std::move(callback).Run(true, std::move(matches), truncated);
 }
 
-void CodegateDirectoryImpl::AddReceiver(
+bool CodegateDirectoryImpl::AddReceiver(
     mojo::PendingReceiver<blink::mojom::cfs::CodegateDirectory> receiver) {
-  receivers_.Add(this, std::move(receiver));
-  receivers_.set_disconnect_handler(base::BindRepeating(
-      &CodegateDirectoryImpl::OnReceiverDisconnect, base::Unretained(this)));
+  return receivers_.Add(GetFileSystem(), std::move(receiver));
 }
 
 mojo::PendingRemote<blink::mojom::cfs::CodegateDirectory>
 CodegateDirectoryImpl::GenerateConnection() {
   mojo::PendingRemote<blink::mojom::cfs::CodegateDirectory> remote;
-  AddReceiver(remote.InitWithNewPipeAndPassReceiver());
+  if (!AddReceiver(remote.InitWithNewPipeAndPassReceiver())) {
+    return mojo::PendingRemote<blink::mojom::cfs::CodegateDirectory>();
+  }
   return remote;
 }
 
 void CodegateDirectoryImpl::OnReceiverDisconnect() {
-  if (receivers_.current_receiver()) {
-    receivers_.Remove(receivers_.current_receiver());
+  receivers_.RemoveCurrent();
+}
+const std::string& CodegateDirectoryImpl::GetAbsolutePath() {
+  CodegateFileSystem* file_system = GetFileSystem();
+  if (file_system && cached_path_epoch_ == file_system->path_epoch()) {
+    return cached_path_;
+  }
+
+  cached_path_ = BuildAbsolutePath();
+  cached_path_epoch_ = file_system ? file_system->path_epoch() : 0;
+  return cached_path_;
+}
+
+std::string CodegateDirectoryImpl::BuildAbsolutePath() const {
+  // Walked iteratively, so that the depth of the tree costs neither stack
+  // nor more than the one string.
+  std::vector<const CodegateDirectoryImpl*> chain;
+  size_t length = 0;
+  for (const CodegateDirectoryImpl* dir = this; dir;
+       dir = dir->GetParentDir()) {
+    chain.push_back(dir);
+    length += 1 + dir->GetItemName().size();
   }
+
+  std::string path;
+  path.reserve(length);
+  for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+    path.append("/").append((*it)->GetItemName());
+  }
+  return path;
+}
+
+bool CodegateDirectoryImpl::ApplyJournalRecord(
+    const CodegateJournalRecord& record) {
+  switch (record.op) {
+    case CodegateJournalRecord::Op::kCreateFile:
+    case CodegateJournalRecord::Op::kAdoptFile: {
+      // A created body is emptied again, since every write to it is redone
+      // after; a checkpointed one holds what the records after it build on.
+      std::string itemname;
+      CodegateDirectoryImpl* parent = ResolveParent(record.path, &itemname);
+      std::unique_ptr<CodegateFileStorage> storage =
+          parent ? GetFileSystem()->OpenFileStorage(
+                       record.items,
+                       record.op == CodegateJournalRecord::Op::kCreateFile)
+                 : nullptr;
+      return storage &&
+             parent->CreateChild(itemname, TYPE_FILE, std::move(storage));
+    }
+    case CodegateJournalRecord::Op::kCreateDir:
+      return CreateItemInternal(record.path, TYPE_DIRECTORY, nullptr) !=
+             nullptr;
+    case CodegateJournalRecord::Op::kDelete:
+      return DeleteItemInternal(record.path, nullptr);
+    case CodegateJournalRecord::Op::kRename:
+      return RenameItemByPath(record.path, record.target, nullptr);
+    case CodegateJournalRecord::Op::kMove:
+      return MoveItemInternal(record.path, record.target, nullptr) != nullptr;
+    case CodegateJournalRecord::Op::kCopy: {
+      std::optional<std::vector<uint64_t>> body_ids =
+          DecodeBodyIds(record.data);
+      return body_ids && CopyItemInternal(record.path, record.target, true,
+                                          &*body_ids, true) != nullptr;
+    }
+    case CodegateJournalRecord::Op::kAssign:
+    case CodegateJournalRecord::Op::kWriteAt:
+    case CodegateJournalRecord::Op::kTruncate: {
+      CodegateItem* item = ResolvePath(record.path);
+      if (!item || item->GetItemType() != TYPE_FILE) {
+        return false;
+      }
+      return static_cast<CodegateFileImpl*>(item)->ApplyJournalRecord(record);
+    }
+    case CodegateJournalRecord::Op::kSetQuota:
+      return false;
+  }
+}
+
+bool CodegateDirectoryImpl::WriteCheckpoint(
+    CodegateJournal::Checkpoint* checkpoint) {
+  // Walks the subtree with a stack of its own rather than by recursion, so
+  // that a deep tree cannot exhaust the stack. Entries are pushed in reverse
+  // so that they come off in listing order, each directory's entries right
+  // after the directory itself.
+  std::vector<std::pair<const CodegateItem*, std::string>> pending;
+  auto push_children = [&pending](const CodegateDirectoryImpl* directory,
+                                  const std::string& path) {
+    for (auto it = directory->item_list_.rbegin();
+         it != directory->item_list_.rend(); ++it) {
+      pending.emplace_back(it->second.get(),
+                           path + "/" + it->second->GetItemName());
+    }
+  };
+
+  push_children(this, BuildAbsolutePath());
+  while (!pending.empty()) {
+    auto [item, path] = std::move(pending.back());
+    pending.pop_back();
+    if (item->GetItemType() == TYPE_DIRECTORY) {
+      checkpoint->Add(CodegateJournalRecord(
+          CodegateJournalRecord::Op::kCreateDir, path));
+      push_children(static_cast<const CodegateDirectoryImpl*>(item), path);
+      continue;
+    }
+
+    // The body itself is the durable copy; the log only names it.
+    const CodegateFileStorage& storage =
+        static_cast<const CodegateFileImpl*>(item)->storage();
+    if (!storage.Flush()) {
+      return false;
+    }
+    CodegateJournalRecord adopt(CodegateJournalRecord::Op::kAdoptFile,
+                                std::move(path));
+    adopt.items = storage.body_id();
+    checkpoint->Add(adopt);
+  }
+  return true;
 }
+
+CodegateItem* CodegateDirectoryImpl::CreateChild(
+    const std::string& itemname,
+    int itemtype,
+    std::unique_ptr<CodegateFileStorage> storage) {
+  if (!IsValidItemName(itemname)) {
+    return nullptr;
+  }
+
+  CodegateFileSystem* file_system = GetFileSystem();
+  if (file_system && !file_system->CanAddItems(1)) {
+    return nullptr;
+  }
+
+  std::unique_ptr<CodegateItem> new_item;
+  if (itemtype == TYPE_DIRECTORY) {
+    new_item = std::make_unique<CodegateDirectoryImpl>(itemname);
+  } else {
+    if (!storage) {
+      storage = file_system ? file_system->CreateFileStorage()
+                            : std::make_unique<CodegateMemoryFileStorage>();
+    }
+    if (!storage) {
+      return nullptr;
+    }
+    new_item = std::make_unique<CodegateFileImpl>(itemname, std::move(storage));
+  }
+
+  CodegateItem* created_item = new_item.get();
+  if (!AddItemInternal(std::move(new_item))) {
+    return nullptr;
+  }
+  return created_item;
+}
+
+std::vector<CodegateItem*> CodegateDirectoryImpl::GetChildren() const {
+  std::vector<CodegateItem*> children;
+  children.reserve(item_list_.size());
+  for (const auto& [seq, item] : item_list_) {
+    children.push_back(item.get());
+  }
+  return children;
+}
+
+void CodegateDirectoryImpl::AdjustUsage(int64_t bytes, int64_t items) {
+  // Unsigned wraparound turns adding a negative delta into a subtraction.
+  CodegateDirectoryImpl* top = this;
+  for (CodegateDirectoryImpl* dir = this; dir; dir = dir->GetParentDir()) {
+    dir->subtree_bytes_ += static_cast<uint64_t>(bytes);
+    dir->subtree_items_ += static_cast<uint64_t>(items);
+    top = dir;
+  }
+  // A subtree detached for a move is counted again once it is reattached.
+  CodegateFileSystem* file_system = GetFileSystem();
+  if (file_system && top == file_system->root()) {
+    file_system->OnUsageChanged(bytes, items);
+  }
+}
+
 // Private
+std::optional<CodegateJournalRecord> CodegateDirectoryImpl::MakeJournalRecord(
+    CodegateJournalRecord::Op op,
+    const std::string& path,
+    const std::string& target) {
+  if (!GetFileSystem() || !GetFileSystem()->journal()) {
+    return std::nullopt;
+  }
+
+  CodegateJournalRecord record(op, GetJournalPath(path));
+  record.target = op == CodegateJournalRecord::Op::kMove ||
+                          op == CodegateJournalRecord::Op::kCopy
+                      ? GetJournalPath(target)
+                      : target;
+  return record;
+}
+
+void CodegateDirectoryImpl::AppendToJournal(
+    const std::optional<CodegateJournalRecord>& record) {
+  if (record && GetFileSystem() && GetFileSystem()->journal()) {
+    GetFileSystem()->journal()->Append(*record);
+  }
+}
+
+CodegateJournal* CodegateDirectoryImpl::GetJournal() const {
+  return GetFileSystem() ? GetFileSystem()->journal() : nullptr;
+}
+
+std::string CodegateDirectoryImpl::GetJournalPath(const std::string& path) {
+  if (!path.empty() && path[0] == '/') {
+    return path;
+  }
+  return GetAbsolutePath() + "/" + path;
+}
+
 bool CodegateDirectoryImpl::AddItemInternal(
     std::unique_ptr<CodegateItem> new_item) {
   if (IsItemNameExists(new_item->GetItemName())) {
     return false;
   }
 
-  new_item->SetParentDir(this);
-  item_list_.push_back(std::move(new_item));
+  InsertItemAt(next_item_seq_++, std::move(new_item));
   return true;
 }
 
-void CodegateDirectoryImpl::RecoverItem(
-    struct backup backup_info,
-    CodegateDirectoryImpl* destination_directory,
-    ChangeItemLocationCallback callback) {
-  blink::mojom::cfs::ITEMTYPE item_type;
-  blink::mojom::cfs::CodegateItemResponsePtr response;
-  std::unique_ptr<CodegateItem> recovered_file;
-
-  if (backup_info.filetype == TYPE_DIRECTORY) {
-    auto new_dir =
-        std::make_unique<CodegateDirectoryImpl>(backup_info.itemname + "_swp");
-    auto remote_dir = new_dir->GenerateConnection();
-    response = blink::mojom::cfs::CodegateItemResponse::NewRemoteDir(
-        std::move(remote_dir));
-    item_type = blink::mojom::cfs::ITEMTYPE::kDir;
-    recovered_file = std::move(new_dir);
+void CodegateDirectoryImpl::InsertItemAt(uint64_t seq,
+                                         std::unique_ptr<CodegateItem> item) {
+  item->SetParentDir(this);
+  item->SetFileSystem(GetFileSystem());
+  if (GetFileSystem()) {
+    GetFileSystem()->name_index().Add(item.get());
+  }
+  std::string name = item->GetItemName();
+  auto entry = item_list_.emplace(seq, std::move(item)).first;
+  item_index_.emplace(std::move(name), entry);
+  MarkModified();
+
+  uint64_t bytes, items;
+  GetItemUsage(*entry->second, &bytes, &items);
+  AdjustUsage(static_cast<int64_t>(bytes), static_cast<int64_t>(items));
+
+  if (!observers_.empty()) {
+    std::string listing_entry = GetListingEntry(*entry->second);
+    for (auto& observer : observers_) {
+      observer->OnItemAdded(listing_entry);
+    }
+  }
+}
+
+CodegateItem* CodegateDirectoryImpl::CreateItemInternal(const std::string& path,
+                                                        int itemtype,
+                                                        BatchUndo* undo) {
+  std::string itemname;
+  CodegateDirectoryImpl* parent_directory = ResolveParent(path, &itemname);
+  if (!parent_directory) {
+    return nullptr;
+  }
+
+  CodegateItem* created_item =
+      parent_directory->CreateChild(itemname, itemtype);
+  if (!created_item) {
+    return nullptr;
+  }
+
+  if (undo) {
+    undo->directory = parent_directory;
+    undo->itemname = std::move(itemname);
+  }
+  return created_item;
+}
+
+bool CodegateDirectoryImpl::DeleteItemInternal(const std::string& path,
+                                               BatchUndo* undo) {
+  std::string itemname;
+  CodegateDirectoryImpl* parent_directory = ResolveParent(path, &itemname);
+  CodegateItem* target =
+      parent_directory ? parent_directory->FindItemByName(itemname) : nullptr;
+
+  // Deleting the directory this handle points at (or one of its parents)
+  // would destroy |this| while it is still dispatching.
+  if (!target || IsWithin(target)) {
+    return false;
+  }
+
+  uint64_t seq;
+  std::unique_ptr<CodegateItem> removed_item =
+      parent_directory->RemoveItemByName(itemname, &seq);
+
+  if (undo) {
+    undo->directory = parent_directory;
+    undo->itemname = std::move(itemname);
+    undo->seq = seq;
+    undo->removed_item = std::move(removed_item);
+  }
+  return true;
+}
+
+bool CodegateDirectoryImpl::RenameItemByPath(const std::string& path_orig,
+                                             const std::string& itemname_new,
+                                             BatchUndo* undo) {
+  std::string itemname_orig;
+  CodegateDirectoryImpl* parent_directory =
+      ResolveParent(path_orig, &itemname_orig);
+  if (!parent_directory || !IsValidItemName(itemname_new) ||
+      !parent_directory->RenameItemInternal(itemname_orig, itemname_new)) {
+    return false;
+  }
+
+  if (undo) {
+    undo->directory = parent_directory;
+    undo->itemname = std::move(itemname_orig);
+    undo->itemname_new = itemname_new;
+  }
+  return true;
+}
+
+CodegateItem* CodegateDirectoryImpl::MoveItemInternal(
+    const std::string& path_src,
+    const std::string& path_dst,
+    BatchUndo* undo) {
+  CodegateDirectoryImpl* source_directory = nullptr;
+  std::string itemname;
+  CodegateDirectoryImpl* destination_directory = ValidateChangeLocation(
+      path_src, path_dst, &source_directory, &itemname);
+  if (!destination_directory) {
+    return nullptr;
+  }
+
+  uint64_t seq;
+  std::unique_ptr<CodegateItem> item_to_move =
+      source_directory->RemoveItemByName(itemname, &seq);
+  CodegateItem* moved_item = item_to_move.get();
+
+  // ValidateChangeLocation already made sure the name is free.
+  bool added = destination_directory->AddItemInternal(std::move(item_to_move));
+  CHECK(added);
+
+  if (undo) {
+    undo->directory = source_directory;
+    undo->destination = destination_directory;
+    undo->itemname = std::move(itemname);
+    undo->seq = seq;
+  }
+  return moved_item;
+}
+
+CodegateItem* CodegateDirectoryImpl::CopyItemInternal(
+    const std::string& path_src,
+    const std::string& path_dst,
+    bool recursive,
+    std::vector<uint64_t>* body_ids,
+    bool adopt_bodies) {
+  CodegateItem* source = ResolvePath(path_src);
+  if (!source || (source->GetItemType() == TYPE_DIRECTORY && !recursive)) {
+    return nullptr;
+  }
+
+  std::string itemname;
+  CodegateDirectoryImpl* destination_directory = nullptr;
+  CodegateItem* dst = ResolvePath(path_dst);
+  if (dst && dst->GetItemType() == TYPE_DIRECTORY) {
+    destination_directory = static_cast<CodegateDirectoryImpl*>(dst);
+    itemname = source->GetItemName();
   } else {
-    auto new_file =
-        std::make_unique<CodegateFileImpl>(backup_info.itemname + ".swp");
-    auto remote_file = new_file->GenerateConnection();
-    response = blink::mojom::cfs::CodegateItemResponse::NewRemoteFile(
-        std::move(remote_file));
-    item_type = blink::mojom::cfs::ITEMTYPE::kFile;
-    recovered_file = std::move(new_file);
-  }
-
-  if (!destination_directory->AddItemInternal(std::move(recovered_file))) {
-    std::move(callback).Run(item_type,
-                            blink::mojom::cfs::CodegateItemResponsePtr());
-    LOG(ERROR) << "Failed to recover item: " << backup_info.itemname;
-    return;
+    destination_directory = ResolveParent(path_dst, &itemname);
+  }
+  if (!destination_directory ||
+      destination_directory->IsItemNameExists(itemname)) {
+    return nullptr;
   }
 
-  std::move(callback).Run(item_type, std::move(response));
+  uint64_t bytes, items;
+  GetItemUsage(*source, &bytes, &items);
+  CodegateFileSystem* file_system = GetFileSystem();
+  if (file_system &&
+      (!file_system->CanAddBytes(bytes) || !file_system->CanAddItems(items))) {
+    return nullptr;
+  }
+
+  // The copy is complete before it is attached, so copying a directory into
+  // its own subtree copies the subtree as it was.
+  std::unique_ptr<CodegateItem> copy =
+      CloneItem(*source, itemname, body_ids, adopt_bodies);
+  if (!copy) {
+    return nullptr;
+  }
+  CodegateItem* copied_item = copy.get();
+  bool added = destination_directory->AddItemInternal(std::move(copy));
+  CHECK(added);
+  return copied_item;
 }
 
-CodegateDirectoryImpl* CodegateDirectoryImpl::ValidateChangeLocation(
+std::unique_ptr<CodegateItem> CodegateDirectoryImpl::CloneItem(
+    const CodegateItem& source,
     const std::string& itemname,
-    const std::string& dst_dir) {
-  if (!IsItemNameExists(itemname) || !IsItemNameExists(dst_dir)) {
+    std::vector<uint64_t>* body_ids,
+    bool adopt_bodies) {
+  struct Node {
+    std::unique_ptr<CodegateItem> copy;
+    // Index of the parent's copy in |nodes| and the seq to insert under.
+    size_t parent;
+    uint64_t seq;
+  };
+
+  CodegateFileSystem* file_system = GetFileSystem();
+  size_t adopted_bodies = 0;
+  std::vector<Node> nodes;
+  std::vector<std::tuple<const CodegateItem*, size_t, uint64_t>> stack = {
+      {&source, 0, 0}};
+  while (!stack.empty()) {
+    auto [item, parent, seq] = stack.back();
+    stack.pop_back();
+    const std::string& name = nodes.empty() ? itemname : item->GetItemName();
+
+    std::unique_ptr<CodegateItem> copy;
+    if (item->GetItemType() == TYPE_DIRECTORY) {
+      const auto* directory = static_cast<const CodegateDirectoryImpl*>(item);
+      auto directory_copy = std::make_unique<CodegateDirectoryImpl>(name);
+      // Same seqs, so the copy lists in the same order.
+      directory_copy->next_item_seq_ = directory->next_item_seq_;
+      for (const auto& [child_seq, child] : directory->item_list_) {
+        stack.emplace_back(child.get(), nodes.size(), child_seq);
+      }
+      copy = std::move(directory_copy);
+    } else {
+      const CodegateFileStorage& storage =
+          static_cast<const CodegateFileImpl*>(item)->storage();
+      std::unique_ptr<CodegateFileStorage> storage_copy;
+      if (!file_system) {
+        storage_copy = storage.CreateReader();
+      } else if (adopt_bodies) {
+        // The bodies were synced when the copy was made.
+        if (adopted_bodies < body_ids->size()) {
+          storage_copy = file_system->OpenFileStorage(
+              (*body_ids)[adopted_bodies++], false);
+        }
+      } else {
+        storage_copy = file_system->CloneFileStorage(storage);
+        if (storage_copy && body_ids) {
+          body_ids->push_back(storage_copy->body_id());
+        }
+      }
+      if (!storage_copy) {
+        return nullptr;
+      }
+      copy = std::make_unique<CodegateFileImpl>(name, std::move(storage_copy));
+    }
+    copy->SetFileSystem(file_system);
+    nodes.push_back({std::move(copy), parent, seq});
+  }
+
+  // Every node comes after its parent, so going backwards attaches each
+  // directory's children before the directory itself is attached, and each
+  // insertion updates the usage counters of a single directory.
+  for (size_t idx = nodes.size() - 1; idx > 0; --idx) {
+    Node& node = nodes[idx];
+    auto* parent =
+        static_cast<CodegateDirectoryImpl*>(nodes[node.parent].copy.get());
+    parent->InsertItemAt(node.seq, std::move(node.copy));
+  }
+  return std::move(nodes[0].copy);
+}
+
+bool CodegateDirectoryImpl::ApplyBatchOp(const blink::mojom::cfs::BatchOp& op,
+                                         std::vector<BatchUndo>* undo_log) {
+  BatchUndo undo;
+  undo.type = op.type;
+  bool success = false;
+
+  switch (op.type) {
+    case blink::mojom::cfs::BatchOpType::kCreateFile:
+      success = CreateItemInternal(op.path, TYPE_FILE, &undo) != nullptr;
+      break;
+    case blink::mojom::cfs::BatchOpType::kCreateDir:
+      success = CreateItemInternal(op.path, TYPE_DIRECTORY, &undo) != nullptr;
+      break;
+    case blink::mojom::cfs::BatchOpType::kDelete:
+      success = DeleteItemInternal(op.path, &undo);
+      break;
+    case blink::mojom::cfs::BatchOpType::kRename:
+      success = RenameItemByPath(op.path, op.target, &undo);
+      break;
+    case blink::mojom::cfs::BatchOpType::kMove:
+      success = MoveItemInternal(op.path, op.target, &undo) != nullptr;
+      break;
+  }
+
+  if (success && undo_log) {
+    undo_log->push_back(std::move(undo));
+  }
+  return success;
+}
+
+void CodegateDirectoryImpl::RollbackBatch(std::vector<BatchUndo>* undo_log) {
+  // Items put back at their old position were announced by OnItemAdded,
+  // which observers append at the end, so those directories are listed
+  // again in full once the rollback is done. Undoing an earlier create can
+  // destroy such a directory along with its parent, so they are held weakly.
+  std::map<CodegateDirectoryImpl*, base::WeakPtr<CodegateDirectoryImpl>>
+      reordered;
+  for (auto it = undo_log->rbegin(); it != undo_log->rend(); ++it) {
+    switch (it->type) {
+      case blink::mojom::cfs::BatchOpType::kCreateFile:
+      case blink::mojom::cfs::BatchOpType::kCreateDir:
+        it->directory->RemoveItemByName(it->itemname);
+        break;
+      case blink::mojom::cfs::BatchOpType::kDelete:
+        it->directory->InsertItemAt(it->seq, std::move(it->removed_item));
+        reordered.emplace(it->directory,
+                          it->directory->weak_factory_.GetWeakPtr());
+        break;
+      case blink::mojom::cfs::BatchOpType::kRename:
+        it->directory->RenameItemInternal(it->itemname_new, it->itemname);
+        break;
+      case blink::mojom::cfs::BatchOpType::kMove:
+        it->directory->InsertItemAt(
+            it->seq, it->destination->RemoveItemByName(it->itemname));
+        reordered.emplace(it->directory,
+                          it->directory->weak_factory_.GetWeakPtr());
+        break;
+    }
+  }
+  undo_log->clear();
+
+  for (const auto& [unused, directory] : reordered) {
+    if (directory && !directory->observers_.empty()) {
+      std::vector<std::string> listing = directory->GetItemNameList();
+      for (auto& observer : directory->observers_) {
+        observer->OnListing(listing);
+      }
+    }
+  }
+}
+
+CodegateDirectoryImpl* CodegateDirectoryImpl::ValidateChangeLocation(
+    const std::string& path_src,
+    const std::string& path_dst,
+    CodegateDirectoryImpl** source_directory,
+    std::string* itemname) {
+  CodegateDirectoryImpl* src_parent = ResolveParent(path_src, itemname);
+  CodegateItem* item =
+      src_parent ? src_parent->FindItemByName(*itemname) : nullptr;
+  CodegateItem* dst = ResolvePath(path_dst);
+  if (!item || !dst || dst->GetItemType() != TYPE_DIRECTORY) {
+    return nullptr;
+  }
+
+  // A directory cannot be moved into itself or into its own subtree.
+  auto* dst_dir = static_cast<CodegateDirectoryImpl*>(dst);
+  if (dst_dir->IsWithin(item)) {
+    return nullptr;
+  }
+  if (dst_dir != src_parent && dst_dir->IsItemNameExists(*itemname)) {
+    return nullptr;
+  }
+
+  *source_directory = src_parent;
+  return dst_dir;
+}
+
+CodegateDirectoryImpl* CodegateDirectoryImpl::SplitPath(
+    const std::string& path,
+    std::vector<std::string>* components) {
+  *components = base::SplitString(path, "/", base::KEEP_WHITESPACE,
+                                  base::SPLIT_WANT_NONEMPTY);
+  if (path.empty() || path[0] != '/') {
+    return this;
+  }
+
+  CodegateDirectoryImpl* root = GetRootDir();
+  if (!components->empty()) {
+    if (components->front() != root->GetItemName()) {
+      return nullptr;
+    }
+    components->erase(components->begin());
+  }
+  return root;
+}
+
+// static
+CodegateItem* CodegateDirectoryImpl::WalkPath(
+    CodegateDirectoryImpl* start,
+    base::span<const std::string> components) {
+  CodegateItem* item = start;
+  for (const std::string& component : components) {
+    if (item->GetItemType() != TYPE_DIRECTORY) {
+      return nullptr;
+    }
+    auto* current_directory = static_cast<CodegateDirectoryImpl*>(item);
+
+    if (component == ".") {
+      continue;
+    }
+    if (component == "..") {
+      // ".." at the root stays at the root.
+      if (current_directory->GetParentDir()) {
+        item = current_directory->GetParentDir();
+      }
+      continue;
+    }
+
+    item = current_directory->FindItemByName(component);
+    if (!item) {
+      return nullptr;
+    }
+  }
+
+  return item;
+}
+
+CodegateItem* CodegateDirectoryImpl::ResolvePath(const std::string& path) {
+  if (path.empty()) {
+    return nullptr;
+  }
+
+  std::vector<std::string> components;
+  CodegateDirectoryImpl* start = SplitPath(path, &components);
+  return start ? WalkPath(start, components) : nullptr;
+}
+
+CodegateDirectoryImpl* CodegateDirectoryImpl::ResolveParent(
+    const std::string& path,
+    std::string* itemname) {
+  std::vector<std::string> components;
+  CodegateDirectoryImpl* start = SplitPath(path, &components);
+  // An absolute path naming just the root has no parent to resolve.
+  if (!start || components.empty() || !IsValidItemName(components.back())) {
     return nullptr;
   }
+  *itemname = components.back();
 
-  if(itemname == ".." || itemname == ".") {
+  CodegateItem* parent =
+      WalkPath(start, base::span(components).first(components.size() - 1));
+  if (!parent || parent->GetItemType() != TYPE_DIRECTORY) {
     return nullptr;
   }
-  CodegateDirectoryImpl* dst = nullptr;
-  if (dst_dir == ".") {
-    dst = this;
-  } else if (dst_dir == "..") {
-    dst = GetParentDir();
-  } else if (IsValidDirectory(dst_dir)) {
-    dst = static_cast<CodegateDirectoryImpl*>(FindItemByName(dst_dir));
+  return static_cast<CodegateDirectoryImpl*>(parent);
+}
+
+CodegateDirectoryImpl* CodegateDirectoryImpl::GetRootDir() {
+  if (GetFileSystem()) {
+    return GetFileSystem()->root();
+  }
+
+  CodegateDirectoryImpl* root = this;
+  while (root->GetParentDir()) {
+    root = root->GetParentDir();
+  }
+  return root;
+}
+
+bool CodegateDirectoryImpl::IsWithin(const CodegateItem* item) const {
+  for (const CodegateDirectoryImpl* dir = this; dir;
+       dir = dir->GetParentDir()) {
+    if (dir == item) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// static
+bool CodegateDirectoryImpl::IsValidItemName(const std::string& itemname) {
+  return !itemname.empty() && itemname != "." && itemname != ".." &&
+         itemname.find('/') == std::string::npos;
+}
+
+bool CodegateDirectoryImpl::RenameItemInternal(
+    const std::string& itemname_orig,
+    const std::string& itemname_new) {
+  auto it = item_index_.find(itemname_orig);
+  if (it == item_index_.end() || IsItemNameExists(itemname_new)) {
+    return false;
+  }
+
+  ItemMap::iterator entry = it->second;
+  item_index_.erase(it);
+  entry->second->SetItemName(itemname_new);
+  if (GetFileSystem()) {
+    GetFileSystem()->name_index().Rename(entry->second.get(), itemname_orig);
+  }
+  MarkModified();
+  if (entry->second->GetItemType() == TYPE_DIRECTORY && GetFileSystem()) {
+    GetFileSystem()->InvalidatePaths();
   }
 
-  return dst;
+  if (!observers_.empty()) {
+    bool is_directory = entry->second->GetItemType() == TYPE_DIRECTORY;
+    std::string listing_entry_old =
+        is_directory ? "/" + itemname_orig : itemname_orig;
+    std::string listing_entry_new = GetListingEntry(*entry->second);
+    for (auto& observer : observers_) {
+      observer->OnItemRenamed(listing_entry_old, listing_entry_new);
+    }
+  }
+  item_index_.emplace(itemname_new, entry);
+  return true;
 }
 
 CodegateItem* CodegateDirectoryImpl::FindItemByName(
@@ -264,26 +1263,43 @@ CodegateItem* CodegateDirectoryImpl::FindItemByName(
     return static_cast<CodegateItem*>(GetParentDir());
   }
 
-  auto it = std::find_if(
-      item_list_.begin(), item_list_.end(),
-      [&name](const auto& file) { return file->GetItemName() == name; });
-
-  return it != item_list_.end() ? it->get() : nullptr;
+  auto it = item_index_.find(name);
+  return it != item_index_.end() ? it->second->second.get() : nullptr;
 }
 
 std::unique_ptr<CodegateItem> CodegateDirectoryImpl::RemoveItemByName(
-    const std::string& name) {
-  auto it = std::find_if(
-      item_list_.begin(), item_list_.end(),
-      [&name](const auto& file) { return file->GetItemName() == name; });
+    const std::string& name,
+    uint64_t* seq) {
+  auto it = item_index_.find(name);
+  if (it == item_index_.end()) {
+    return nullptr;
+  }
+
+  if (seq) {
+    *seq = it->second->first;
+  }
 
-  if (it != item_list_.end()) {
-    std::unique_ptr<CodegateItem> result = std::move(*it);
-    item_list_.erase(it);
-    return result;
+  std::unique_ptr<CodegateItem> result = std::move(it->second->second);
+  item_list_.erase(it->second);
+  item_index_.erase(it);
+  MarkModified();
+
+  uint64_t bytes, items;
+  GetItemUsage(*result, &bytes, &items);
+  AdjustUsage(-static_cast<int64_t>(bytes), -static_cast<int64_t>(items));
+  // A directory leaving this one is being moved or deleted; either way paths
+  // cached beneath it no longer hold.
+  if (result->GetItemType() == TYPE_DIRECTORY && GetFileSystem()) {
+    GetFileSystem()->InvalidatePaths();
   }
 
-  return nullptr;
+  if (!observers_.empty()) {
+    std::string listing_entry = GetListingEntry(*result);
+    for (auto& observer : observers_) {
+      observer->OnItemRemoved(listing_entry);
+    }
+  }
+  return result;
 }
 
 bool CodegateDirectoryImpl::IsItemNameExists(
@@ -305,13 +1321,51 @@ std::vector<std::string> CodegateDirectoryImpl::GetItemNameList() const {
   std::vector<std::string> result;
   result.reserve(item_list_.size());
 
-  for (const auto& file : item_list_) {
-    if (file->GetItemType() == TYPE_DIRECTORY) {
-      result.push_back("/" + file->GetItemName());
-    } else {
-      result.push_back(file->GetItemName());
-    }
+  for (const auto& [seq, file] : item_list_) {
+    result.push_back(GetListingEntry(*file));
   }
 
   return result;
 }
+
+// static
+std::string CodegateDirectoryImpl::GetListingEntry(const CodegateItem& item) {
+  if (item.GetItemType() == TYPE_DIRECTORY) {
+    return "/" + item.GetItemName();
+  }
+  return item.GetItemName();
+}
+
+// static
+blink::mojom::cfs::ItemStatPtr CodegateDirectoryImpl::GetItemStat(
+    const CodegateItem& item) {
+  auto stat = blink::mojom::cfs::ItemStat::New();
+  stat->name = item.GetItemName();
+  stat->mod_count = item.GetModCount();
+
+  if (item.GetItemType() == TYPE_DIRECTORY) {
+    const auto& directory = static_cast<const CodegateDirectoryImpl&>(item);
+    stat->type = blink::mojom::cfs::ITEMTYPE::kDir;
+    stat->child_count =
+        base::saturated_cast<uint32_t>(directory.item_list_.size());
+  } else {
+    const auto& file = static_cast<const CodegateFileImpl&>(item);
+    stat->type = blink::mojom::cfs::ITEMTYPE::kFile;
+    stat->size = file.storage().size();
+  }
+  return stat;
+}
+
+// static
+void CodegateDirectoryImpl::GetItemUsage(const CodegateItem& item,
+                                         uint64_t* bytes,
+                                         uint64_t* items) {
+  if (item.GetItemType() == TYPE_DIRECTORY) {
+    const auto& directory = static_cast<const CodegateDirectoryImpl&>(item);
+    *bytes = directory.subtree_bytes_;
+    *items = directory.subtree_items_ + 1;
+  } else {
+    *bytes = static_cast<const CodegateFileImpl&>(item).storage().size();
+    *items = 1;
+  }
+}
@@ -6,19 +6,28 @@
 #include <list>
 #include <map>
 #include <memory>
+#include <optional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 // content
 #include "content/browser/CFS/cfs_file_impl.h"
+#include "content/browser/CFS/cfs_file_system.h"
 #include "content/browser/CFS/cfs_item.h"
+#include "content/browser/CFS/cfs_journal.h"
 #include "content/browser/CFS/cfs_manager_impl.h"
+#include "content/browser/CFS/cfs_receiver_set.h"
 
 // base
+#include "base/containers/span.h"
+#include "base/memory/raw_ptr.h"
 #include "base/memory/weak_ptr.h"
 #include "base/task/sequenced_task_runner.h"
 
 // mojo dependency
+#include "mojo/public/cpp/bindings/associated_remote_set.h"
+#include "mojo/public/cpp/bindings/pending_associated_remote.h"
 #include "mojo/public/cpp/bindings/pending_receiver.h"
 #include "mojo/public/cpp/bindings/receiver.h"
 #include "mojo/public/cpp/bindings/receiver_set.h"
@@ -27,13 +36,21 @@
 // mojo IPC Rule
 #include "third_party/blink/public/mojom/CFS/cfs.mojom.h"
 
-struct backup {
+class CodegateDirectoryImpl;
+class CodegateFileImpl;
+
+// What it takes to revert one applied batch op. |directory| is the parent the
+// item lived in before the op and |seq| its position there.
+struct BatchUndo {
+  blink::mojom::cfs::BatchOpType type;
+  raw_ptr<CodegateDirectoryImpl> directory = nullptr;
+  raw_ptr<CodegateDirectoryImpl> destination = nullptr;  // kMove
   std::string itemname;
-  int filetype;
+  std::string itemname_new;  // kRename
+  uint64_t seq = 0;
+  std::unique_ptr<CodegateItem> removed_item;  // kDelete
 };
 
-class CodegateFileImpl;
-
 class CodegateDirectoryImpl
     : public blink::mojom::cfs::CodegateDirectory,
       public CodegateItem {
@@ -45,54 +62,228 @@ class CodegateDirectoryImpl
   CodegateDirectoryImpl& operator=(const CodegateDirectoryImpl&) = delete;
 
   // Mojo IDL
-  void GetItemHandle(const std::string& itemname,
+  void GetItemHandle(const std::string& path,
                      GetItemHandleCallback callback) override;
 
-  void CreateItem(const std::string& itemname,
+  void CreateItem(const std::string& path,
                   blink::mojom::cfs::ITEMTYPE type,
                   CreateItemCallback callback) override;
 
-  void DeleteItem(const std::string& itemname,
+  void DeleteItem(const std::string& path,
                   DeleteItemCallback callback) override;
 
-  void RenameItem(const std::string& itemname_orig,
+  void RenameItem(const std::string& path_orig,
                   const std::string& itemname_new,
                   RenameItemCallback callback) override;
 
-  void ChangeItemLocation(const std::string& itemname_src,
-                          const std::string& itemname_dst,
+  void ChangeItemLocation(const std::string& path_src,
+                          const std::string& path_dst,
                           ChangeItemLocationCallback callback) override;
 
   void ListItems(ListItemsCallback callback) override;
 
+  void ListItemsPage(uint64_t cursor,
+                     uint32_t max_entries,
+                     ListItemsPageCallback callback) override;
+
+  void ListItemsDetailed(uint64_t cursor,
+                         uint32_t max_entries,
+                         ListItemsDetailedCallback callback) override;
+
   void GetPwd(GetPwdCallback callback) override;
 
-  void AddReceiver(mojo::PendingReceiver<blink::mojom::cfs::CodegateDirectory> receiver);
+  void ExecuteBatch(std::vector<blink::mojom::cfs::BatchOpPtr> ops,
+                    bool atomic,
+                    ExecuteBatchCallback callback) override;
+
+  void AddObserver(
+      mojo::PendingAssociatedRemote<blink::mojom::cfs::CodegateDirectoryObserver>
+          observer) override;
+
+  void RemoveItem(const std::string& path,
+                  bool recursive,
+                  RemoveItemCallback callback) override;
+
+  void CopyItem(const std::string& path_src,
+                const std::string& path_dst,
+                bool recursive,
+                CopyItemCallback callback) override;
+
+  void GetDiskUsage(const std::string& path,
+                    GetDiskUsageCallback callback) override;
+
+  void CreateDirectories(const std::string& path,
+                         CreateDirectoriesCallback callback) override;
+
+  void Find(const std::string& path,
+            const std::string& pattern,
+            bool files,
+            bool directories,
+            uint32_t max_results,
+            FindCallback callback) override;
+
+  void Grep(const std::string& path,
+            const std::vector<uint8_t>& pattern,
+            uint32_t max_matches,
+            GrepCallback callback) override;
+
+  // Fails only when the filesystem has no receiver left to give.
+  bool AddReceiver(
+      mojo::PendingReceiver<blink::mojom::cfs::CodegateDirectory> receiver);
+  // Returns an invalid remote if AddReceiver fails.
   mojo::PendingRemote<blink::mojom::cfs::CodegateDirectory> GenerateConnection();
-    void OnReceiverDisconnect();
+  void OnReceiverDisconnect();
+
+  // Absolute path of this directory as reported by GetPwd, e.g. "/root/a".
+  // Cached in this directory only, until a directory of the same filesystem
+  // is renamed or moved. For directories that have handles of their own.
+  const std::string& GetAbsolutePath();
+  // Builds the absolute path with one walk up to the root and caches
+  // nothing, so that paths reported for many directories, e.g. by Find, do
+  // not leave a cached copy behind in each of them.
+  std::string BuildAbsolutePath() const;
 
+  // Bytes of every file and number of items below this directory.
+  uint64_t subtree_bytes() const { return subtree_bytes_; }
+  uint64_t subtree_items() const { return subtree_items_; }
+  // Applies a usage change below this directory to it and every ancestor.
+  void AdjustUsage(int64_t bytes, int64_t items);
+
+  // Replays one logged mutation. Called on the root, which resolves the
+  // record's absolute paths. kSetQuota is the filesystem's to apply.
+  bool ApplyJournalRecord(const CodegateJournalRecord& record);
+  // Adds the records that recreate everything below this directory, in
+  // listing order, after syncing every file body they refer to. Returns
+  // false if a body failed to sync.
+  bool WriteCheckpoint(CodegateJournal::Checkpoint* checkpoint);
+
+  // Creates an empty item named |itemname| right in this directory. Fails on
+  // an invalid or taken name and when the filesystem is out of items or file
+  // storage. A file gets |storage| if given, new storage otherwise.
+  CodegateItem* CreateChild(
+      const std::string& itemname,
+      int itemtype,
+      std::unique_ptr<CodegateFileStorage> storage = nullptr);
+  // Children in listing order.
+  std::vector<CodegateItem*> GetChildren() const;
+  static bool IsValidItemName(const std::string& itemname);
 
 
  private:
+  // Children are kept in insertion order, keyed by a per-directory sequence
+  // number, so that removing an entry never shifts the others.
+  using ItemMap = std::map<uint64_t, std::unique_ptr<CodegateItem>>;
+
+  // Mutations are logged only once they succeeded, but their record is
+  // built before they run: paths are taken relative to this directory, and
+  // the mutation may rename or move it. Returns nullopt without a journal.
+  std::optional<CodegateJournalRecord> MakeJournalRecord(
+      CodegateJournalRecord::Op op,
+      const std::string& path,
+      const std::string& target);
+  void AppendToJournal(const std::optional<CodegateJournalRecord>& record);
+  // Null when nothing is logged. Mutations pass their reply through
+  // CodegateJournal::HoldReply with it.
+  CodegateJournal* GetJournal() const;
+  std::string GetJournalPath(const std::string& path);
+
   bool AddItemInternal(std::unique_ptr<CodegateItem> new_item);
-  void RecoverItem(struct backup backup_info,
-                   CodegateDirectoryImpl* destination_directory,
-                   ChangeItemLocationCallback callback);
+  void InsertItemAt(uint64_t seq, std::unique_ptr<CodegateItem> item);
+
+  // Shared by the single-op mojo methods and ExecuteBatch. When |undo| is
+  // given it receives what RollbackBatch needs to revert the op; a deleted
+  // item is parked there instead of being destroyed.
+  CodegateItem* CreateItemInternal(const std::string& path,
+                                   int itemtype,
+                                   BatchUndo* undo);
+  bool DeleteItemInternal(const std::string& path, BatchUndo* undo);
+  bool RenameItemByPath(const std::string& path_orig,
+                        const std::string& itemname_new,
+                        BatchUndo* undo);
+  CodegateItem* MoveItemInternal(const std::string& path_src,
+                                 const std::string& path_dst,
+                                 BatchUndo* undo);
+  // |body_ids| is passed on to CloneItem.
+  CodegateItem* CopyItemInternal(const std::string& path_src,
+                                 const std::string& path_dst,
+                                 bool recursive,
+                                 std::vector<uint64_t>* body_ids,
+                                 bool adopt_bodies);
+  // Returns a detached copy of |source| and everything below it, named
+  // |itemname|, or nullptr if file storage ran out. Quotas are the caller's
+  // to check. The body ids of the copied files are appended to |body_ids|
+  // if given; with |adopt_bodies|, the copies instead reopen the bodies
+  // listed there, which is how a logged copy replays.
+  std::unique_ptr<CodegateItem> CloneItem(const CodegateItem& source,
+                                          const std::string& itemname,
+                                          std::vector<uint64_t>* body_ids,
+                                          bool adopt_bodies);
+
+  bool ApplyBatchOp(const blink::mojom::cfs::BatchOp& op,
+                    std::vector<BatchUndo>* undo_log);
+  void RollbackBatch(std::vector<BatchUndo>* undo_log);
+
+  CodegateDirectoryImpl* ValidateChangeLocation(
+      const std::string& path_src,
+      const std::string& path_dst,
+      CodegateDirectoryImpl** source_directory,
+      std::string* itemname);
+
+  // Splits a slash-separated |path| into |components| and returns the
+  // directory they start at. Relative paths start at this directory; absolute
+  // paths start at the filesystem root and name it first, the way GetPwd
+  // reports it, and that first component is dropped. Returns nullptr if an
+  // absolute path names another root.
+  CodegateDirectoryImpl* SplitPath(const std::string& path,
+                                   std::vector<std::string>* components);
+  // Follows |components| from |start|, normalizing "." and ".." on the way.
+  static CodegateItem* WalkPath(CodegateDirectoryImpl* start,
+                                base::span<const std::string> components);
+  // Resolves |path| in one walk.
+  CodegateItem* ResolvePath(const std::string& path);
+  // Resolves all but the last component of |path| to a directory and stores
+  // the last component in |itemname|. Fails if that name is not a valid item
+  // name, and for a path that names the root itself.
+  CodegateDirectoryImpl* ResolveParent(const std::string& path,
+                                       std::string* itemname);
+  CodegateDirectoryImpl* GetRootDir();
+  // True if this directory is |item| or lies somewhere beneath it.
+  bool IsWithin(const CodegateItem* item) const;
 
-  CodegateDirectoryImpl* ValidateChangeLocation(const std::string& itemname,
-                                                const std::string& dst_dir);
+  bool RenameItemInternal(const std::string& itemname_orig,
+                          const std::string& itemname_new);
 
   CodegateItem* FindItemByName(const std::string& name) const;
-  std::unique_ptr<CodegateItem> RemoveItemByName(const std::string& name);
+  std::unique_ptr<CodegateItem> RemoveItemByName(const std::string& name,
+                                                 uint64_t* seq = nullptr);
 
   bool IsItemNameExists(const std::string& itemname) const;
   bool IsValidFile(const std::string& itemname) const;
   bool IsValidDirectory(const std::string& dirname) const;
 
   std::vector<std::string> GetItemNameList() const;
+  // |item| as it appears in ListItems: directories get a leading "/".
+  static std::string GetListingEntry(const CodegateItem& item);
+  static blink::mojom::cfs::ItemStatPtr GetItemStat(const CodegateItem& item);
+  // What |item| adds to its parent's subtree counters, itself included.
+  static void GetItemUsage(const CodegateItem& item,
+                           uint64_t* bytes,
+                           uint64_t* items);
 
-  mojo::ReceiverSet<blink::mojom::cfs::CodegateDirectory> receivers_;
-  std::vector<std::unique_ptr<CodegateItem>> item_list_;
+  CodegateReceiverSet<blink::mojom::cfs::CodegateDirectory> receivers_{this};
+  // Notified from InsertItemAt, RemoveItemByName and RenameItemInternal, which
+  // every change to |item_list_| goes through, batch rollbacks included.
+  mojo::AssociatedRemoteSet<blink::mojom::cfs::CodegateDirectoryObserver>
+      observers_;
+  ItemMap item_list_;
+  // Name -> entry in |item_list_|. Must be updated together with
+  // |item_list_| and whenever a child is renamed.
+  std::unordered_map<std::string, ItemMap::iterator> item_index_;
+  uint64_t next_item_seq_ = 0;
+  std::string cached_path_;
+  uint64_t cached_path_epoch_ = 0;
+  uint64_t subtree_bytes_ = 0;
+  uint64_t subtree_items_ = 0;
   base::WeakPtrFactory<CodegateDirectoryImpl> weak_factory_{this};
 };
 #endif  // CONTENT_BROWSER_CFS_CFS_DIRECTORY_IMPL_H_
@@ -0,0 +1,158 @@
+// content/browser/CFS/cfs_directory_impl_unittest.cc
+
+// content
+#include "content/browser/CFS/cfs_directory_impl.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "content/browser/CFS/cfs_file_system.h"
+
+// base
+#include "base/files/file_path.h"
+#include "base/test/task_environment.h"
+#include "base/test/test_future.h"
+
+// test
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace {
+
+using blink::mojom::cfs::ITEMTYPE;
+
+class CodegateDirectoryImplTest : public testing::Test {
+ protected:
+  CodegateDirectoryImpl* root() { return file_system_.root(); }
+
+  std::vector<std::string> ListItems() {
+    base::test::TestFuture<std::vector<std::string>> future;
+    root()->ListItems(future.GetCallback<const std::vector<std::string>&>());
+    return future.Take();
+  }
+
+  ITEMTYPE GetItemType(const std::string& path) {
+    base::test::TestFuture<ITEMTYPE,
+                           blink::mojom::cfs::CodegateItemResponsePtr>
+        future;
+    root()->GetItemHandle(path, future.GetCallback());
+    return future.Get<0>();
+  }
+
+  ITEMTYPE CreateItem(const std::string& path, ITEMTYPE type) {
+    base::test::TestFuture<ITEMTYPE,
+                           blink::mojom::cfs::CodegateItemResponsePtr>
+        future;
+    root()->CreateItem(path, type, future.GetCallback());
+    return future.Get<0>();
+  }
+
+  bool RenameItem(const std::string& path, const std::string& name) {
+    base::test::TestFuture<bool> future;
+    root()->RenameItem(path, name, future.GetCallback());
+    return future.Get();
+  }
+
+  bool DeleteItem(const std::string& path) {
+    base::test::TestFuture<bool> future;
+    root()->DeleteItem(path, future.GetCallback());
+    return future.Get();
+  }
+
+  std::vector<bool> ExecuteAtomicBatch(
+      std::vector<blink::mojom::cfs::BatchOpPtr> ops) {
+    base::test::TestFuture<bool, std::vector<bool>> future;
+    root()->ExecuteBatch(std::move(ops), /*atomic=*/true,
+                         future.GetCallback<bool, const std::vector<bool>&>());
+    EXPECT_FALSE(future.Get<0>());
+    return future.Get<1>();
+  }
+
+  base::test::TaskEnvironment task_environment_;
+  CodegateFileSystem file_system_{"root", base::FilePath(), nullptr, nullptr};
+};
+
+TEST_F(CodegateDirectoryImplTest, ListsInCreationOrder) {
+  ASSERT_TRUE(root()->CreateChild("b", TYPE_FILE));
+  ASSERT_TRUE(root()->CreateChild("a", TYPE_FILE));
+  ASSERT_TRUE(root()->CreateChild("c", TYPE_DIRECTORY));
+
+  EXPECT_EQ(ListItems(), (std::vector<std::string>{"b", "a", "/c"}));
+  EXPECT_EQ(GetItemType("a"), ITEMTYPE::kFile);
+  EXPECT_EQ(GetItemType("c"), ITEMTYPE::kDir);
+  EXPECT_EQ(GetItemType("d"), ITEMTYPE::kFailed);
+}
+
+TEST_F(CodegateDirectoryImplTest, RejectsTakenName) {
+  ASSERT_TRUE(root()->CreateChild("a", TYPE_FILE));
+
+  EXPECT_FALSE(root()->CreateChild("a", TYPE_FILE));
+  EXPECT_FALSE(root()->CreateChild("a", TYPE_DIRECTORY));
+  EXPECT_EQ(ListItems().size(), 1u);
+}
+
+TEST_F(CodegateDirectoryImplTest, RenameKeepsPosition) {
+  ASSERT_TRUE(root()->CreateChild("a", TYPE_FILE));
+  ASSERT_TRUE(root()->CreateChild("b", TYPE_FILE));
+  ASSERT_TRUE(root()->CreateChild("c", TYPE_FILE));
+
+  EXPECT_TRUE(RenameItem("b", "z"));
+  EXPECT_EQ(ListItems(), (std::vector<std::string>{"a", "z", "c"}));
+  EXPECT_EQ(GetItemType("z"), ITEMTYPE::kFile);
+  EXPECT_EQ(GetItemType("b"), ITEMTYPE::kFailed);
+
+  // The new name must be free.
+  EXPECT_FALSE(RenameItem("a", "c"));
+  EXPECT_EQ(ListItems(), (std::vector<std::string>{"a", "z", "c"}));
+}
+
+TEST_F(CodegateDirectoryImplTest, DeleteFreesName) {
+  ASSERT_TRUE(root()->CreateChild("a", TYPE_FILE));
+  ASSERT_TRUE(root()->CreateChild("b", TYPE_FILE));
+
+  EXPECT_TRUE(DeleteItem("a"));
+  EXPECT_FALSE(DeleteItem("a"));
+  EXPECT_EQ(GetItemType("a"), ITEMTYPE::kFailed);
+
+  // A re-created item goes to the end.
+  ASSERT_TRUE(root()->CreateChild("a", TYPE_DIRECTORY));
+  EXPECT_EQ(ListItems(), (std::vector<std::string>{"b", "/a"}));
+}
+
+// Creating, opening and deleting agree on what an absolute path means.
+TEST_F(CodegateDirectoryImplTest, AbsolutePathsNameRootFirst) {
+  EXPECT_EQ(CreateItem("/a", ITEMTYPE::kFile), ITEMTYPE::kFailed);
+  EXPECT_EQ(ListItems(), std::vector<std::string>());
+
+  EXPECT_EQ(CreateItem("/root/d", ITEMTYPE::kDir), ITEMTYPE::kDir);
+  EXPECT_EQ(CreateItem("/root/d/f", ITEMTYPE::kFile), ITEMTYPE::kFile);
+  EXPECT_EQ(GetItemType("/root/d/f"), ITEMTYPE::kFile);
+  EXPECT_EQ(GetItemType("d/../d/f"), ITEMTYPE::kFile);
+  EXPECT_EQ(GetItemType("/d/f"), ITEMTYPE::kFailed);
+
+  // The root is not an entry of itself.
+  EXPECT_FALSE(DeleteItem("/root"));
+  EXPECT_FALSE(DeleteItem("/"));
+  EXPECT_FALSE(DeleteItem("/d"));
+  EXPECT_TRUE(DeleteItem("/root/d/f"));
+  EXPECT_EQ(GetItemType("/root/d/f"), ITEMTYPE::kFailed);
+}
+
+// Undoing the delete puts "f" back into "d", and undoing the mkdir then
+// destroys "d". The relisting after the rollback must not touch "d".
+TEST_F(CodegateDirectoryImplTest, RollbackDropsDirectoryItRemoved) {
+  using blink::mojom::cfs::BatchOp;
+  using blink::mojom::cfs::BatchOpType;
+  std::vector<blink::mojom::cfs::BatchOpPtr> ops;
+  ops.push_back(BatchOp::New(BatchOpType::kCreateDir, "d", ""));
+  ops.push_back(BatchOp::New(BatchOpType::kCreateFile, "d/f", ""));
+  ops.push_back(BatchOp::New(BatchOpType::kDelete, "d/f", ""));
+  ops.push_back(BatchOp::New(BatchOpType::kDelete, "missing", ""));
+
+  EXPECT_EQ(ExecuteAtomicBatch(std::move(ops)),
+            (std::vector<bool>{true, true, true, false}));
+  EXPECT_EQ(ListItems(), std::vector<std::string>());
+  EXPECT_EQ(GetItemType("d"), ITEMTYPE::kFailed);
+}
+
+}  // namespace
@@ -0,0 +1,158 @@
+// content/browser/CFS/cfs_file_content.cc
+
+// content
+#include "content/browser/CFS/cfs_file_content.h"
+
+#include <algorithm>
+
+// base
+#include "base/check_op.h"
+#include "base/memory/scoped_refptr.h"
+
+CodegateFileChunk::CodegateFileChunk(size_t size) : data_(size) {}
+
+CodegateFileChunk::CodegateFileChunk(base::span<const uint8_t> data)
+    : data_(data.begin(), data.end()) {}
+
+CodegateFileChunk::~CodegateFileChunk() = default;
+
+CodegateFileContent::CodegateFileContent() = default;
+CodegateFileContent::~CodegateFileContent() = default;
+
+CodegateFileContent::CodegateFileContent(const CodegateFileContent&) = default;
+CodegateFileContent& CodegateFileContent::operator=(
+    const CodegateFileContent&) = default;
+CodegateFileContent::CodegateFileContent(CodegateFileContent&&) = default;
+CodegateFileContent& CodegateFileContent::operator=(CodegateFileContent&&) =
+    default;
+
+size_t CodegateFileContent::Read(uint64_t offset,
+                                 base::span<uint8_t> buffer) const {
+  if (offset >= size_) {
+    return 0;
+  }
+
+  size_t count =
+      static_cast<size_t>(std::min<uint64_t>(buffer.size(), size_ - offset));
+  size_t done = 0;
+  while (done < count) {
+    uint64_t pos = offset + done;
+    size_t chunk_idx = static_cast<size_t>(pos / kChunkSize);
+    size_t chunk_offset = static_cast<size_t>(pos % kChunkSize);
+    size_t step = std::min(count - done, ChunkLength(chunk_idx) - chunk_offset);
+
+    base::span<uint8_t> dest = buffer.subspan(done, step);
+    if (chunks_[chunk_idx]) {
+      dest.copy_from(chunks_[chunk_idx]->data().subspan(chunk_offset, step));
+    } else {
+      std::ranges::fill(dest, 0);
+    }
+    done += step;
+  }
+  return count;
+}
+
+std::vector<uint8_t> CodegateFileContent::ReadAll() const {
+  std::vector<uint8_t> data(static_cast<size_t>(size_));
+  Read(0, data);
+  return data;
+}
+
+bool CodegateFileContent::Equals(base::span<const uint8_t> data) const {
+  if (data.size() != size_) {
+    return false;
+  }
+
+  for (size_t chunk_idx = 0; chunk_idx < chunks_.size(); ++chunk_idx) {
+    base::span<const uint8_t> expected =
+        data.subspan(chunk_idx * kChunkSize, ChunkLength(chunk_idx));
+    if (chunks_[chunk_idx]) {
+      if (!std::ranges::equal(chunks_[chunk_idx]->data(), expected)) {
+        return false;
+      }
+    } else if (!std::ranges::all_of(expected,
+                                    [](uint8_t byte) { return byte == 0; })) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void CodegateFileContent::Write(uint64_t offset,
+                                base::span<const uint8_t> data) {
+  if (offset + data.size() > size_) {
+    Resize(offset + data.size());
+  }
+
+  size_t done = 0;
+  while (done < data.size()) {
+    uint64_t pos = offset + done;
+    size_t chunk_idx = static_cast<size_t>(pos / kChunkSize);
+    size_t chunk_offset = static_cast<size_t>(pos % kChunkSize);
+    base::span<uint8_t> chunk =
+        GetMutableChunk(chunk_idx).subspan(chunk_offset);
+    size_t step = std::min(chunk.size(), data.size() - done);
+    chunk.first(step).copy_from(data.subspan(done, step));
+    done += step;
+  }
+}
+
+void CodegateFileContent::Assign(base::span<const uint8_t> data) {
+  chunks_.clear();
+  chunks_.reserve((data.size() + kChunkSize - 1) / kChunkSize);
+  for (size_t offset = 0; offset < data.size(); offset += kChunkSize) {
+    chunks_.push_back(base::MakeRefCounted<CodegateFileChunk>(
+        data.subspan(offset, std::min(kChunkSize, data.size() - offset))));
+  }
+  size_ = data.size();
+}
+
+void CodegateFileContent::Resize(uint64_t size) {
+  size_t chunk_count =
+      static_cast<size_t>((size + kChunkSize - 1) / kChunkSize);
+
+  if (size < size_) {
+    chunks_.resize(chunk_count);
+    size_ = size;
+    // The new last chunk may still hold bytes past the end; trim them so a
+    // later grow reads back zeroes.
+    if (!chunks_.empty() && chunks_.back() &&
+        chunks_.back()->size() != ChunkLength(chunk_count - 1)) {
+      GetMutableChunk(chunk_count - 1);
+    }
+    return;
+  }
+
+  // Growing: the old last chunk is extended with zeroes, new chunks stay
+  // unallocated until written.
+  size_t last_idx = chunks_.size();
+  chunks_.resize(chunk_count);
+  size_ = size;
+  if (last_idx > 0 && chunks_[last_idx - 1] &&
+      chunks_[last_idx - 1]->size() != ChunkLength(last_idx - 1)) {
+    GetMutableChunk(last_idx - 1);
+  }
+}
+
+size_t CodegateFileContent::ChunkLength(size_t chunk_idx) const {
+  uint64_t start = static_cast<uint64_t>(chunk_idx) * kChunkSize;
+  return static_cast<size_t>(std::min<uint64_t>(kChunkSize, size_ - start));
+}
+
+base::span<uint8_t> CodegateFileContent::GetMutableChunk(size_t chunk_idx) {
+  CHECK_LT(chunk_idx, chunks_.size());
+  size_t length = ChunkLength(chunk_idx);
+  scoped_refptr<CodegateFileChunk>& chunk = chunks_[chunk_idx];
+
+  if (!chunk) {
+    chunk = base::MakeRefCounted<CodegateFileChunk>(length);
+  } else if (!chunk->HasOneRef()) {
+    auto clone = base::MakeRefCounted<CodegateFileChunk>(length);
+    size_t kept = std::min(length, chunk->size());
+    clone->mutable_data().first(kept).copy_from(chunk->data().first(kept));
+    chunk = std::move(clone);
+  } else if (chunk->size() != length) {
+    chunk->Resize(length);
+  }
+  return chunk->mutable_data();
+}
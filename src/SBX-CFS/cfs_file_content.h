@@ -0,0 +1,79 @@
+#ifndef CONTENT_BROWSER_CFS_CFS_FILE_CONTENT_H_
+#define CONTENT_BROWSER_CFS_CFS_FILE_CONTENT_H_
+
+// library
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// base
+#include "base/containers/span.h"
+#include "base/memory/ref_counted.h"
+#include "base/memory/scoped_refptr.h"
+
+// Fixed-size slice of a file. A chunk is written in place only while a single
+// CodegateFileContent references it; once shared it is treated as immutable.
+class CodegateFileChunk
+    : public base::RefCountedThreadSafe<CodegateFileChunk> {
+ public:
+  // Zero-filled chunk of |size| bytes.
+  explicit CodegateFileChunk(size_t size);
+  explicit CodegateFileChunk(base::span<const uint8_t> data);
+
+  CodegateFileChunk(const CodegateFileChunk&) = delete;
+  CodegateFileChunk& operator=(const CodegateFileChunk&) = delete;
+
+  base::span<const uint8_t> data() const { return data_; }
+  base::span<uint8_t> mutable_data() { return data_; }
+  size_t size() const { return data_.size(); }
+  void Resize(size_t size) { data_.resize(size); }
+
+ private:
+  friend class base::RefCountedThreadSafe<CodegateFileChunk>;
+  ~CodegateFileChunk();
+
+  std::vector<uint8_t> data_;
+};
+
+// Byte content of a CodegateFileImpl stored as a list of shared chunks.
+// Copying a CodegateFileContent only copies chunk references, so a copy is a
+// cheap snapshot; the next modification of either side clones just the chunk
+// it touches. Chunks that were never written stay unallocated and read back
+// as zeroes.
+class CodegateFileContent {
+ public:
+  static constexpr size_t kChunkSize = 64 * 1024;
+
+  CodegateFileContent();
+  ~CodegateFileContent();
+
+  CodegateFileContent(const CodegateFileContent&);
+  CodegateFileContent& operator=(const CodegateFileContent&);
+  CodegateFileContent(CodegateFileContent&&);
+  CodegateFileContent& operator=(CodegateFileContent&&);
+
+  uint64_t size() const { return size_; }
+
+  // Copies content starting at |offset| into |buffer| and returns the number
+  // of bytes copied, which is short only at the end of the content.
+  size_t Read(uint64_t offset, base::span<uint8_t> buffer) const;
+  std::vector<uint8_t> ReadAll() const;
+  // Returns whether the content is exactly |data|.
+  bool Equals(base::span<const uint8_t> data) const;
+
+  // Writes |data| at |offset|, growing the content with zeroes as needed.
+  void Write(uint64_t offset, base::span<const uint8_t> data);
+  void Assign(base::span<const uint8_t> data);
+  void Resize(uint64_t size);
+
+ private:
+  size_t ChunkLength(size_t chunk_idx) const;
+  // Returns chunk |chunk_idx| ready for writing, allocating it if it was
+  // never written and cloning it if another content still references it.
+  base::span<uint8_t> GetMutableChunk(size_t chunk_idx);
+
+  std::vector<scoped_refptr<CodegateFileChunk>> chunks_;
+  uint64_t size_ = 0;
+};
+
+#endif  // CONTENT_BROWSER_CFS_CFS_FILE_CONTENT_H_
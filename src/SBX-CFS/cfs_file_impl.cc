@@ -3,37 +3,163 @@
 // content
 #include "content/browser/CFS/cfs_file_impl.h"
 
+#include <algorithm>
+#include <optional>
+
 #include "content/browser/CFS/cfs_directory_impl.h"
+#include "content/browser/CFS/cfs_file_system.h"
+#include "content/browser/CFS/cfs_journal.h"
 #include "content/browser/CFS/cfs_manager_impl.h"
 
 // Base
+#include "base/functional/bind.h"
+#include "base/numerics/safe_conversions.h"
+#include "base/task/sequenced_task_runner.h"
 #include "base/task/task_traits.h"
 #include "base/task/thread_pool.h"
 
+// mojo
+#include "mojo/public/cpp/system/simple_watcher.h"
+
+namespace {
+
+// Capacity of the data pipe handed out by ReadStream. The writer never has
+// more than this much of a file in flight.
+constexpr uint32_t kReadStreamChunkSize = 64 * 1024;
+
+}  // namespace
+
+// Feeds one ReadStream pipe from a reader of its file, one pipe-capacity at
+// a time, so streaming never copies the file up front. With in-memory storage
+// the reader is a snapshot that shares the file's chunks. Owned by the file it
+// reads from.
+class CodegateFileStreamWriter {
+ public:
+  CodegateFileStreamWriter(
+      std::unique_ptr<CodegateFileStorage> reader,
+      mojo::ScopedDataPipeProducerHandle producer,
+      base::OnceCallback<void(CodegateFileStreamWriter*)> on_finished)
+      : reader_(std::move(reader)),
+        producer_(std::move(producer)),
+        size_(reader_->size()),
+        on_finished_(std::move(on_finished)),
+        watcher_(FROM_HERE,
+                 mojo::SimpleWatcher::ArmingPolicy::MANUAL,
+                 base::SequencedTaskRunner::GetCurrentDefault()) {}
+
+  void Start() {
+    watcher_.Watch(producer_.get(), MOJO_HANDLE_SIGNAL_WRITABLE,
+                   base::BindRepeating(&CodegateFileStreamWriter::OnWritable,
+                                       base::Unretained(this)));
+    watcher_.ArmOrNotify();
+  }
+
+ private:
+  void OnWritable(MojoResult result) {
+    while (result == MOJO_RESULT_OK && offset_ < size_) {
+      base::span<uint8_t> buffer;
+      MojoResult rv = producer_->BeginWriteData(
+          size_ - offset_, MOJO_BEGIN_WRITE_DATA_FLAG_NONE, buffer);
+      if (rv == MOJO_RESULT_SHOULD_WAIT) {
+        watcher_.ArmOrNotify();
+        return;
+      }
+      if (rv != MOJO_RESULT_OK) {
+        break;
+      }
+
+      size_t wanted = static_cast<size_t>(
+          std::min<uint64_t>(buffer.size(), size_ - offset_));
+      size_t copied = reader_->Read(offset_, buffer.first(wanted));
+      producer_->EndWriteData(copied);
+      offset_ += copied;
+      if (copied < wanted) {
+        // The file got shorter or could not be read; end the stream early.
+        break;
+      }
+    }
+
+    // Deletes |this|.
+    std::move(on_finished_).Run(this);
+  }
+
+  std::unique_ptr<CodegateFileStorage> reader_;
+  mojo::ScopedDataPipeProducerHandle producer_;
+  uint64_t size_;
+  uint64_t offset_ = 0;
+  base::OnceCallback<void(CodegateFileStreamWriter*)> on_finished_;
+  mojo::SimpleWatcher watcher_;
+};
+
 CodegateFileImpl::CodegateFileImpl(const std::string& filename)
-    : CodegateItem(filename, TYPE_FILE) {}
+    : CodegateFileImpl(filename,
+                       std::make_unique<CodegateMemoryFileStorage>()) {}
 
-CodegateFileImpl::~CodegateFileImpl() {}
+CodegateFileImpl::CodegateFileImpl(
+    const std::string& filename,
+    std::unique_ptr<CodegateFileStorage> storage)
+    : CodegateItem(filename, TYPE_FILE), storage_(std::move(storage)) {
+  CHECK(storage_);
+}
+
+CodegateFileImpl::~CodegateFileImpl() {
+  if (GetFileSystem()) {
+    GetFileSystem()->name_index().Remove(this);
+  }
+}
 
 void CodegateFileImpl::GetFilename(GetFilenameCallback callback) {
   std::move(callback).Run(GetItemName());
 }
 
+void CodegateFileImpl::GetPath(GetPathCallback callback) {
+  if (!GetParentDir()) {
+    std::move(callback).Run(std::string());
+    return;
+  }
+  std::move(callback).Run(GetParentDir()->BuildAbsolutePath() + "/" +
+                          GetItemName());
+}
+
 void CodegateFileImpl::Write(const std::vector<uint8_t>& data,
                              WriteCallback callback) {
-  data_buffer_ = data;
-  std::move(callback).Run(true);
+  // The reply waits until the mutation is in the journal for good.
+  callback = CodegateJournal::HoldReply(GetJournal(), std::move(callback));
+  if (!CanResizeTo(data.size())) {
+    std::move(callback).Run(false);
+    return;
+  }
+  // Rewriting the body a file already holds changes nothing, so it is
+  // neither counted as a modification nor logged.
+  if (storage_->HasContent(data)) {
+    std::move(callback).Run(true);
+    return;
+  }
+
+  uint64_t old_size = storage_->size();
+  bool success = storage_->Assign(data);
+  OnContentChanged(old_size);
+  if (success) {
+    AppendToJournal(CodegateJournalRecord::Op::kAssign, 0, data);
+  }
+  std::move(callback).Run(success);
 }
 
 void CodegateFileImpl::Read(ReadCallback callback) {
-  std::vector<uint8_t> data = data_buffer_;
-  std::move(callback).Run(true, data);
+  ReadRange(0, base::saturated_cast<uint32_t>(storage_->size()),
+            std::move(callback));
 }
 
 void CodegateFileImpl::Edit(uint32_t idx, uint8_t value, EditCallback callback) {
-  if (idx < data_buffer_.size()) {
-    data_buffer_[idx] = value;
-    std::move(callback).Run(true);
+  callback = CodegateJournal::HoldReply(GetJournal(), std::move(callback));
+  if (idx < storage_->size()) {
+    bool success = storage_->Write(idx, base::span_from_ref(value));
+    MarkModified();
+    if (success) {
+      AppendToJournal(CodegateJournalRecord::Op::kWriteAt, idx,
+                      base::span_from_ref(value));
+    }
+    std::move(callback).Run(success);
   } else {
     std::move(callback).Run(false);
   }
@@ -44,22 +170,254 @@ void CodegateFileImpl::Close(CloseCallback callback) {
   std::move(callback).Run(true);
 }
 
-void CodegateFileImpl::AddReceiver(
+void CodegateFileImpl::ReadRange(uint64_t offset,
+                                 uint32_t length,
+                                 ReadRangeCallback callback) {
+  if (offset > storage_->size()) {
+    std::move(callback).Run(false, std::nullopt);
+    return;
+  }
+
+  // Copied once, straight from the storage into the reply.
+  size_t count = static_cast<size_t>(
+      std::min<uint64_t>(length, storage_->size() - offset));
+  std::optional<std::vector<uint8_t>> data(std::in_place, count);
+  if (storage_->Read(offset, *data) != count) {
+    std::move(callback).Run(false, std::nullopt);
+    return;
+  }
+  std::move(callback).Run(true, data);
+}
+
+void CodegateFileImpl::ReadStream(ReadStreamCallback callback) {
+  if (stream_writers_.size() >= CFS_STREAMS_PER_FILE_MAX) {
+    std::move(callback).Run(false, 0, mojo::ScopedDataPipeConsumerHandle());
+    return;
+  }
+
+  mojo::ScopedDataPipeProducerHandle producer;
+  mojo::ScopedDataPipeConsumerHandle consumer;
+  if (mojo::CreateDataPipe(kReadStreamChunkSize, producer, consumer) !=
+      MOJO_RESULT_OK) {
+    std::move(callback).Run(false, 0, mojo::ScopedDataPipeConsumerHandle());
+    return;
+  }
+
+  std::unique_ptr<CodegateFileStorage> reader = storage_->CreateReader();
+  if (!reader) {
+    std::move(callback).Run(false, 0, mojo::ScopedDataPipeConsumerHandle());
+    return;
+  }
+
+  uint64_t size = reader->size();
+  auto writer = std::make_unique<CodegateFileStreamWriter>(
+      std::move(reader), std::move(producer),
+      base::BindOnce(&CodegateFileImpl::OnStreamFinished,
+                     base::Unretained(this)));
+  CodegateFileStreamWriter* started_writer = writer.get();
+  stream_writers_.push_back(std::move(writer));
+  started_writer->Start();
+
+  std::move(callback).Run(true, size, std::move(consumer));
+}
+
+void CodegateFileImpl::WriteBuffer(mojo_base::BigBuffer data,
+                                   WriteBufferCallback callback) {
+  callback = CodegateJournal::HoldReply(GetJournal(), std::move(callback));
+  if (!CanResizeTo(data.size())) {
+    std::move(callback).Run(false);
+    return;
+  }
+  if (storage_->HasContent(data)) {
+    std::move(callback).Run(true);
+    return;
+  }
+
+  // |data| is either the inline bytes of the message or a mapping of the
+  // sender's shared memory region. Neither can be adopted: BigBuffer does not
+  // give up its inline bytes, and the sender may still write to the region.
+  // So it is copied once into the storage, and not at all if the blob store
+  // already holds the same body, plus once into the journal frame if the
+  // filesystem keeps one.
+  uint64_t old_size = storage_->size();
+  bool success = storage_->Assign(data);
+  OnContentChanged(old_size);
+  if (success) {
+    AppendToJournal(CodegateJournalRecord::Op::kAssign, 0, data);
+  }
+  std::move(callback).Run(success);
+}
+
+void CodegateFileImpl::WriteAt(uint64_t offset,
+                               const std::vector<uint8_t>& data,
+                               WriteAtCallback callback) {
+  callback = CodegateJournal::HoldReply(GetJournal(), std::move(callback));
+  if (offset > CFS_FILESIZE_MAX || data.size() > CFS_FILESIZE_MAX - offset ||
+      !CanResizeTo(std::max(storage_->size(), offset + data.size()))) {
+    std::move(callback).Run(false);
+    return;
+  }
+
+  uint64_t old_size = storage_->size();
+  bool success = storage_->Write(offset, data);
+  OnContentChanged(old_size);
+  if (success) {
+    AppendToJournal(CodegateJournalRecord::Op::kWriteAt, offset, data);
+  }
+  std::move(callback).Run(success);
+}
+
+void CodegateFileImpl::EditBatch(
+    std::vector<blink::mojom::cfs::FileEditPtr> edits,
+    EditBatchCallback callback) {
+  callback = CodegateJournal::HoldReply(GetJournal(), std::move(callback));
+  for (const auto& edit : edits) {
+    if (edit->idx >= storage_->size()) {
+      std::move(callback).Run(false);
+      return;
+    }
+  }
+
+  bool success = true;
+  for (const auto& edit : edits) {
+    if (storage_->Write(edit->idx, base::span_from_ref(edit->value))) {
+      AppendToJournal(CodegateJournalRecord::Op::kWriteAt, edit->idx,
+                      base::span_from_ref(edit->value));
+    } else {
+      success = false;
+    }
+  }
+  MarkModified();
+  std::move(callback).Run(success);
+}
+
+void CodegateFileImpl::Truncate(uint64_t size, TruncateCallback callback) {
+  callback = CodegateJournal::HoldReply(GetJournal(), std::move(callback));
+  if (!CanResizeTo(size)) {
+    std::move(callback).Run(false);
+    return;
+  }
+
+  // Storage past the new end is released, not just hidden.
+  uint64_t old_size = storage_->size();
+  bool success = storage_->Resize(size);
+  OnContentChanged(old_size);
+  if (success) {
+    AppendToJournal(CodegateJournalRecord::Op::kTruncate, size, {});
+  }
+  std::move(callback).Run(success);
+}
+
+void CodegateFileImpl::Append(const std::vector<uint8_t>& data,
+                              AppendCallback callback) {
+  callback = CodegateJournal::HoldReply(GetJournal(), std::move(callback));
+  if (!CanResizeTo(storage_->size() + data.size())) {
+    std::move(callback).Run(false);
+    return;
+  }
+
+  // Only the tail of the file is touched.
+  uint64_t old_size = storage_->size();
+  bool success = storage_->Write(old_size, data);
+  OnContentChanged(old_size);
+  if (success) {
+    AppendToJournal(CodegateJournalRecord::Op::kWriteAt, old_size, data);
+  }
+  std::move(callback).Run(success);
+}
+
+bool CodegateFileImpl::LoadContent(base::span<const uint8_t> data) {
+  if (!CanResizeTo(data.size())) {
+    return false;
+  }
+
+  uint64_t old_size = storage_->size();
+  bool success = storage_->Assign(data);
+  OnContentChanged(old_size);
+  return success;
+}
+
+bool CodegateFileImpl::ApplyJournalRecord(
+    const CodegateJournalRecord& record) {
+  // Quotas are not checked: the mutation passed them when it was logged.
+  uint64_t old_size = storage_->size();
+  bool success = false;
+  switch (record.op) {
+    case CodegateJournalRecord::Op::kAssign:
+      success = storage_->Assign(record.data);
+      break;
+    case CodegateJournalRecord::Op::kWriteAt:
+      success = record.offset <= CFS_FILESIZE_MAX &&
+                record.data.size() <= CFS_FILESIZE_MAX - record.offset &&
+                storage_->Write(record.offset, record.data);
+      break;
+    case CodegateJournalRecord::Op::kTruncate:
+      success = record.offset <= CFS_FILESIZE_MAX &&
+                storage_->Resize(record.offset);
+      break;
+    default:
+      break;
+  }
+  OnContentChanged(old_size);
+  return success;
+}
+
+bool CodegateFileImpl::CanResizeTo(uint64_t size) const {
+  if (size > CFS_FILESIZE_MAX) {
+    return false;
+  }
+  // Checked before anything is written, so a write over quota fails whole.
+  CodegateFileSystem* file_system = GetFileSystem();
+  return size <= storage_->size() || !file_system ||
+         file_system->CanAddBytes(size - storage_->size());
+}
+
+void CodegateFileImpl::OnContentChanged(uint64_t old_size) {
+  MarkModified();
+  if (storage_->size() != old_size && GetParentDir()) {
+    GetParentDir()->AdjustUsage(static_cast<int64_t>(storage_->size()) -
+                                    static_cast<int64_t>(old_size),
+                                0);
+  }
+}
+
+CodegateJournal* CodegateFileImpl::GetJournal() const {
+  return GetFileSystem() ? GetFileSystem()->journal() : nullptr;
+}
+
+void CodegateFileImpl::AppendToJournal(CodegateJournalRecord::Op op,
+                                       uint64_t offset,
+                                       base::span<const uint8_t> data) {
+  CodegateJournal* journal = GetJournal();
+  if (!journal || !GetParentDir()) {
+    return;
+  }
+
+  CodegateJournalRecord record(
+      op, GetParentDir()->BuildAbsolutePath() + "/" + GetItemName());
+  record.offset = offset;
+  journal->Append(record, data);
+}
+
+void CodegateFileImpl::OnStreamFinished(CodegateFileStreamWriter* writer) {
+  std::erase_if(stream_writers_,
+                [writer](const auto& entry) { return entry.get() == writer; });
+}
+
+bool CodegateFileImpl::AddReceiver(
     mojo::PendingReceiver<blink::mojom::cfs::CodegateFile> receiver) {
-  receivers_.Add(this, std::move(receiver));
-  receivers_.set_disconnect_handler(base::BindRepeating(
-      &CodegateFileImpl::OnReceiverDisconnect, base::Unretained(this)));
+  return receivers_.Add(GetFileSystem(), std::move(receiver));
 }
 
 mojo::PendingRemote<blink::mojom::cfs::CodegateFile>
 CodegateFileImpl::GenerateConnection() {
   mojo::PendingRemote<blink::mojom::cfs::CodegateFile> remote;
-  AddReceiver(remote.InitWithNewPipeAndPassReceiver());
+  if (!AddReceiver(remote.InitWithNewPipeAndPassReceiver())) {
+    return mojo::PendingRemote<blink::mojom::cfs::CodegateFile>();
+  }
   return remote;
 }
 
-  void CodegateFileImpl::OnReceiverDisconnect() {
-    if (receivers_.current_receiver()) {
-      receivers_.Remove(receivers_.current_receiver());
-    }
-  }
+void CodegateFileImpl::OnReceiverDisconnect() {
+  receivers_.RemoveCurrent();
+}
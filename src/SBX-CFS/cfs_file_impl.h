@@ -3,16 +3,25 @@
 
 // library
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
+// base
+#include "base/containers/span.h"
+
 // content
 #include "content/browser/CFS/cfs_directory_impl.h"
 #include "content/browser/CFS/cfs_item.h"
+#include "content/browser/CFS/cfs_journal.h"
 #include "content/browser/CFS/cfs_manager_impl.h"
+#include "content/browser/CFS/cfs_receiver_set.h"
+#include "content/browser/CFS/cfs_storage.h"
 
 // mojo dependency
+#include "mojo/public/cpp/base/big_buffer.h"
 #include "mojo/public/cpp/bindings/pending_receiver.h"
+#include "mojo/public/cpp/system/data_pipe.h"
 #include "mojo/public/cpp/bindings/receiver.h"
 #include "mojo/public/cpp/bindings/receiver_set.h"
 #include "mojo/public/cpp/bindings/self_owned_receiver.h"
@@ -20,13 +29,23 @@
 // mojo IPC Rule
 #include "third_party/blink/public/mojom/CFS/cfs.mojom.h"
 
+// Upper bound for a single file; writes that would grow past it fail.
+#define CFS_FILESIZE_MAX (64 * 1024 * 1024)
+// ReadStream calls one file may have in flight; each holds a reader and a
+// data pipe until its consumer drains it.
+#define CFS_STREAMS_PER_FILE_MAX 8
+
 class CodegateDirectoryImpl;
+class CodegateFileStreamWriter;
 
 class CodegateFileImpl
     : public blink::mojom::cfs::CodegateFile,
       public CodegateItem {
  public:
+  // Keeps the body in memory.
   explicit CodegateFileImpl(const std::string& filename);
+  CodegateFileImpl(const std::string& filename,
+                   std::unique_ptr<CodegateFileStorage> storage);
   ~CodegateFileImpl() override;
 
   CodegateFileImpl(const CodegateFileImpl&) = delete;
@@ -34,17 +53,59 @@ class CodegateFileImpl
 
   // Mojo IDL
   void GetFilename(GetFilenameCallback callback) override;
+  void GetPath(GetPathCallback callback) override;
   void Write(const std::vector<uint8_t>& data, WriteCallback callback) override;
   void Read(ReadCallback callback) override;
   void Edit(uint32_t idx, uint8_t value, EditCallback callback) override;
   void Close(CloseCallback callback) override;
+  void ReadRange(uint64_t offset,
+                 uint32_t length,
+                 ReadRangeCallback callback) override;
+  void ReadStream(ReadStreamCallback callback) override;
+  void WriteBuffer(mojo_base::BigBuffer data,
+                   WriteBufferCallback callback) override;
+  void WriteAt(uint64_t offset,
+               const std::vector<uint8_t>& data,
+               WriteAtCallback callback) override;
+  void EditBatch(std::vector<blink::mojom::cfs::FileEditPtr> edits,
+                 EditBatchCallback callback) override;
+  void Truncate(uint64_t size, TruncateCallback callback) override;
+  void Append(const std::vector<uint8_t>& data,
+              AppendCallback callback) override;
 
-    void AddReceiver(mojo::PendingReceiver<blink::mojom::cfs::CodegateFile> receiver);
+  // Fails only when the filesystem has no receiver left to give.
+  bool AddReceiver(
+      mojo::PendingReceiver<blink::mojom::cfs::CodegateFile> receiver);
+  // Returns an invalid remote if AddReceiver fails.
   mojo::PendingRemote<blink::mojom::cfs::CodegateFile> GenerateConnection();
   void OnReceiverDisconnect();
+
+  const CodegateFileStorage& storage() const { return *storage_; }
+
+  // Replaces the content, subject to the same limits as Write.
+  bool LoadContent(base::span<const uint8_t> data);
+  // Replays a logged kAssign, kWriteAt or kTruncate.
+  bool ApplyJournalRecord(const CodegateJournalRecord& record);
+
  private:
-  mojo::ReceiverSet<blink::mojom::cfs::CodegateFile> receivers_;
-  std::vector<uint8_t> data_buffer_;
+  // False if the file may not become |size| bytes long, either because of
+  // CFS_FILESIZE_MAX or because growing would exceed the filesystem's quota.
+  bool CanResizeTo(uint64_t size) const;
+  // Bumps the modification counter and rolls a size change up into the
+  // parent directories' usage.
+  void OnContentChanged(uint64_t old_size);
+  // Logs a successful write if the filesystem keeps a journal.
+  void AppendToJournal(CodegateJournalRecord::Op op,
+                       uint64_t offset,
+                       base::span<const uint8_t> data);
+  // Null when nothing is logged. Mutations pass their reply through
+  // CodegateJournal::HoldReply with it.
+  CodegateJournal* GetJournal() const;
+  void OnStreamFinished(CodegateFileStreamWriter* writer);
+
+  CodegateReceiverSet<blink::mojom::cfs::CodegateFile> receivers_{this};
+  std::unique_ptr<CodegateFileStorage> storage_;
+  std::vector<std::unique_ptr<CodegateFileStreamWriter>> stream_writers_;
   base::WeakPtrFactory<CodegateFileImpl> weak_factory_{this};
 };
 #endif  // CONTENT_BROWSER_CFS_CFS_FILE_IMPL_H_
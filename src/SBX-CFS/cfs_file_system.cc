@@ -0,0 +1,263 @@
+// content/browser/CFS/cfs_file_system.cc
+
+// content
+#include "content/browser/CFS/cfs_file_system.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "content/browser/CFS/cfs_directory_impl.h"
+#include "content/browser/CFS/cfs_image.h"
+#include "content/browser/CFS/cfs_journal.h"
+#include "content/browser/CFS/cfs_receiver_set.h"
+#include "content/browser/CFS/cfs_storage.h"
+#include "content/browser/CFS/cfs_usage_budget.h"
+
+// base
+#include "base/files/file_util.h"
+#include "base/functional/bind.h"
+#include "base/logging.h"
+#include "base/numerics/safe_conversions.h"
+
+namespace {
+
+constexpr base::TimeDelta kIdleSweepInterval = base::Seconds(30);
+// A receiver that dispatched nothing for this long counts as forgotten.
+constexpr base::TimeDelta kReceiverIdleTimeout = base::Minutes(2);
+// Receivers per item the sweep never touches, however idle. Normal use stays
+// well below this; only handles opened in a loop and then dropped go past it.
+constexpr size_t kReceiversKeptPerItem = 4;
+
+}  // namespace
+
+CodegateFileSystem::CodegateFileSystem(
+    const std::string& root_name,
+    const base::FilePath& storage_dir,
+    scoped_refptr<CodegateBlobStore> blob_store,
+    scoped_refptr<CodegateUsageBudget> usage_budget)
+    : root_(std::make_unique<CodegateDirectoryImpl>(root_name)),
+      usage_budget_(std::move(usage_budget)) {
+  root_->SetFileSystem(this);
+  idle_sweep_timer_.Start(
+      FROM_HERE, kIdleSweepInterval,
+      base::BindRepeating(&CodegateFileSystem::ReclaimIdleReceivers,
+                          base::Unretained(this)));
+
+  if (storage_dir.empty()) {
+    storage_backend_ =
+        std::make_unique<CodegateMemoryStorageBackend>(std::move(blob_store));
+    return;
+  }
+
+  auto disk_backend = std::make_unique<CodegateDiskStorageBackend>(
+      storage_dir.AppendASCII("bodies"));
+  disk_backend_ = disk_backend.get();
+  storage_backend_ = std::move(disk_backend);
+  if (base::CreateDirectory(storage_dir)) {
+    // Replayed as the log is read, before |journal_| is set, so nothing is
+    // logged again.
+    journal_ = CodegateJournal::Open(
+        storage_dir.AppendASCII("journal"),
+        [this](const CodegateJournalRecord& record) { ReplayRecord(record); });
+  }
+  if (!journal_) {
+    LOG(ERROR) << "Failed to open CFS journal in " << storage_dir;
+    return;
+  }
+
+  disk_backend_->SetJournal(journal_.get());
+  // Bodies of files that were gone, or never logged, when the last session
+  // ended.
+  disk_backend_->DeleteUnusedBodies();
+  // The journal belongs to this filesystem, so it cannot call back after it.
+  journal_->SetCheckpointCallback(base::BindRepeating(
+      &CodegateFileSystem::MaybeCheckpoint, base::Unretained(this)));
+  journal_->SetFailureCallback(base::BindOnce(
+      &CodegateFileSystem::OnJournalFailed, base::Unretained(this)));
+  // A long log left by the last session is compacted right away.
+  MaybeCheckpoint();
+}
+
+CodegateFileSystem::~CodegateFileSystem() {
+  // The journal goes first; bodies the teardown drops are kept anyway.
+  if (disk_backend_) {
+    disk_backend_->SetJournal(nullptr);
+  }
+  // Gives back everything the tree charged, and keeps its teardown from
+  // charging anything more.
+  if (usage_budget_) {
+    usage_budget_->Adjust(-static_cast<int64_t>(used_bytes()),
+                          -static_cast<int64_t>(used_items()));
+    usage_budget_ = nullptr;
+  }
+}
+
+mojo::PendingRemote<blink::mojom::cfs::CodegateDirectory>
+CodegateFileSystem::ConnectRoot() {
+  return root_->GenerateConnection();
+}
+
+std::optional<mojo_base::BigBuffer> CodegateFileSystem::ExportImage() const {
+  return ExportFileSystemImage(*this);
+}
+
+bool CodegateFileSystem::LoadImage(mojo_base::BigBuffer image) {
+  return ImportFileSystemImage(image, this);
+}
+
+std::unique_ptr<CodegateFileStorage> CodegateFileSystem::CreateFileStorage() {
+  return storage_backend_->CreateFileStorage();
+}
+
+std::unique_ptr<CodegateFileStorage> CodegateFileSystem::CloneFileStorage(
+    const CodegateFileStorage& source) {
+  return storage_backend_->CloneFileStorage(source);
+}
+
+std::unique_ptr<CodegateFileStorage> CodegateFileSystem::OpenFileStorage(
+    uint64_t body_id,
+    bool truncate) {
+  return disk_backend_ ? disk_backend_->OpenFileStorage(body_id, truncate)
+                       : nullptr;
+}
+
+uint64_t CodegateFileSystem::used_bytes() const {
+  return root_->subtree_bytes();
+}
+
+uint64_t CodegateFileSystem::used_items() const {
+  return root_->subtree_items();
+}
+
+bool CodegateFileSystem::CanAddBytes(uint64_t bytes) const {
+  return used_bytes() <= quota_bytes_ && bytes <= quota_bytes_ - used_bytes() &&
+         (!usage_budget_ || usage_budget_->CanAddBytes(bytes));
+}
+
+bool CodegateFileSystem::CanAddItems(uint64_t items) const {
+  return used_items() <= quota_items_ && items <= quota_items_ - used_items() &&
+         (!usage_budget_ || usage_budget_->CanAddItems(items));
+}
+
+void CodegateFileSystem::SetQuota(uint64_t quota_bytes, uint64_t quota_items) {
+  // The quotas come from the renderer, so they may only be lowered.
+  quota_bytes_ = std::min<uint64_t>(quota_bytes, CFS_QUOTA_BYTES_DEFAULT);
+  quota_items_ = std::min<uint64_t>(quota_items, CFS_QUOTA_ITEMS_DEFAULT);
+  if (journal()) {
+    CodegateJournalRecord record(CodegateJournalRecord::Op::kSetQuota, "");
+    record.offset = quota_bytes_;
+    record.items = quota_items_;
+    journal()->Append(record);
+  }
+}
+
+void CodegateFileSystem::OnUsageChanged(int64_t bytes, int64_t items) {
+  if (usage_budget_) {
+    usage_budget_->Adjust(bytes, items);
+  }
+}
+
+void CodegateFileSystem::RunWhenCommitted(
+    base::OnceCallback<void(bool)> callback) {
+  if (journal()) {
+    journal()->RunWhenCommitted(std::move(callback));
+  } else {
+    std::move(callback).Run(true);
+  }
+}
+
+blink::mojom::cfs::FileSystemUsagePtr CodegateFileSystem::GetUsage() const {
+  return blink::mojom::cfs::FileSystemUsage::New(used_bytes(), used_items(),
+                                                 quota_bytes_, quota_items_);
+}
+
+void CodegateFileSystem::OnReceiverAdded(CodegateReceiverTracker* tracker) {
+  ++live_receivers_;
+  trackers_.insert(tracker);
+}
+
+void CodegateFileSystem::OnReceiverRemoved(CodegateReceiverTracker* tracker,
+                                           size_t remaining,
+                                           bool reclaimed) {
+  --live_receivers_;
+  if (reclaimed) {
+    ++reclaimed_receivers_;
+  }
+  if (remaining == 0) {
+    trackers_.erase(tracker);
+  }
+}
+
+void CodegateFileSystem::OnTrackerDestroyed(CodegateReceiverTracker* tracker,
+                                            size_t live) {
+  live_receivers_ -= live;
+  trackers_.erase(tracker);
+}
+
+blink::mojom::cfs::HandleStatsPtr CodegateFileSystem::GetHandleStats() const {
+  return blink::mojom::cfs::HandleStats::New(
+      base::saturated_cast<uint32_t>(live_receivers_),
+      base::saturated_cast<uint32_t>(trackers_.size()), reclaimed_receivers_,
+      rejected_receivers_);
+}
+
+void CodegateFileSystem::ReclaimIdleReceivers() {
+  base::TimeTicks cutoff = base::TimeTicks::Now() - kReceiverIdleTimeout;
+  // Reclaiming can drop a tracker from |trackers_|, so walk a copy.
+  std::vector<CodegateReceiverTracker*> trackers(trackers_.begin(),
+                                                 trackers_.end());
+  for (CodegateReceiverTracker* tracker : trackers) {
+    tracker->ReclaimIdle(cutoff, kReceiversKeptPerItem);
+  }
+}
+
+void CodegateFileSystem::ReplayRecord(const CodegateJournalRecord& record) {
+  if (record.op == CodegateJournalRecord::Op::kSetQuota) {
+    SetQuota(record.offset, record.items);
+  } else if (!root_->ApplyJournalRecord(record)) {
+    LOG(ERROR) << "Failed to replay CFS journal record for " << record.path;
+  }
+}
+
+void CodegateFileSystem::Checkpoint() {
+  if (!journal_) {
+    return;
+  }
+
+  std::unique_ptr<CodegateJournal::Checkpoint> checkpoint =
+      journal_->BeginCheckpoint();
+  if (!checkpoint) {
+    return;
+  }
+  if (!root_->WriteCheckpoint(checkpoint.get())) {
+    LOG(ERROR) << "Failed to sync CFS file bodies for a checkpoint";
+    return;
+  }
+  // Last, so that replaying the tree is not held to a quota lowered below
+  // what it already uses.
+  CodegateJournalRecord quota(CodegateJournalRecord::Op::kSetQuota, "");
+  quota.offset = quota_bytes_;
+  quota.items = quota_items_;
+  checkpoint->Add(quota);
+  if (!checkpoint->Finish()) {
+    LOG(ERROR) << "Failed to checkpoint CFS journal";
+  }
+}
+
+void CodegateFileSystem::OnJournalFailed() {
+  // Every client is cut off, so the replies the journal drops go nowhere and
+  // no mutation is made that could not be logged.
+  journal_failed_ = true;
+  std::vector<CodegateReceiverTracker*> trackers(trackers_.begin(),
+                                                 trackers_.end());
+  for (CodegateReceiverTracker* tracker : trackers) {
+    tracker->CloseAll();
+  }
+}
+
+void CodegateFileSystem::MaybeCheckpoint() {
+  if (journal_->NeedsCheckpoint()) {
+    Checkpoint();
+  }
+}
@@ -0,0 +1,171 @@
+#ifndef CONTENT_BROWSER_CFS_CFS_FILE_SYSTEM_H_
+#define CONTENT_BROWSER_CFS_CFS_FILE_SYSTEM_H_
+
+// library
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+// base
+#include "base/files/file_path.h"
+#include "base/memory/raw_ptr.h"
+#include "base/functional/callback.h"
+#include "base/memory/scoped_refptr.h"
+#include "base/timer/timer.h"
+
+// content
+#include "content/browser/CFS/cfs_name_index.h"
+
+// mojo dependency
+#include "mojo/public/cpp/base/big_buffer.h"
+#include "mojo/public/cpp/bindings/pending_remote.h"
+
+// mojo IPC Rule
+#include "third_party/blink/public/mojom/CFS/cfs.mojom.h"
+
+// Live receivers one item, and one whole filesystem, may hold at a time.
+#define CFS_RECEIVERS_PER_ITEM_MAX 64
+#define CFS_RECEIVERS_PER_FS_MAX 4096
+
+// Default quotas for a new filesystem, and the most SetQuota can raise them
+// to; see CodegateFSManager::SetQuota.
+#define CFS_QUOTA_BYTES_DEFAULT (256 * 1024 * 1024)
+#define CFS_QUOTA_ITEMS_DEFAULT (64 * 1024)
+
+class CodegateBlobStore;
+class CodegateDirectoryImpl;
+class CodegateDiskStorageBackend;
+class CodegateFileStorage;
+class CodegateJournal;
+struct CodegateJournalRecord;
+class CodegateReceiverTracker;
+class CodegateStorageBackend;
+class CodegateUsageBudget;
+
+// One filesystem handed out by CodegateFSManagerImpl. Owns the root directory
+// and the state shared by every item of the tree. Lives on a sequence of its
+// own, and so does everything it owns.
+class CodegateFileSystem {
+ public:
+  // An empty |storage_dir| keeps the filesystem in memory. Otherwise file
+  // bodies are kept in files under |storage_dir|, every mutation is logged to
+  // a journal there, and a journal left by an earlier session is replayed
+  // first, on top of the bodies it left; see CodegateDiskStorageBackend.
+  // In-memory bodies are deduplicated through |blob_store|, and usage is
+  // also held to |usage_budget|, shared with the other filesystems of the
+  // manager. Either may be null.
+  CodegateFileSystem(const std::string& root_name,
+                     const base::FilePath& storage_dir,
+                     scoped_refptr<CodegateBlobStore> blob_store,
+                     scoped_refptr<CodegateUsageBudget> usage_budget);
+  ~CodegateFileSystem();
+
+  CodegateFileSystem(const CodegateFileSystem&) = delete;
+  CodegateFileSystem& operator=(const CodegateFileSystem&) = delete;
+
+  CodegateDirectoryImpl* root() const { return root_.get(); }
+  // Returns an invalid remote if the root has no receiver left to give.
+  mojo::PendingRemote<blink::mojom::cfs::CodegateDirectory> ConnectRoot();
+
+  // See cfs_image.h. LoadImage requires an empty filesystem.
+  std::optional<mojo_base::BigBuffer> ExportImage() const;
+  bool LoadImage(mojo_base::BigBuffer image);
+
+  // Returns nullptr if the backend cannot store another file.
+  std::unique_ptr<CodegateFileStorage> CreateFileStorage();
+  std::unique_ptr<CodegateFileStorage> CloneFileStorage(
+      const CodegateFileStorage& source);
+  // Storage on a body named by the journal, for replay. See
+  // CodegateDiskStorageBackend::OpenFileStorage; nullptr in memory.
+  std::unique_ptr<CodegateFileStorage> OpenFileStorage(uint64_t body_id,
+                                                       bool truncate);
+
+  // Null for in-memory filesystems and while the journal is being replayed.
+  CodegateJournal* journal() const { return journal_.get(); }
+  // Syncs every file body and rewrites the journal as the records that
+  // recreate the current tree on top of them. Also how changes made without
+  // logging, such as loading an image, are made durable. No-op without a
+  // journal.
+  void Checkpoint();
+
+  // Every item below the root, by name. See CodegateNameIndex for when
+  // items join and leave it.
+  CodegateNameIndex& name_index() { return name_index_; }
+
+  // Directories asked for their absolute path cache it together with the
+  // epoch it was computed in. Renaming or moving a directory bumps the epoch,
+  // which lazily invalidates every cached path at once.
+  uint64_t path_epoch() const { return path_epoch_; }
+  void InvalidatePaths() { ++path_epoch_; }
+
+  // Usage is rolled up into the root directory as items change, so these are
+  // O(1).
+  uint64_t used_bytes() const;
+  uint64_t used_items() const;
+  bool CanAddBytes(uint64_t bytes) const;
+  bool CanAddItems(uint64_t items) const;
+  // Quotas above the defaults are clamped to them.
+  void SetQuota(uint64_t quota_bytes, uint64_t quota_items);
+  // Runs |callback| once the mutations made so far are durable, with false if
+  // the journal failed to make them so; right away for in-memory
+  // filesystems.
+  void RunWhenCommitted(base::OnceCallback<void(bool)> callback);
+  // Called by the root directory whenever its totals change.
+  void OnUsageChanged(int64_t bytes, int64_t items);
+  blink::mojom::cfs::FileSystemUsagePtr GetUsage() const;
+
+  // Receiver accounting, reported by CodegateReceiverSet. None is added
+  // once the journal failed.
+  bool CanAddReceiver() const {
+    return !journal_failed_ && live_receivers_ < CFS_RECEIVERS_PER_FS_MAX;
+  }
+  void OnReceiverAdded(CodegateReceiverTracker* tracker);
+  void OnReceiverRemoved(CodegateReceiverTracker* tracker,
+                         size_t remaining,
+                         bool reclaimed);
+  void OnReceiverRejected() { ++rejected_receivers_; }
+  void OnTrackerDestroyed(CodegateReceiverTracker* tracker, size_t live);
+
+  blink::mojom::cfs::HandleStatsPtr GetHandleStats() const;
+
+ private:
+  // Runs periodically and drops receivers that stayed idle too long.
+  void ReclaimIdleReceivers();
+
+  // Applies one record of the journal left by an earlier session.
+  void ReplayRecord(const CodegateJournalRecord& record);
+  // Compacts the journal once it grew large enough. Run by the journal as
+  // soon as a commit takes it past that.
+  void MaybeCheckpoint();
+  // Run by the journal when a commit fails. Closes every receiver and
+  // refuses new ones, which leaves the tree as it is until it is reopened.
+  void OnJournalFailed();
+
+  // Declared before |root_| so that they outlive the items reporting to them
+  // while the tree is torn down.
+  std::set<raw_ptr<CodegateReceiverTracker>> trackers_;
+  size_t live_receivers_ = 0;
+  uint64_t reclaimed_receivers_ = 0;
+  uint64_t rejected_receivers_ = 0;
+  base::RepeatingTimer idle_sweep_timer_;
+  // Outlives the file storages it created.
+  std::unique_ptr<CodegateStorageBackend> storage_backend_;
+  // |storage_backend_| if the filesystem is kept on disk, otherwise null.
+  raw_ptr<CodegateDiskStorageBackend> disk_backend_ = nullptr;
+  std::unique_ptr<CodegateJournal> journal_;
+  bool journal_failed_ = false;
+  CodegateNameIndex name_index_;
+
+  std::unique_ptr<CodegateDirectoryImpl> root_;
+  // Starts at 1 so that a zero cache epoch never matches.
+  uint64_t path_epoch_ = 1;
+  scoped_refptr<CodegateUsageBudget> usage_budget_;
+  uint64_t quota_bytes_ = CFS_QUOTA_BYTES_DEFAULT;
+  uint64_t quota_items_ = CFS_QUOTA_ITEMS_DEFAULT;
+};
+
+#endif  // CONTENT_BROWSER_CFS_CFS_FILE_SYSTEM_H_
@@ -0,0 +1,219 @@
+// content/browser/CFS/cfs_image.cc
+
+// content
+#include "content/browser/CFS/cfs_image.h"
+
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "content/browser/CFS/cfs_directory_impl.h"
+#include "content/browser/CFS/cfs_file_impl.h"
+#include "content/browser/CFS/cfs_file_system.h"
+
+// base
+#include "base/containers/span_reader.h"
+#include "base/containers/span_writer.h"
+#include "base/memory/raw_ptr.h"
+#include "base/numerics/safe_conversions.h"
+
+namespace {
+
+constexpr uint32_t kImageMagic = 0x49534643;  // "CFSI"
+constexpr uint32_t kImageVersion = 1;
+constexpr size_t kHeaderSize = 32;
+constexpr size_t kNodeSize = 32;
+// Parent index of the root node.
+constexpr uint32_t kNoParent = std::numeric_limits<uint32_t>::max();
+
+struct ImageNode {
+  uint32_t parent = kNoParent;
+  uint32_t type = 0;
+  uint32_t name_offset = 0;
+  uint32_t name_size = 0;
+  uint64_t data_offset = 0;
+  uint64_t data_size = 0;
+};
+
+bool ReadNode(base::SpanReader<const uint8_t>& reader, ImageNode* node) {
+  return reader.ReadU32LittleEndian(node->parent) &&
+         reader.ReadU32LittleEndian(node->type) &&
+         reader.ReadU32LittleEndian(node->name_offset) &&
+         reader.ReadU32LittleEndian(node->name_size) &&
+         reader.ReadU64LittleEndian(node->data_offset) &&
+         reader.ReadU64LittleEndian(node->data_size);
+}
+
+bool IsInSection(uint64_t offset, uint64_t size, uint64_t section_size) {
+  return offset <= section_size && size <= section_size - offset;
+}
+
+}  // namespace
+
+std::optional<mojo_base::BigBuffer> ExportFileSystemImage(
+    const CodegateFileSystem& file_system) {
+  std::vector<ImageNode> nodes;
+  std::vector<const CodegateFileImpl*> files;
+  std::string strings;
+  uint64_t data_size = 0;
+
+  // Preorder walk. Children are pushed in reverse so that they come off the
+  // stack, and into the node table, in listing order.
+  std::vector<std::pair<CodegateItem*, uint32_t>> stack = {
+      {file_system.root(), kNoParent}};
+  while (!stack.empty()) {
+    auto [item, parent] = stack.back();
+    stack.pop_back();
+
+    ImageNode node;
+    node.parent = parent;
+    node.type = item->GetItemType();
+    node.name_offset = base::checked_cast<uint32_t>(strings.size());
+    node.name_size = base::checked_cast<uint32_t>(item->GetItemName().size());
+    strings += item->GetItemName();
+    if (strings.size() > std::numeric_limits<uint32_t>::max()) {
+      return std::nullopt;
+    }
+
+    uint32_t index = base::checked_cast<uint32_t>(nodes.size());
+    if (node.type == TYPE_FILE) {
+      const auto* file = static_cast<const CodegateFileImpl*>(item);
+      node.data_offset = data_size;
+      node.data_size = file->storage().size();
+      data_size += node.data_size;
+      files.push_back(file);
+    } else {
+      std::vector<CodegateItem*> children =
+          static_cast<CodegateDirectoryImpl*>(item)->GetChildren();
+      for (auto it = children.rbegin(); it != children.rend(); ++it) {
+        stack.emplace_back(*it, index);
+      }
+    }
+    nodes.push_back(node);
+  }
+
+  uint64_t image_size = kHeaderSize + uint64_t{nodes.size()} * kNodeSize +
+                        strings.size() + data_size;
+  if (!base::IsValueInRangeForNumericType<size_t>(image_size)) {
+    return std::nullopt;
+  }
+
+  mojo_base::BigBuffer image(static_cast<size_t>(image_size));
+  base::SpanWriter<uint8_t> writer{base::span<uint8_t>(image)};
+  writer.WriteU32LittleEndian(kImageMagic);
+  writer.WriteU32LittleEndian(kImageVersion);
+  writer.WriteU32LittleEndian(base::checked_cast<uint32_t>(nodes.size()));
+  writer.WriteU32LittleEndian(0);
+  writer.WriteU64LittleEndian(strings.size());
+  writer.WriteU64LittleEndian(data_size);
+  for (const ImageNode& node : nodes) {
+    writer.WriteU32LittleEndian(node.parent);
+    writer.WriteU32LittleEndian(node.type);
+    writer.WriteU32LittleEndian(node.name_offset);
+    writer.WriteU32LittleEndian(node.name_size);
+    writer.WriteU64LittleEndian(node.data_offset);
+    writer.WriteU64LittleEndian(node.data_size);
+  }
+  writer.Write(base::as_byte_span(strings));
+
+  // File bodies go straight from the storage into the image.
+  for (const CodegateFileImpl* file : files) {
+    size_t size = static_cast<size_t>(file->storage().size());
+    std::optional<base::span<uint8_t>> dest = writer.Skip(size);
+    CHECK(dest);
+    file->storage().Read(0, *dest);
+  }
+  CHECK_EQ(writer.remaining(), 0u);
+  return image;
+}
+
+bool ImportFileSystemImage(base::span<const uint8_t> image,
+                           CodegateFileSystem* file_system) {
+  CHECK_EQ(file_system->used_items(), 0u);
+  base::SpanReader<const uint8_t> reader(image);
+  uint32_t magic, version, node_count, reserved;
+  uint64_t strings_size, data_size;
+  if (!reader.ReadU32LittleEndian(magic) ||
+      !reader.ReadU32LittleEndian(version) ||
+      !reader.ReadU32LittleEndian(node_count) ||
+      !reader.ReadU32LittleEndian(reserved) ||
+      !reader.ReadU64LittleEndian(strings_size) ||
+      !reader.ReadU64LittleEndian(data_size) || magic != kImageMagic ||
+      version != kImageVersion || node_count == 0 ||
+      node_count > reader.remaining() / kNodeSize) {
+    return false;
+  }
+
+  base::span<const uint8_t> node_table = *reader.Read(node_count * kNodeSize);
+  if (strings_size > reader.remaining() ||
+      data_size != reader.remaining() - strings_size) {
+    return false;
+  }
+  base::span<const uint8_t> strings =
+      *reader.Read(static_cast<size_t>(strings_size));
+  base::span<const uint8_t> data = reader.remaining_span();
+
+  base::SpanReader<const uint8_t> node_reader(node_table);
+  ImageNode root_node;
+  ReadNode(node_reader, &root_node);
+  if (root_node.parent != kNoParent || root_node.type != TYPE_DIRECTORY ||
+      root_node.data_size != 0 ||
+      !IsInSection(root_node.name_offset, root_node.name_size,
+                   strings.size())) {
+    return false;
+  }
+  std::string root_name(base::as_string_view(
+      strings.subspan(root_node.name_offset, root_node.name_size)));
+  if (!CodegateDirectoryImpl::IsValidItemName(root_name)) {
+    return false;
+  }
+
+  file_system->root()->SetItemName(root_name);
+  file_system->InvalidatePaths();
+  // Directory created for each node, null for files.
+  std::vector<CodegateDirectoryImpl*> directories(node_count, nullptr);
+  directories[0] = file_system->root();
+
+  for (uint32_t idx = 1; idx < node_count; ++idx) {
+    ImageNode node;
+    ReadNode(node_reader, &node);
+    if (node.parent >= idx || !directories[node.parent] ||
+        !IsInSection(node.name_offset, node.name_size, strings.size())) {
+      return false;
+    }
+
+    std::string name(base::as_string_view(
+        strings.subspan(node.name_offset, node.name_size)));
+    if (node.type == TYPE_DIRECTORY) {
+      if (node.data_size != 0) {
+        return false;
+      }
+      CodegateItem* directory =
+          directories[node.parent]->CreateChild(name, TYPE_DIRECTORY);
+      if (!directory) {
+        return false;
+      }
+      directories[idx] = static_cast<CodegateDirectoryImpl*>(directory);
+    } else if (node.type == TYPE_FILE) {
+      if (!IsInSection(node.data_offset, node.data_size, data.size())) {
+        return false;
+      }
+      auto* file = static_cast<CodegateFileImpl*>(
+          directories[node.parent]->CreateChild(name, TYPE_FILE));
+      if (!file ||
+          (node.data_size > 0 &&
+           !file->LoadContent(data.subspan(
+               static_cast<size_t>(node.data_offset),
+               static_cast<size_t>(node.data_size))))) {
+        return false;
+      }
+    } else {
+      return false;
+    }
+  }
+
+  // Nothing above went through the journal.
+  file_system->Checkpoint();
+  return true;
+}
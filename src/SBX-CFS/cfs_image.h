@@ -0,0 +1,40 @@
+#ifndef CONTENT_BROWSER_CFS_CFS_IMAGE_H_
+#define CONTENT_BROWSER_CFS_CFS_IMAGE_H_
+
+// library
+#include <cstdint>
+#include <optional>
+
+// base
+#include "base/containers/span.h"
+
+// mojo dependency
+#include "mojo/public/cpp/base/big_buffer.h"
+
+class CodegateFileSystem;
+
+// Filesystem images, as produced by CodegateFSManager::ExportFileSystem.
+//
+// An image is four sections back to back, all integers little endian:
+//   header   magic "CFSI", version, node count, 0 (u32 each), then the
+//            string and data section sizes (u64 each)
+//   nodes    one fixed-size entry per item in preorder, root first:
+//            parent index, type, name offset, name size (u32 each), then
+//            data offset and data size (u64 each)
+//   strings  every item name, unterminated
+//   data     every file body, back to back
+// A parent always precedes its children, and children follow their parent
+// in listing order, so one forward pass rebuilds the tree.
+
+// Returns nullopt if the image would not fit in memory.
+std::optional<mojo_base::BigBuffer> ExportFileSystemImage(
+    const CodegateFileSystem& file_system);
+
+// Builds the tree of |image| in |file_system|, which must be empty, renaming
+// its root as the image says. Returns false if the image is malformed or does
+// not fit the filesystem's quotas; the filesystem is then left half built and
+// should be discarded.
+bool ImportFileSystemImage(base::span<const uint8_t> image,
+                           CodegateFileSystem* file_system);
+
+#endif  // CONTENT_BROWSER_CFS_CFS_IMAGE_H_
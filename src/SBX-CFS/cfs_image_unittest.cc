@@ -0,0 +1,233 @@
+// content/browser/CFS/cfs_image_unittest.cc
+
+// content
+#include "content/browser/CFS/cfs_image.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "content/browser/CFS/cfs_directory_impl.h"
+#include "content/browser/CFS/cfs_file_impl.h"
+#include "content/browser/CFS/cfs_file_system.h"
+#include "content/browser/CFS/cfs_storage.h"
+
+// base
+#include "base/containers/span.h"
+#include "base/files/file_path.h"
+#include "base/test/task_environment.h"
+
+// mojo dependency
+#include "mojo/public/cpp/base/big_buffer.h"
+
+// test
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace {
+
+constexpr uint32_t kImageMagic = 0x49534643;  // "CFSI"
+constexpr uint32_t kNoParent = 0xFFFFFFFF;
+
+struct TestNode {
+  uint32_t parent;
+  uint32_t type;
+  uint32_t name_offset;
+  uint32_t name_size;
+  uint64_t data_offset;
+  uint64_t data_size;
+};
+
+// Lays out an image by hand, so that tests can break one field at a time.
+class ImageBuilder {
+ public:
+  ImageBuilder(std::string strings, std::string data)
+      : strings_(std::move(strings)), data_(std::move(data)) {}
+
+  ImageBuilder& Add(const TestNode& node) {
+    nodes_.push_back(node);
+    return *this;
+  }
+
+  std::vector<uint8_t> Build(uint32_t magic = kImageMagic) const {
+    std::vector<uint8_t> image;
+    AppendU32(image, magic);
+    AppendU32(image, 1);
+    AppendU32(image, static_cast<uint32_t>(nodes_.size()));
+    AppendU32(image, 0);
+    AppendU64(image, strings_.size());
+    AppendU64(image, data_.size());
+    for (const TestNode& node : nodes_) {
+      AppendU32(image, node.parent);
+      AppendU32(image, node.type);
+      AppendU32(image, node.name_offset);
+      AppendU32(image, node.name_size);
+      AppendU64(image, node.data_offset);
+      AppendU64(image, node.data_size);
+    }
+    image.insert(image.end(), strings_.begin(), strings_.end());
+    image.insert(image.end(), data_.begin(), data_.end());
+    return image;
+  }
+
+ private:
+  static void AppendU32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+      out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+  }
+  static void AppendU64(std::vector<uint8_t>& out, uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+      out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+  }
+
+  std::vector<TestNode> nodes_;
+  std::string strings_;
+  std::string data_;
+};
+
+// "root" with a directory "d" holding the file "f" = "hello".
+ImageBuilder ValidImage() {
+  ImageBuilder builder("rootdf", "hello");
+  builder.Add({kNoParent, TYPE_DIRECTORY, 0, 4, 0, 0})
+      .Add({0, TYPE_DIRECTORY, 4, 1, 0, 0})
+      .Add({1, TYPE_FILE, 5, 1, 0, 5});
+  return builder;
+}
+
+std::string ReadBody(const CodegateFileImpl* file) {
+  std::string body(static_cast<size_t>(file->storage().size()), '\0');
+  file->storage().Read(0, base::as_writable_byte_span(body));
+  return body;
+}
+
+class CodegateImageTest : public testing::Test {
+ protected:
+  bool Import(const std::vector<uint8_t>& image) {
+    return ImportFileSystemImage(image, &file_system_);
+  }
+
+  base::test::TaskEnvironment task_environment_;
+  CodegateFileSystem file_system_{"empty", base::FilePath(), nullptr, nullptr};
+};
+
+TEST_F(CodegateImageTest, ImportsValidImage) {
+  ASSERT_TRUE(Import(ValidImage().Build()));
+
+  EXPECT_EQ(file_system_.root()->GetItemName(), "root");
+  EXPECT_EQ(file_system_.used_items(), 2u);
+  EXPECT_EQ(file_system_.used_bytes(), 5u);
+  std::vector<CodegateItem*> children = file_system_.root()->GetChildren();
+  ASSERT_EQ(children.size(), 1u);
+  EXPECT_EQ(children[0]->GetItemName(), "d");
+  std::vector<CodegateItem*> grandchildren =
+      static_cast<CodegateDirectoryImpl*>(children[0])->GetChildren();
+  ASSERT_EQ(grandchildren.size(), 1u);
+  ASSERT_EQ(grandchildren[0]->GetItemType(), TYPE_FILE);
+  EXPECT_EQ(ReadBody(static_cast<CodegateFileImpl*>(grandchildren[0])),
+            "hello");
+}
+
+TEST_F(CodegateImageTest, RoundTripsExport) {
+  CodegateFileSystem source("src", base::FilePath(), nullptr, nullptr);
+  auto* dir = static_cast<CodegateDirectoryImpl*>(
+      source.root()->CreateChild("a", TYPE_DIRECTORY));
+  ASSERT_TRUE(dir);
+  auto* file = static_cast<CodegateFileImpl*>(dir->CreateChild("x", TYPE_FILE));
+  ASSERT_TRUE(file);
+  ASSERT_TRUE(file->LoadContent(base::as_byte_span(std::string("abc"))));
+  ASSERT_TRUE(source.root()->CreateChild("b", TYPE_FILE));
+
+  std::optional<mojo_base::BigBuffer> image = ExportFileSystemImage(source);
+  ASSERT_TRUE(image);
+  ASSERT_TRUE(ImportFileSystemImage(*image, &file_system_));
+
+  EXPECT_EQ(file_system_.root()->GetItemName(), "src");
+  EXPECT_EQ(file_system_.used_items(), source.used_items());
+  EXPECT_EQ(file_system_.used_bytes(), source.used_bytes());
+  std::vector<CodegateItem*> children = file_system_.root()->GetChildren();
+  ASSERT_EQ(children.size(), 2u);
+  EXPECT_EQ(children[0]->GetItemName(), "a");
+  EXPECT_EQ(children[1]->GetItemName(), "b");
+}
+
+TEST_F(CodegateImageTest, RejectsTruncatedImage) {
+  std::vector<uint8_t> image = ValidImage().Build();
+  for (size_t size : {size_t{0}, size_t{31}, size_t{40}, image.size() - 1}) {
+    CodegateFileSystem file_system("empty", base::FilePath(), nullptr,
+                                   nullptr);
+    EXPECT_FALSE(ImportFileSystemImage(base::span(image).first(size),
+                                       &file_system))
+        << size;
+  }
+}
+
+TEST_F(CodegateImageTest, RejectsBadMagic) {
+  EXPECT_FALSE(Import(ValidImage().Build(0x12345678)));
+}
+
+TEST_F(CodegateImageTest, RejectsParentAfterChild) {
+  ImageBuilder builder("rootdf", "");
+  builder.Add({kNoParent, TYPE_DIRECTORY, 0, 4, 0, 0})
+      .Add({2, TYPE_DIRECTORY, 4, 1, 0, 0})
+      .Add({0, TYPE_DIRECTORY, 5, 1, 0, 0});
+  EXPECT_FALSE(Import(builder.Build()));
+}
+
+TEST_F(CodegateImageTest, RejectsSelfParent) {
+  ImageBuilder builder("rootd", "");
+  builder.Add({kNoParent, TYPE_DIRECTORY, 0, 4, 0, 0})
+      .Add({1, TYPE_DIRECTORY, 4, 1, 0, 0});
+  EXPECT_FALSE(Import(builder.Build()));
+}
+
+TEST_F(CodegateImageTest, RejectsFileAsParent) {
+  ImageBuilder builder("rootfg", "");
+  builder.Add({kNoParent, TYPE_DIRECTORY, 0, 4, 0, 0})
+      .Add({0, TYPE_FILE, 4, 1, 0, 0})
+      .Add({1, TYPE_FILE, 5, 1, 0, 0});
+  EXPECT_FALSE(Import(builder.Build()));
+}
+
+TEST_F(CodegateImageTest, RejectsNameOutsideStrings) {
+  ImageBuilder builder("rootd", "");
+  builder.Add({kNoParent, TYPE_DIRECTORY, 0, 4, 0, 0})
+      .Add({0, TYPE_DIRECTORY, 4, 2, 0, 0});
+  EXPECT_FALSE(Import(builder.Build()));
+
+  ImageBuilder overflow("rootd", "");
+  overflow.Add({kNoParent, TYPE_DIRECTORY, 0, 4, 0, 0})
+      .Add({0, TYPE_DIRECTORY, 0xFFFFFFFF, 2, 0, 0});
+  CodegateFileSystem file_system("empty", base::FilePath(), nullptr, nullptr);
+  EXPECT_FALSE(ImportFileSystemImage(overflow.Build(), &file_system));
+}
+
+TEST_F(CodegateImageTest, RejectsDataOutsideSection) {
+  ImageBuilder builder("rootf", "hello");
+  builder.Add({kNoParent, TYPE_DIRECTORY, 0, 4, 0, 0})
+      .Add({0, TYPE_FILE, 4, 1, 3, 5});
+  EXPECT_FALSE(Import(builder.Build()));
+
+  ImageBuilder overflow("rootf", "hello");
+  overflow.Add({kNoParent, TYPE_DIRECTORY, 0, 4, 0, 0})
+      .Add({0, TYPE_FILE, 4, 1, 1, 0xFFFFFFFFFFFFFFFF});
+  CodegateFileSystem file_system("empty", base::FilePath(), nullptr, nullptr);
+  EXPECT_FALSE(ImportFileSystemImage(overflow.Build(), &file_system));
+}
+
+TEST_F(CodegateImageTest, RejectsDataOnDirectory) {
+  ImageBuilder builder("rootd", "hello");
+  builder.Add({kNoParent, TYPE_DIRECTORY, 0, 4, 0, 0})
+      .Add({0, TYPE_DIRECTORY, 4, 1, 0, 5});
+  EXPECT_FALSE(Import(builder.Build()));
+}
+
+TEST_F(CodegateImageTest, RejectsRootWithParent) {
+  ImageBuilder builder("root", "");
+  builder.Add({0, TYPE_DIRECTORY, 0, 4, 0, 0});
+  EXPECT_FALSE(Import(builder.Build()));
+}
+
+}  // namespace
@@ -10,6 +10,7 @@
 #include "mojo/public/cpp/bindings/receiver_set.h"
 
 class CodegateDirectoryImpl;
+class CodegateFileSystem;
 
 class CodegateItem {
  public:
@@ -20,13 +21,22 @@ class CodegateItem {
   CodegateDirectoryImpl* GetParentDir() const { return parents_dir_.get(); }
   void SetParentDir(CodegateDirectoryImpl* t) { parents_dir_ = t; }
 
-  std::string GetItemName() const { return itemname_; }
-  void SetItemName(std::string newname) { itemname_ = newname; }
+  CodegateFileSystem* GetFileSystem() const { return file_system_.get(); }
+  void SetFileSystem(CodegateFileSystem* fs) { file_system_ = fs; }
+
+  const std::string& GetItemName() const { return itemname_; }
+  void SetItemName(std::string newname) { itemname_ = std::move(newname); }
   int GetItemType() const { return itemtype_; }
 
+  // Bumped on every change to a file's bytes or a directory's entries.
+  uint64_t GetModCount() const { return mod_count_; }
+  void MarkModified() { ++mod_count_; }
+
  private:
   int itemtype_;
   std::string itemname_;
   raw_ptr<CodegateDirectoryImpl> parents_dir_;
+  raw_ptr<CodegateFileSystem> file_system_ = nullptr;
+  uint64_t mod_count_ = 0;
 };
 #endif  // CONTENT_BROWSER_CFS_CFS_ITEM_H
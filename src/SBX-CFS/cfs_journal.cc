@@ -0,0 +1,307 @@
+// content/browser/CFS/cfs_journal.cc
+
+// content
+#include "content/browser/CFS/cfs_journal.h"
+
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+// base
+#include "base/files/file_util.h"
+#include "base/functional/bind.h"
+#include "base/hash/hash.h"
+#include "base/logging.h"
+#include "base/memory/ptr_util.h"
+#include "base/numerics/byte_conversions.h"
+#include "base/numerics/safe_conversions.h"
+#include "base/pickle.h"
+#include "base/task/sequenced_task_runner.h"
+
+namespace {
+
+// Frame header: payload length, then the payload's hash.
+constexpr size_t kFrameHeaderSize = 8;
+// The log is never checkpointed below this size.
+constexpr uint64_t kCheckpointMinBytes = 4 * 1024 * 1024;
+// Checkpoints write in pieces of about this size.
+constexpr size_t kCheckpointWriteSize = 64 * 1024;
+
+}  // namespace
+
+CodegateJournalRecord::CodegateJournalRecord() = default;
+
+CodegateJournalRecord::CodegateJournalRecord(Op op, std::string path)
+    : op(op), path(std::move(path)) {}
+
+CodegateJournalRecord::~CodegateJournalRecord() = default;
+
+CodegateJournalRecord::CodegateJournalRecord(CodegateJournalRecord&&) =
+    default;
+CodegateJournalRecord& CodegateJournalRecord::operator=(
+    CodegateJournalRecord&&) = default;
+
+CodegateJournal::Checkpoint::Checkpoint(CodegateJournal* journal,
+                                        const base::FilePath& path,
+                                        base::File file)
+    : journal_(journal), path_(path), file_(std::move(file)) {}
+
+CodegateJournal::Checkpoint::~Checkpoint() {
+  if (!finished_) {
+    file_.Close();
+    base::DeleteFile(path_);
+  }
+}
+
+void CodegateJournal::Checkpoint::Add(const CodegateJournalRecord& record) {
+  AppendFrame(record, record.data, &buffer_);
+  if (buffer_.size() >= kCheckpointWriteSize) {
+    WriteBuffered();
+  }
+}
+
+bool CodegateJournal::Checkpoint::Finish() {
+  WriteBuffered();
+  if (failed_ || !file_.Flush()) {
+    return false;
+  }
+  file_.Close();
+
+  if (!base::ReplaceFile(path_, journal_->path_, nullptr)) {
+    return false;
+  }
+  finished_ = true;
+  journal_->OnCheckpointFinished(
+      base::File(journal_->path_, base::File::FLAG_OPEN |
+                                      base::File::FLAG_READ |
+                                      base::File::FLAG_WRITE),
+      size_);
+  return true;
+}
+
+void CodegateJournal::Checkpoint::WriteBuffered() {
+  if (!failed_ && !buffer_.empty()) {
+    std::optional<size_t> written =
+        file_.Write(base::checked_cast<int64_t>(size_), buffer_);
+    failed_ = written != buffer_.size();
+    size_ += buffer_.size();
+  }
+  buffer_.clear();
+}
+
+// static
+std::unique_ptr<CodegateJournal> CodegateJournal::Open(
+    const base::FilePath& path,
+    base::FunctionRef<void(const CodegateJournalRecord&)> replay) {
+  base::File file(path, base::File::FLAG_OPEN_ALWAYS | base::File::FLAG_READ |
+                            base::File::FLAG_WRITE);
+  int64_t length = file.IsValid() ? file.GetLength() : -1;
+  if (length < 0) {
+    return nullptr;
+  }
+
+  uint64_t log_size = static_cast<uint64_t>(length);
+  uint64_t valid_size = 0;
+  std::vector<uint8_t> payload;
+  CodegateJournalRecord record;
+  while (log_size - valid_size >= kFrameHeaderSize) {
+    std::array<uint8_t, kFrameHeaderSize> header;
+    if (file.Read(base::checked_cast<int64_t>(valid_size), header) !=
+        header.size()) {
+      break;
+    }
+    uint32_t frame_length =
+        base::U32FromLittleEndian(base::span(header).first<4>());
+    uint32_t hash = base::U32FromLittleEndian(base::span(header).last<4>());
+    if (log_size - valid_size - kFrameHeaderSize < frame_length) {
+      break;
+    }
+
+    payload.resize(frame_length);
+    if (file.Read(base::checked_cast<int64_t>(valid_size + kFrameHeaderSize),
+                  payload) != payload.size() ||
+        base::PersistentHash(payload) != hash ||
+        !ParseRecord(payload, &record)) {
+      break;
+    }
+    replay(record);
+    valid_size += kFrameHeaderSize + frame_length;
+  }
+
+  if (valid_size < log_size) {
+    LOG(ERROR) << "Dropping torn CFS journal tail: " << path;
+    if (!file.SetLength(base::checked_cast<int64_t>(valid_size))) {
+      return nullptr;
+    }
+  }
+  return base::WrapUnique(
+      new CodegateJournal(path, std::move(file), valid_size));
+}
+
+CodegateJournal::CodegateJournal(const base::FilePath& path,
+                                 base::File file,
+                                 uint64_t size)
+    : path_(path),
+      file_(std::move(file)),
+      size_(size),
+      // A long log left by the last session gets compacted soon.
+      checkpoint_size_(0) {}
+
+CodegateJournal::~CodegateJournal() {
+  // The owner is going away, so a failure now is only logged.
+  failure_callback_.Reset();
+  Commit();
+}
+
+void CodegateJournal::Append(const CodegateJournalRecord& record) {
+  Append(record, record.data);
+}
+
+void CodegateJournal::Append(const CodegateJournalRecord& record,
+                             base::span<const uint8_t> data) {
+  if (failed_) {
+    return;
+  }
+  AppendFrame(record, data, &pending_);
+  if (!commit_scheduled_) {
+    commit_scheduled_ = true;
+    base::SequencedTaskRunner::GetCurrentDefault()->PostTask(
+        FROM_HERE, base::BindOnce(&CodegateJournal::Commit,
+                                  weak_factory_.GetWeakPtr()));
+  }
+}
+
+void CodegateJournal::Commit() {
+  commit_scheduled_ = false;
+  if (!pending_.empty()) {
+    std::optional<size_t> written;
+    if (file_.IsValid()) {
+      written = file_.Write(base::checked_cast<int64_t>(size_), pending_);
+    }
+    if (written == pending_.size() && file_.Flush()) {
+      size_ += pending_.size();
+    } else {
+      // Cut off whatever part made it, so that the log ends on a frame.
+      LOG(ERROR) << "Failed to commit CFS journal: " << path_;
+      if (file_.IsValid()) {
+        file_.SetLength(base::checked_cast<int64_t>(size_));
+      }
+      failed_ = true;
+      if (failure_callback_) {
+        std::move(failure_callback_).Run();
+      }
+    }
+    pending_.clear();
+  }
+
+  // Posted rather than run here, since Commit also runs while a checkpoint
+  // is being opened and from the destructor.
+  if (!failed_ && checkpoint_callback_ && !checkpoint_requested_ &&
+      NeedsCheckpoint()) {
+    checkpoint_requested_ = true;
+    base::SequencedTaskRunner::GetCurrentDefault()->PostTask(
+        FROM_HERE, base::BindOnce(&CodegateJournal::RunCheckpointCallback,
+                                  weak_factory_.GetWeakPtr()));
+  }
+
+  // A waiter may append and wait again; that goes into the next commit.
+  std::vector<base::OnceCallback<void(bool)>> waiters =
+      std::move(commit_waiters_);
+  commit_waiters_.clear();
+  for (auto& waiter : waiters) {
+    std::move(waiter).Run(!failed_);
+  }
+}
+
+void CodegateJournal::RunWhenCommitted(
+    base::OnceCallback<void(bool)> callback) {
+  if (failed_ || pending_.empty()) {
+    std::move(callback).Run(!failed_);
+    return;
+  }
+  commit_waiters_.push_back(std::move(callback));
+}
+
+void CodegateJournal::SetCheckpointCallback(base::RepeatingClosure callback) {
+  checkpoint_callback_ = std::move(callback);
+}
+
+void CodegateJournal::SetFailureCallback(base::OnceClosure callback) {
+  failure_callback_ = std::move(callback);
+}
+
+bool CodegateJournal::NeedsCheckpoint() const {
+  return size_ > std::max(kCheckpointMinBytes, 2 * checkpoint_size_);
+}
+
+std::unique_ptr<CodegateJournal::Checkpoint>
+CodegateJournal::BeginCheckpoint() {
+  Commit();
+  if (failed_) {
+    return nullptr;
+  }
+
+  base::FilePath path = path_.AddExtensionASCII("tmp");
+  base::File file(path,
+                  base::File::FLAG_CREATE_ALWAYS | base::File::FLAG_WRITE);
+  if (!file.IsValid()) {
+    return nullptr;
+  }
+  return base::WrapUnique(new Checkpoint(this, path, std::move(file)));
+}
+
+// static
+void CodegateJournal::AppendFrame(const CodegateJournalRecord& record,
+                                  base::span<const uint8_t> data,
+                                  std::vector<uint8_t>* out) {
+  base::Pickle pickle;
+  pickle.WriteInt(static_cast<int>(record.op));
+  pickle.WriteString(record.path);
+  pickle.WriteString(record.target);
+  pickle.WriteUInt64(record.offset);
+  pickle.WriteUInt64(record.items);
+  pickle.WriteString(base::as_string_view(data));
+
+  base::span<const uint8_t> payload = pickle.AsBytes();
+  auto length = base::U32ToLittleEndian(
+      base::checked_cast<uint32_t>(payload.size()));
+  auto hash = base::U32ToLittleEndian(base::PersistentHash(payload));
+  out->insert(out->end(), length.begin(), length.end());
+  out->insert(out->end(), hash.begin(), hash.end());
+  out->insert(out->end(), payload.begin(), payload.end());
+}
+
+// static
+bool CodegateJournal::ParseRecord(base::span<const uint8_t> payload,
+                                  CodegateJournalRecord* record) {
+  base::Pickle pickle = base::Pickle::WithUnownedBuffer(payload);
+  base::PickleIterator iter(pickle);
+  int op;
+  std::string_view data;
+  if (!iter.ReadInt(&op) || op < 0 ||
+      op > static_cast<int>(CodegateJournalRecord::Op::kAdoptFile) ||
+      !iter.ReadString(&record->path) || !iter.ReadString(&record->target) ||
+      !iter.ReadUInt64(&record->offset) || !iter.ReadUInt64(&record->items) ||
+      !iter.ReadStringPiece(&data)) {
+    return false;
+  }
+  record->op = static_cast<CodegateJournalRecord::Op>(op);
+  record->data.assign(data.begin(), data.end());
+  return true;
+}
+
+void CodegateJournal::RunCheckpointCallback() {
+  checkpoint_requested_ = false;
+  checkpoint_callback_.Run();
+}
+
+void CodegateJournal::OnCheckpointFinished(base::File file, uint64_t size) {
+  file_ = std::move(file);
+  size_ = size;
+  checkpoint_size_ = size;
+  if (!file_.IsValid()) {
+    LOG(ERROR) << "Failed to reopen CFS journal: " << path_;
+  }
+}
@@ -0,0 +1,202 @@
+#ifndef CONTENT_BROWSER_CFS_CFS_JOURNAL_H_
+#define CONTENT_BROWSER_CFS_CFS_JOURNAL_H_
+
+// library
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// base
+#include "base/containers/span.h"
+#include "base/files/file.h"
+#include "base/files/file_path.h"
+#include "base/functional/bind.h"
+#include "base/functional/callback.h"
+#include "base/functional/function_ref.h"
+#include "base/memory/raw_ptr.h"
+#include "base/memory/weak_ptr.h"
+
+// One mutation of a filesystem as it is logged and replayed. Paths are
+// absolute ("/root/a/b"), so a record replays the same from any directory.
+struct CodegateJournalRecord {
+  enum class Op : uint8_t {
+    kCreateFile = 0,
+    kCreateDir = 1,
+    kDelete = 2,
+    kRename = 3,
+    kMove = 4,
+    kAssign = 5,
+    kWriteAt = 6,
+    kTruncate = 7,
+    kSetQuota = 8,
+    kCopy = 9,
+    // A file on a body that is durable already, as written by checkpoints.
+    kAdoptFile = 10,
+  };
+
+  CodegateJournalRecord();
+  CodegateJournalRecord(Op op, std::string path);
+  ~CodegateJournalRecord();
+
+  CodegateJournalRecord(CodegateJournalRecord&&);
+  CodegateJournalRecord& operator=(CodegateJournalRecord&&);
+
+  Op op = Op::kCreateFile;
+  std::string path;
+  // kRename: new name, kMove: destination directory, kCopy: destination
+  std::string target;
+  uint64_t offset = 0;  // kWriteAt: offset, kTruncate: size, kSetQuota: bytes
+  uint64_t items = 0;  // kCreateFile, kAdoptFile: body id, kSetQuota
+  // kAssign, kWriteAt; kCopy: body ids of the copied files
+  std::vector<uint8_t> data;
+};
+
+// Append-only write-ahead log of one filesystem.
+//
+// Records appended during one task are buffered and written with a single
+// write and a single sync in a task posted behind them, so a burst of small
+// mutations costs one sync per turn rather than one per mutation. Each record
+// is framed with its length and a hash; replay stops at the first frame that
+// is incomplete or does not match, which is where a crash cut the log.
+// Replies to the mutations are held until their records are synced, so a
+// client is never told of a change a crash could still lose. A failed write
+// or sync is fatal: the log no longer follows the state the mutations left,
+// so the owner is told, the held replies are dropped rather than sent, and
+// nothing more is logged.
+//
+// The log grows until Checkpoint replaces it with the records that rebuild
+// the current state. The owner is told as soon as a commit leaves the log
+// large enough for that.
+class CodegateJournal {
+ public:
+  // Rewrites the log into a temporary file and swaps it in on Finish. The
+  // journal must not be appended to while a checkpoint is open.
+  class Checkpoint {
+   public:
+    ~Checkpoint();
+
+    Checkpoint(const Checkpoint&) = delete;
+    Checkpoint& operator=(const Checkpoint&) = delete;
+
+    void Add(const CodegateJournalRecord& record);
+    // Syncs the new log and replaces the old one with it. On failure the old
+    // log stays in place.
+    bool Finish();
+
+   private:
+    friend class CodegateJournal;
+    Checkpoint(CodegateJournal* journal,
+               const base::FilePath& path,
+               base::File file);
+    void WriteBuffered();
+
+    raw_ptr<CodegateJournal> journal_;
+    base::FilePath path_;
+    base::File file_;
+    std::vector<uint8_t> buffer_;
+    uint64_t size_ = 0;
+    bool failed_ = false;
+    bool finished_ = false;
+  };
+
+  // Opens the log at |path|, creating it if needed, and passes the records
+  // it already holds to |replay| in order. Frames are read one at a time, so
+  // replay holds no more than one record however long the log is. A torn
+  // tail is cut off. Returns nullptr if the log cannot be opened.
+  static std::unique_ptr<CodegateJournal> Open(
+      const base::FilePath& path,
+      base::FunctionRef<void(const CodegateJournalRecord&)> replay);
+  ~CodegateJournal();
+
+  CodegateJournal(const CodegateJournal&) = delete;
+  CodegateJournal& operator=(const CodegateJournal&) = delete;
+
+  void Append(const CodegateJournalRecord& record);
+  // Append() with |data| logged in place of |record.data|, so a large write
+  // goes into the log without first being copied into a record.
+  void Append(const CodegateJournalRecord& record,
+              base::span<const uint8_t> data);
+  // Writes and syncs everything appended so far, then runs the callbacks
+  // waiting for it. Runs on its own at the end of each turn that appended
+  // something.
+  void Commit();
+  // Runs |callback| once everything appended so far is committed, right
+  // away if nothing is pending. It gets false if the journal failed, now or
+  // earlier.
+  void RunWhenCommitted(base::OnceCallback<void(bool)> callback);
+
+  // Wraps the reply |callback| of a mutation so that, once run, the reply
+  // waits for RunWhenCommitted. It is dropped if the commit fails, which the
+  // failure callback must make safe by closing the mutation's receiver. A
+  // null |journal| returns |callback| as is.
+  template <typename... Args>
+  static base::OnceCallback<void(Args...)> HoldReply(
+      CodegateJournal* journal,
+      base::OnceCallback<void(Args...)> callback) {
+    if (!journal) {
+      return callback;
+    }
+    return base::BindOnce(
+        [](base::WeakPtr<CodegateJournal> journal,
+           base::OnceCallback<void(Args...)> callback, Args... args) {
+          base::OnceClosure reply =
+              base::BindOnce(std::move(callback), std::move(args)...);
+          if (!journal) {
+            std::move(reply).Run();
+            return;
+          }
+          journal->RunWhenCommitted(base::BindOnce(
+              [](base::OnceClosure reply, bool committed) {
+                if (committed) {
+                  std::move(reply).Run();
+                }
+              },
+              std::move(reply)));
+        },
+        journal->weak_factory_.GetWeakPtr(), std::move(callback));
+  }
+
+  // |callback| runs, in a task of its own, whenever a commit leaves the log
+  // in need of a checkpoint. It is not run again until a checkpoint was
+  // taken or tried.
+  void SetCheckpointCallback(base::RepeatingClosure callback);
+  // |callback| runs once, when a write or sync first fails, before anything
+  // waiting for that commit is told. Not run from the destructor.
+  void SetFailureCallback(base::OnceClosure callback);
+  bool failed() const { return failed_; }
+
+  // True once the log has grown well past what the last checkpoint wrote.
+  bool NeedsCheckpoint() const;
+  // Commits pending records and opens a checkpoint. Returns nullptr if the
+  // temporary file cannot be created or the journal failed.
+  std::unique_ptr<Checkpoint> BeginCheckpoint();
+
+ private:
+  CodegateJournal(const base::FilePath& path, base::File file, uint64_t size);
+
+  static void AppendFrame(const CodegateJournalRecord& record,
+                          base::span<const uint8_t> data,
+                          std::vector<uint8_t>* out);
+  // Parses the payload of one frame into |record|, whose buffers are reused.
+  static bool ParseRecord(base::span<const uint8_t> payload,
+                          CodegateJournalRecord* record);
+  void OnCheckpointFinished(base::File file, uint64_t size);
+  void RunCheckpointCallback();
+
+  base::FilePath path_;
+  base::File file_;
+  uint64_t size_;
+  uint64_t checkpoint_size_;
+  std::vector<uint8_t> pending_;
+  bool commit_scheduled_ = false;
+  std::vector<base::OnceCallback<void(bool)>> commit_waiters_;
+  base::RepeatingClosure checkpoint_callback_;
+  bool checkpoint_requested_ = false;
+  base::OnceClosure failure_callback_;
+  bool failed_ = false;
+  base::WeakPtrFactory<CodegateJournal> weak_factory_{this};
+};
+
+#endif  // CONTENT_BROWSER_CFS_CFS_JOURNAL_H_
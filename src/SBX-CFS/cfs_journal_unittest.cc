@@ -0,0 +1,177 @@
+// content/browser/CFS/cfs_journal_unittest.cc
+
+// content
+#include "content/browser/CFS/cfs_journal.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// base
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/functional/bind.h"
+#include "base/test/task_environment.h"
+
+// test
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace {
+
+using Op = CodegateJournalRecord::Op;
+
+CodegateJournalRecord MakeRecord(Op op,
+                                 std::string path,
+                                 std::vector<uint8_t> data = {}) {
+  CodegateJournalRecord record(op, std::move(path));
+  record.data = std::move(data);
+  return record;
+}
+
+class CodegateJournalTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    path_ = temp_dir_.GetPath().AppendASCII("journal");
+  }
+
+  // Collects the replayed records in |records|.
+  std::unique_ptr<CodegateJournal> Open(
+      std::vector<CodegateJournalRecord>* records) {
+    return CodegateJournal::Open(
+        path_, [records](const CodegateJournalRecord& record) {
+          CodegateJournalRecord copy(record.op, record.path);
+          copy.target = record.target;
+          copy.offset = record.offset;
+          copy.items = record.items;
+          copy.data = record.data;
+          records->push_back(std::move(copy));
+        });
+  }
+
+  // Writes three records and closes the log again.
+  void WriteThreeRecords() {
+    std::vector<CodegateJournalRecord> records;
+    std::unique_ptr<CodegateJournal> journal = Open(&records);
+    ASSERT_TRUE(journal);
+    ASSERT_TRUE(records.empty());
+    journal->Append(MakeRecord(Op::kCreateDir, "/root/a"));
+    journal->Append(MakeRecord(Op::kCreateFile, "/root/a/f"));
+    journal->Append(MakeRecord(Op::kAssign, "/root/a/f", {1, 2, 3}));
+  }
+
+  int64_t GetLogSize() {
+    std::optional<int64_t> size = base::GetFileSize(path_);
+    return size.value_or(-1);
+  }
+
+  base::test::TaskEnvironment task_environment_;
+  base::ScopedTempDir temp_dir_;
+  base::FilePath path_;
+};
+
+TEST_F(CodegateJournalTest, ReplaysCommittedRecords) {
+  WriteThreeRecords();
+
+  std::vector<CodegateJournalRecord> records;
+  ASSERT_TRUE(Open(&records));
+  ASSERT_EQ(records.size(), 3u);
+  EXPECT_EQ(records[0].op, Op::kCreateDir);
+  EXPECT_EQ(records[0].path, "/root/a");
+  EXPECT_EQ(records[1].op, Op::kCreateFile);
+  EXPECT_EQ(records[2].op, Op::kAssign);
+  EXPECT_EQ(records[2].path, "/root/a/f");
+  EXPECT_EQ(records[2].data, std::vector<uint8_t>({1, 2, 3}));
+}
+
+TEST_F(CodegateJournalTest, CutsTornTail) {
+  WriteThreeRecords();
+  int64_t full_size = GetLogSize();
+  ASSERT_GT(full_size, 0);
+
+  // A crash in the middle of the last frame.
+  const uint8_t kPartialFrame[] = {0x20, 0x00, 0x00, 0x00, 0x01};
+  ASSERT_TRUE(base::AppendToFile(path_, kPartialFrame));
+  std::vector<CodegateJournalRecord> records;
+  ASSERT_TRUE(Open(&records));
+  EXPECT_EQ(records.size(), 3u);
+  EXPECT_EQ(GetLogSize(), full_size);
+}
+
+TEST_F(CodegateJournalTest, StopsAtCorruptFrame) {
+  WriteThreeRecords();
+  std::optional<std::vector<uint8_t>> log = base::ReadFileToBytes(path_);
+  ASSERT_TRUE(log);
+  // The last byte belongs to the last frame's payload.
+  log->back() ^= 0xFF;
+  ASSERT_TRUE(base::WriteFile(path_, *log));
+
+  std::vector<CodegateJournalRecord> records;
+  ASSERT_TRUE(Open(&records));
+  ASSERT_EQ(records.size(), 2u);
+  EXPECT_EQ(records[1].op, Op::kCreateFile);
+  EXPECT_LT(GetLogSize(), static_cast<int64_t>(log->size()));
+}
+
+TEST_F(CodegateJournalTest, RunsWaitersAfterCommit) {
+  std::vector<CodegateJournalRecord> records;
+  std::unique_ptr<CodegateJournal> journal = Open(&records);
+  ASSERT_TRUE(journal);
+
+  // Nothing pending, so there is nothing to wait for.
+  bool ran = false;
+  journal->RunWhenCommitted(base::BindOnce(
+      [](bool* ran, bool committed) { *ran = committed; }, &ran));
+  EXPECT_TRUE(ran);
+
+  journal->Append(MakeRecord(Op::kCreateFile, "/root/f"));
+  ran = false;
+  int64_t size_when_run = -1;
+  journal->RunWhenCommitted(base::BindOnce(
+      [](const base::FilePath& path, bool* ran, int64_t* size,
+         bool committed) {
+        *ran = committed;
+        *size = base::GetFileSize(path).value_or(-1);
+      },
+      path_, &ran, &size_when_run));
+  EXPECT_FALSE(ran);
+
+  task_environment_.RunUntilIdle();
+  EXPECT_TRUE(ran);
+  EXPECT_GT(size_when_run, 0);
+}
+
+TEST_F(CodegateJournalTest, CheckpointReplacesLog) {
+  {
+    std::vector<CodegateJournalRecord> records;
+    std::unique_ptr<CodegateJournal> journal = Open(&records);
+    ASSERT_TRUE(journal);
+    for (int i = 0; i < 10; ++i) {
+      journal->Append(MakeRecord(Op::kAssign, "/root/f", {static_cast<uint8_t>(i)}));
+    }
+
+    std::unique_ptr<CodegateJournal::Checkpoint> checkpoint =
+        journal->BeginCheckpoint();
+    ASSERT_TRUE(checkpoint);
+    checkpoint->Add(MakeRecord(Op::kCreateFile, "/root/f"));
+    checkpoint->Add(MakeRecord(Op::kAssign, "/root/f", {9}));
+    ASSERT_TRUE(checkpoint->Finish());
+
+    // Appends go on after the checkpoint.
+    journal->Append(MakeRecord(Op::kTruncate, "/root/f"));
+  }
+
+  std::vector<CodegateJournalRecord> records;
+  ASSERT_TRUE(Open(&records));
+  ASSERT_EQ(records.size(), 3u);
+  EXPECT_EQ(records[0].op, Op::kCreateFile);
+  EXPECT_EQ(records[1].data, std::vector<uint8_t>({9}));
+  EXPECT_EQ(records[2].op, Op::kTruncate);
+  EXPECT_FALSE(base::PathExists(path_.AddExtensionASCII("tmp")));
+}
+
+}  // namespace
@@ -2,27 +2,218 @@
 
 #include "content/browser/CFS/cfs_manager_impl.h"
 
-CodegateFSManagerImpl::CodegateFSManagerImpl() : cnt_(0) {}
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <set>
+#include <utility>
 
-CodegateFSManagerImpl::~CodegateFSManagerImpl() = default;
+// base
+#include "base/files/file_enumerator.h"
+#include "base/files/file_util.h"
+#include "base/functional/bind.h"
+#include "base/functional/callback_helpers.h"
+#include "base/logging.h"
+#include "base/memory/ptr_util.h"
+#include "base/memory/ref_counted.h"
+#include "base/no_destructor.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/synchronization/lock.h"
+#include "base/task/bind_post_task.h"
+#include "base/task/task_traits.h"
+#include "base/task/thread_pool.h"
+#include "base/thread_annotations.h"
+
+namespace {
+
+constexpr uint32_t kSlotIndexBits = 16;
+constexpr uint32_t kSlotIndexMask = (1u << kSlotIndexBits) - 1;
+// The last index is never used: with the last generation it would make id
+// 0xFFFFFFFF, which the renderer's id-keyed hash maps reserve.
+constexpr uint32_t kMaxSlots = (1u << kSlotIndexBits) - 1;
+// A slot whose generation would pass this is retired for good rather than
+// hand out an id it has handed out before.
+constexpr uint32_t kMaxGeneration = (1u << (32 - kSlotIndexBits)) - 1;
+
+uint32_t SlotIndex(uint32_t id) {
+  return id & kSlotIndexMask;
+}
+
+uint32_t SlotGeneration(uint32_t id) {
+  return id >> kSlotIndexBits;
+}
+
+// Storage directories some manager of this process uses. Managers live on
+// different threads, hence the lock.
+struct ClaimedStorageDirs {
+  base::Lock lock;
+  std::set<base::FilePath> paths GUARDED_BY(lock);
+};
+
+ClaimedStorageDirs& GetClaimedStorageDirs() {
+  static base::NoDestructor<ClaimedStorageDirs> claimed;
+  return *claimed;
+}
+
+// Lists the ids of the filesystems an earlier session left in |storage_dir|,
+// one per slot. A slot can show up under two generations when a crash cut
+// off deleting the older filesystem; only the newest is live, and the
+// others are deleted here. They could not come back anyway, since the slot
+// only goes on from the newest generation.
+std::vector<uint32_t> ListStoredFileSystems(const base::FilePath& storage_dir) {
+  std::map<uint32_t, uint32_t> ids_by_slot;
+  base::FileEnumerator enumerator(storage_dir, /*recursive=*/false,
+                                  base::FileEnumerator::DIRECTORIES);
+  for (base::FilePath path = enumerator.Next(); !path.empty();
+       path = enumerator.Next()) {
+    uint32_t id;
+    if (!base::StringToUint(path.BaseName().MaybeAsASCII(), &id) || id == 0 ||
+        SlotIndex(id) >= kMaxSlots) {
+      continue;
+    }
+    auto [it, inserted] = ids_by_slot.emplace(SlotIndex(id), id);
+    if (!inserted) {
+      uint32_t shadowed = std::min(it->second, id);
+      it->second = std::max(it->second, id);
+      if (!base::DeletePathRecursively(
+              storage_dir.AppendASCII(base::NumberToString(shadowed)))) {
+        LOG(ERROR) << "Failed to delete stale CFS filesystem " << shadowed;
+      }
+    }
+  }
+
+  std::vector<uint32_t> ids;
+  ids.reserve(ids_by_slot.size());
+  for (const auto& [index, id] : ids_by_slot) {
+    ids.push_back(id);
+  }
+  return ids;
+}
+
+}  // namespace
+
+// Keeps a storage directory to one manager until the last reference goes.
+class CodegateFSManagerImpl::StorageDirClaim
+    : public base::RefCountedThreadSafe<StorageDirClaim> {
+ public:
+  // Returns nullptr if another manager holds |storage_dir| already.
+  static scoped_refptr<StorageDirClaim> Create(
+      const base::FilePath& storage_dir) {
+    ClaimedStorageDirs& claimed = GetClaimedStorageDirs();
+    base::AutoLock lock(claimed.lock);
+    if (!claimed.paths.insert(storage_dir).second) {
+      return nullptr;
+    }
+    return base::WrapRefCounted(new StorageDirClaim(storage_dir));
+  }
+
+  StorageDirClaim(const StorageDirClaim&) = delete;
+  StorageDirClaim& operator=(const StorageDirClaim&) = delete;
+
+ private:
+  friend class base::RefCountedThreadSafe<StorageDirClaim>;
+
+  explicit StorageDirClaim(const base::FilePath& storage_dir)
+      : storage_dir_(storage_dir) {}
+  ~StorageDirClaim() {
+    ClaimedStorageDirs& claimed = GetClaimedStorageDirs();
+    base::AutoLock lock(claimed.lock);
+    claimed.paths.erase(storage_dir_);
+  }
+
+  const base::FilePath storage_dir_;
+};
+
+CodegateFSManagerImpl::Slot::Slot() = default;
+CodegateFSManagerImpl::Slot::Slot(Slot&&) = default;
+CodegateFSManagerImpl::Slot& CodegateFSManagerImpl::Slot::operator=(Slot&&) =
+    default;
+CodegateFSManagerImpl::Slot::~Slot() = default;
+
+// static
+void CodegateFSManagerImpl::Create(
+    const base::FilePath& storage_dir,
+    mojo::PendingReceiver<blink::mojom::cfs::CodegateFSManager> receiver) {
+  // Two managers on one directory would truncate each other's bodies and
+  // interleave their journals.
+  base::FilePath path = storage_dir.StripTrailingSeparators();
+  scoped_refptr<StorageDirClaim> claim = StorageDirClaim::Create(path);
+  if (!claim) {
+    LOG(ERROR) << "CFS storage directory already in use: " << path;
+    return;
+  }
+
+  // Calls queue up in |receiver| until the listing is back.
+  base::ThreadPool::PostTaskAndReplyWithResult(
+      FROM_HERE, {base::MayBlock(), base::TaskPriority::USER_VISIBLE},
+      base::BindOnce(&ListStoredFileSystems, path),
+      base::BindOnce(
+          [](const base::FilePath& storage_dir,
+             scoped_refptr<StorageDirClaim> claim,
+             mojo::PendingReceiver<blink::mojom::cfs::CodegateFSManager>
+                 receiver,
+             std::vector<uint32_t> stored_ids) {
+            mojo::MakeSelfOwnedReceiver(
+                base::WrapUnique(new CodegateFSManagerImpl(
+                    storage_dir, stored_ids, std::move(claim))),
+                std::move(receiver));
+          },
+          path, std::move(claim), std::move(receiver)));
+}
+
+CodegateFSManagerImpl::CodegateFSManagerImpl() = default;
+
+CodegateFSManagerImpl::CodegateFSManagerImpl(
+    const base::FilePath& storage_dir,
+    const std::vector<uint32_t>& stored_ids,
+    scoped_refptr<StorageDirClaim> claim)
+    : storage_dir_(storage_dir), storage_dir_claim_(std::move(claim)) {
+  // Every filesystem of an earlier session comes back under its old id and
+  // replays its journal on its own sequence. The ids name distinct slots.
+  for (uint32_t id : stored_ids) {
+    AddFileSystem(id);
+  }
+  for (uint32_t index = static_cast<uint32_t>(slots_.size()); index-- > 0;) {
+    if (slots_[index].file_system.is_null()) {
+      free_slots_.push_back(index);
+    }
+  }
+}
+
+CodegateFSManagerImpl::~CodegateFSManagerImpl() {
+  if (!storage_dir_claim_) {
+    return;
+  }
+  for (Slot& slot : slots_) {
+    if (!slot.file_system.is_null()) {
+      slot.file_system.Reset();
+      slot.task_runner->PostTask(
+          FROM_HERE, base::DoNothingWithBoundArgs(storage_dir_claim_));
+    }
+  }
+}
 
 void CodegateFSManagerImpl::CreateFileSystem(
     CreateFileSystemCallback callback) {
-  std::unique_ptr<CodegateDirectoryImpl> root_dir =
-      std::make_unique<CodegateDirectoryImpl>("root");
-  auto remote = root_dir->GenerateConnection();
-  file_system_list_.emplace(++cnt_, std::move(root_dir));
-  std::move(callback).Run(cnt_, std::move(remote));
+  uint32_t id = AllocateId();
+  if (!id) {
+    std::move(callback).Run(
+        0, mojo::PendingRemote<blink::mojom::cfs::CodegateDirectory>());
+    return;
+  }
+  AddFileSystem(id)
+      .AsyncCall(&CodegateFileSystem::ConnectRoot)
+      .Then(base::BindOnce(std::move(callback), id));
 }
 
 void CodegateFSManagerImpl::DeleteFileSystem(
     uint32_t id,
     DeleteFileSystemCallback callback) {
-  if (!file_system_list_[id]) {
+  if (!FindFileSystem(id)) {
     std::move(callback).Run(false);
     return;
   } else {
-    file_system_list_.erase(id);
+    RemoveFileSystem(id);
     std::move(callback).Run(true);
     return;
   }
@@ -31,17 +222,203 @@ void CodegateFSManagerImpl::DeleteFileSystem(
 void CodegateFSManagerImpl::GetFileSystemHandle(
     uint32_t id,
     GetFileSystemHandleCallback callback) {
-  if (!file_system_list_[id]) {
-    std::move(callback).Run(false, mojo::PendingRemote<blink::mojom::cfs::CodegateDirectory>());
+  base::SequenceBound<CodegateFileSystem>* file_system = FindFileSystem(id);
+  if (!file_system) {
+    std::move(callback).Run(
+        false, mojo::PendingRemote<blink::mojom::cfs::CodegateDirectory>());
     return;
   } else {
-    CodegateDirectoryImpl* target = file_system_list_[id].get();
-    auto remote = target->GenerateConnection();
-    std::move(callback).Run(true, std::move(remote));
+    file_system->AsyncCall(&CodegateFileSystem::ConnectRoot)
+        .Then(base::BindOnce(
+            [](GetFileSystemHandleCallback callback,
+               mojo::PendingRemote<blink::mojom::cfs::CodegateDirectory>
+                   remote) {
+              bool success = remote.is_valid();
+              std::move(callback).Run(success, std::move(remote));
+            },
+            std::move(callback)));
     return;
   }
 }
 
 void CodegateFSManagerImpl::GetCode(GetCodeCallback callback) {
-  std::move(callback).Run((uint64_t)(&CodegateFSManagerImpl::Create));
+  void (*create)(
+      mojo::PendingReceiver<blink::mojom::cfs::CodegateFSManager>) =
+      &CodegateFSManagerImpl::Create;
+  std::move(callback).Run((uint64_t)create);
+}
+
+void CodegateFSManagerImpl::GetHandleStats(uint32_t id,
+                                           GetHandleStatsCallback callback) {
+  base::SequenceBound<CodegateFileSystem>* file_system = FindFileSystem(id);
+  if (!file_system) {
+    std::move(callback).Run(nullptr);
+    return;
+  }
+  file_system->AsyncCall(&CodegateFileSystem::GetHandleStats)
+      .Then(std::move(callback));
+}
+
+void CodegateFSManagerImpl::GetUsage(uint32_t id, GetUsageCallback callback) {
+  base::SequenceBound<CodegateFileSystem>* file_system = FindFileSystem(id);
+  if (!file_system) {
+    std::move(callback).Run(nullptr);
+    return;
+  }
+  file_system->AsyncCall(&CodegateFileSystem::GetUsage)
+      .Then(std::move(callback));
+}
+
+void CodegateFSManagerImpl::SetQuota(uint32_t id,
+                                     uint64_t quota_bytes,
+                                     uint64_t quota_items,
+                                     SetQuotaCallback callback) {
+  base::SequenceBound<CodegateFileSystem>* file_system = FindFileSystem(id);
+  if (!file_system) {
+    std::move(callback).Run(false);
+    return;
+  }
+  file_system->AsyncCall(&CodegateFileSystem::SetQuota)
+      .WithArgs(quota_bytes, quota_items);
+  // Queued behind SetQuota, so the reply waits for its journal record and
+  // fails if the journal could not commit it.
+  file_system->AsyncCall(&CodegateFileSystem::RunWhenCommitted)
+      .WithArgs(base::BindPostTaskToCurrentDefault(std::move(callback)));
+}
+
+void CodegateFSManagerImpl::GetDedupStats(GetDedupStatsCallback callback) {
+  std::move(callback).Run(blob_store_->GetStats());
+}
+
+void CodegateFSManagerImpl::ExportFileSystem(
+    uint32_t id,
+    ExportFileSystemCallback callback) {
+  base::SequenceBound<CodegateFileSystem>* file_system = FindFileSystem(id);
+  if (!file_system) {
+    std::move(callback).Run(std::nullopt);
+    return;
+  }
+  file_system->AsyncCall(&CodegateFileSystem::ExportImage)
+      .Then(std::move(callback));
+}
+
+void CodegateFSManagerImpl::ImportFileSystem(
+    mojo_base::BigBuffer image,
+    ImportFileSystemCallback callback) {
+  uint32_t id = AllocateId();
+  if (!id) {
+    std::move(callback).Run(
+        false, 0, mojo::PendingRemote<blink::mojom::cfs::CodegateDirectory>());
+    return;
+  }
+  AddFileSystem(id)
+      .AsyncCall(&CodegateFileSystem::LoadImage)
+      .WithArgs(std::move(image))
+      .Then(base::BindOnce(&CodegateFSManagerImpl::OnImageLoaded,
+                           weak_factory_.GetWeakPtr(), id,
+                           std::move(callback)));
+}
+
+uint32_t CodegateFSManagerImpl::AllocateId() {
+  if (file_system_count_ >= CFS_FILESYSTEMS_MAX) {
+    return 0;
+  }
+
+  uint32_t index;
+  if (!free_slots_.empty()) {
+    index = free_slots_.back();
+    free_slots_.pop_back();
+  } else if (slots_.size() < kMaxSlots) {
+    index = static_cast<uint32_t>(slots_.size());
+    slots_.emplace_back();
+  } else {
+    return 0;
+  }
+  // Generations start at 1, so no id is 0.
+  return (slots_[index].generation << kSlotIndexBits) | index;
+}
+
+base::SequenceBound<CodegateFileSystem>& CodegateFSManagerImpl::AddFileSystem(
+    uint32_t id) {
+  uint32_t index = SlotIndex(id);
+  if (index >= slots_.size()) {
+    slots_.resize(index + 1);
+  }
+  Slot& slot = slots_[index];
+  CHECK(slot.file_system.is_null());
+  slot.generation = SlotGeneration(id);
+  ++file_system_count_;
+
+  // A disk-backed filesystem blocks shutdown so that its last journal commit
+  // is not cut off.
+  base::TaskShutdownBehavior shutdown_behavior =
+      storage_dir_.empty() ? base::TaskShutdownBehavior::SKIP_ON_SHUTDOWN
+                           : base::TaskShutdownBehavior::BLOCK_SHUTDOWN;
+  slot.task_runner = base::ThreadPool::CreateSequencedTaskRunner(
+      {base::MayBlock(), base::TaskPriority::USER_VISIBLE, shutdown_behavior});
+  slot.file_system = base::SequenceBound<CodegateFileSystem>(
+      slot.task_runner, "root", GetStorageDir(id), blob_store_,
+      usage_budget_);
+  return slot.file_system;
+}
+
+base::SequenceBound<CodegateFileSystem>* CodegateFSManagerImpl::FindFileSystem(
+    uint32_t id) {
+  uint32_t index = SlotIndex(id);
+  if (index >= slots_.size()) {
+    return nullptr;
+  }
+  Slot& slot = slots_[index];
+  if (slot.generation != SlotGeneration(id) || slot.file_system.is_null()) {
+    return nullptr;
+  }
+  return &slot.file_system;
+}
+
+void CodegateFSManagerImpl::RemoveFileSystem(uint32_t id) {
+  base::SequenceBound<CodegateFileSystem>* file_system = FindFileSystem(id);
+  if (!file_system) {
+    return;
+  }
+
+  uint32_t index = SlotIndex(id);
+  Slot& slot = slots_[index];
+  scoped_refptr<base::SequencedTaskRunner> task_runner =
+      std::move(slot.task_runner);
+  // Posts the destruction of the tree to its sequence.
+  file_system->Reset();
+  --file_system_count_;
+  if (slot.generation < kMaxGeneration) {
+    ++slot.generation;
+    free_slots_.push_back(index);
+  }
+  if (!storage_dir_.empty()) {
+    task_runner->PostTask(
+        FROM_HERE,
+        base::BindOnce(base::IgnoreResult(&base::DeletePathRecursively),
+                       GetStorageDir(id)));
+    task_runner->PostTask(FROM_HERE,
+                          base::DoNothingWithBoundArgs(storage_dir_claim_));
+  }
+}
+
+void CodegateFSManagerImpl::OnImageLoaded(uint32_t id,
+                                          ImportFileSystemCallback callback,
+                                          bool success) {
+  base::SequenceBound<CodegateFileSystem>* file_system = FindFileSystem(id);
+  if (!success || !file_system) {
+    RemoveFileSystem(id);
+    std::move(callback).Run(
+        false, 0, mojo::PendingRemote<blink::mojom::cfs::CodegateDirectory>());
+    return;
+  }
+  file_system->AsyncCall(&CodegateFileSystem::ConnectRoot)
+      .Then(base::BindOnce(std::move(callback), true, id));
+}
+
+base::FilePath CodegateFSManagerImpl::GetStorageDir(uint32_t id) const {
+  if (storage_dir_.empty()) {
+    return base::FilePath();
+  }
+  return storage_dir_.AppendASCII(base::NumberToString(id));
 }
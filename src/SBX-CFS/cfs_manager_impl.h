@@ -2,11 +2,24 @@
 #define CONTENT_BROWSER_CFS_CFS_MANAGER_IMPL_H_
 
 // library
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <vector>
+
+// base
+#include "base/files/file_path.h"
+#include "base/memory/scoped_refptr.h"
+#include "base/memory/weak_ptr.h"
+#include "base/task/sequenced_task_runner.h"
+#include "base/threading/sequence_bound.h"
 
 // content
+#include "content/browser/CFS/cfs_blob_store.h"
 #include "content/browser/CFS/cfs_directory_impl.h"
 #include "content/browser/CFS/cfs_file_impl.h"
+#include "content/browser/CFS/cfs_file_system.h"
+#include "content/browser/CFS/cfs_usage_budget.h"
 
 // mojo dependency
 #include "mojo/public/cpp/bindings/pending_receiver.h"
@@ -16,8 +29,19 @@
 // mojo IPC Rule
 #include "third_party/blink/public/mojom/CFS/cfs.mojom.h"
 
+// Limits on every filesystem of one manager together: how many there may
+// be, and what they may use between them whatever their own quotas.
+#define CFS_FILESYSTEMS_MAX 256
+#define CFS_MANAGER_QUOTA_BYTES (1024 * 1024 * 1024)
+#define CFS_MANAGER_QUOTA_ITEMS (256 * 1024)
+
 class CodegateDirectoryImpl;
 
+// Routes CodegateFSManager calls to the filesystems it owns. Each filesystem
+// lives on a thread-pool sequence of its own: its tree is built, used and
+// destroyed there, and every receiver of its items is bound there. Work on
+// one filesystem stays ordered while independent filesystems run in
+// parallel, and none of it runs on the thread the manager is bound on.
 class CodegateFSManagerImpl : public blink::mojom::cfs::CodegateFSManager {
  public:
   static void Create(
@@ -25,6 +49,14 @@ class CodegateFSManagerImpl : public blink::mojom::cfs::CodegateFSManager {
     mojo::MakeSelfOwnedReceiver(std::make_unique<CodegateFSManagerImpl>(),
                                 std::move(receiver));
   }
+  // Keeps filesystems on disk under |storage_dir|, one subdirectory per
+  // filesystem holding its journal and file bodies. Filesystems found there
+  // are restored; |receiver| is bound once the directory has been listed.
+  // Only one manager of the process may use a directory at a time; while
+  // another one still does, |receiver| is dropped.
+  static void Create(
+      const base::FilePath& storage_dir,
+      mojo::PendingReceiver<blink::mojom::cfs::CodegateFSManager> receiver);
 
   CodegateFSManagerImpl();
   ~CodegateFSManagerImpl() override;
@@ -38,8 +70,77 @@ class CodegateFSManagerImpl : public blink::mojom::cfs::CodegateFSManager {
       GetFileSystemHandleCallback callback) override;
 
   void GetCode(GetCodeCallback callback) override;
+
+  void GetHandleStats(uint32_t id, GetHandleStatsCallback callback) override;
+  void GetUsage(uint32_t id, GetUsageCallback callback) override;
+  void SetQuota(uint32_t id,
+                uint64_t quota_bytes,
+                uint64_t quota_items,
+                SetQuotaCallback callback) override;
+  void GetDedupStats(GetDedupStatsCallback callback) override;
+  void ExportFileSystem(uint32_t id,
+                        ExportFileSystemCallback callback) override;
+  void ImportFileSystem(mojo_base::BigBuffer image,
+                        ImportFileSystemCallback callback) override;
  private:
-  uint32_t cnt_;
-  std::map<uint32_t, std::unique_ptr<CodegateDirectoryImpl>> file_system_list_;
+  class StorageDirClaim;
+
+  // |stored_ids| are the filesystems found under |storage_dir|, which
+  // |claim| holds for this manager.
+  CodegateFSManagerImpl(const base::FilePath& storage_dir,
+                        const std::vector<uint32_t>& stored_ids,
+                        scoped_refptr<StorageDirClaim> claim);
+
+  // A filesystem id is a slot index in the low bits and the slot's
+  // generation in the high bits. Removing a filesystem bumps the generation,
+  // so an id that outlived its filesystem never finds the next one to use
+  // the slot.
+  struct Slot {
+    Slot();
+    Slot(Slot&&);
+    Slot& operator=(Slot&&);
+    ~Slot();
+
+    uint32_t generation = 1;
+    // Both null while the slot is free.
+    scoped_refptr<base::SequencedTaskRunner> task_runner;
+    base::SequenceBound<CodegateFileSystem> file_system;
+  };
+
+  // Returns 0, which is never a valid id, if every slot is taken or the
+  // manager already holds CFS_FILESYSTEMS_MAX filesystems.
+  uint32_t AllocateId();
+  // Creates filesystem |id| on a new sequence, in the slot |id| names.
+  base::SequenceBound<CodegateFileSystem>& AddFileSystem(uint32_t id);
+  // Returns nullptr if there is no filesystem |id|. Never allocates.
+  base::SequenceBound<CodegateFileSystem>* FindFileSystem(uint32_t id);
+  // Destroys filesystem |id| on its sequence, then removes its storage, and
+  // frees its slot.
+  void RemoveFileSystem(uint32_t id);
+  void OnImageLoaded(uint32_t id,
+                     ImportFileSystemCallback callback,
+                     bool success);
+  // Empty for in-memory managers.
+  base::FilePath GetStorageDir(uint32_t id) const;
+
+  // Empty when filesystems stay in memory.
+  base::FilePath storage_dir_;
+  // Null when filesystems stay in memory. Every filesystem sequence gets a
+  // reference once its filesystem is gone, so the directory stays claimed
+  // until the last commit to it.
+  scoped_refptr<StorageDirClaim> storage_dir_claim_;
+  // Shared by the in-memory filesystems, which reach it from their own
+  // sequences.
+  scoped_refptr<CodegateBlobStore> blob_store_ =
+      base::MakeRefCounted<CodegateBlobStore>();
+  scoped_refptr<CodegateUsageBudget> usage_budget_ =
+      base::MakeRefCounted<CodegateUsageBudget>(CFS_MANAGER_QUOTA_BYTES,
+                                                CFS_MANAGER_QUOTA_ITEMS);
+  std::vector<Slot> slots_;
+  size_t file_system_count_ = 0;
+  // Indices of free slots that still have a generation left, reused last
+  // freed first.
+  std::vector<uint32_t> free_slots_;
+  base::WeakPtrFactory<CodegateFSManagerImpl> weak_factory_{this};
 };
 #endif  // CONTENT_BROWSER_CFS_CFS_MANAGER_IMPL_H_
@@ -0,0 +1,241 @@
+// content/browser/CFS/cfs_manager_impl_unittest.cc
+
+// content
+#include "content/browser/CFS/cfs_manager_impl.h"
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// base
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/run_loop.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/test/task_environment.h"
+#include "base/test/test_future.h"
+
+// mojo dependency
+#include "mojo/public/cpp/bindings/pending_remote.h"
+#include "mojo/public/cpp/bindings/remote.h"
+
+// test
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace {
+
+using blink::mojom::cfs::CodegateDirectory;
+using blink::mojom::cfs::CodegateFile;
+using blink::mojom::cfs::CodegateFSManager;
+using blink::mojom::cfs::CodegateItemResponsePtr;
+using blink::mojom::cfs::ITEMTYPE;
+
+using CreateFileSystemFuture =
+    base::test::TestFuture<uint32_t, mojo::PendingRemote<CodegateDirectory>>;
+using ItemFuture = base::test::TestFuture<ITEMTYPE, CodegateItemResponsePtr>;
+using ReadFuture =
+    base::test::TestFuture<bool, std::optional<std::vector<uint8_t>>>;
+
+// Filesystems kept in memory.
+class CodegateFSManagerImplTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    CodegateFSManagerImpl::Create(manager_.BindNewPipeAndPassReceiver());
+  }
+
+  uint32_t CreateFileSystem() {
+    CreateFileSystemFuture created;
+    manager_->CreateFileSystem(created.GetCallback());
+    auto [id, root] = created.Take();
+    EXPECT_EQ(id != 0, root.is_valid());
+    return id;
+  }
+
+  bool DeleteFileSystem(uint32_t id) {
+    base::test::TestFuture<bool> deleted;
+    manager_->DeleteFileSystem(id, deleted.GetCallback());
+    return deleted.Get();
+  }
+
+  bool HasFileSystem(uint32_t id) {
+    base::test::TestFuture<bool, mojo::PendingRemote<CodegateDirectory>>
+        handle;
+    manager_->GetFileSystemHandle(id, handle.GetCallback());
+    return handle.Get<0>();
+  }
+
+  base::test::TaskEnvironment task_environment_;
+  mojo::Remote<CodegateFSManager> manager_;
+};
+
+TEST_F(CodegateFSManagerImplTest, ReusedSlotGetsNewId) {
+  uint32_t first = CreateFileSystem();
+  ASSERT_NE(first, 0u);
+  ASSERT_TRUE(DeleteFileSystem(first));
+  EXPECT_FALSE(HasFileSystem(first));
+  EXPECT_FALSE(DeleteFileSystem(first));
+
+  uint32_t second = CreateFileSystem();
+  ASSERT_NE(second, 0u);
+  // Same slot, next generation: the stale id stays dead.
+  EXPECT_EQ(second & 0xFFFF, first & 0xFFFF);
+  EXPECT_NE(second, first);
+  EXPECT_TRUE(HasFileSystem(second));
+  EXPECT_FALSE(HasFileSystem(first));
+}
+
+TEST_F(CodegateFSManagerImplTest, RejectsUnknownIds) {
+  uint32_t id = CreateFileSystem();
+  ASSERT_NE(id, 0u);
+
+  EXPECT_FALSE(HasFileSystem(0));
+  EXPECT_FALSE(HasFileSystem(0xFFFFFFFF));
+  EXPECT_FALSE(HasFileSystem(id + 1));
+  // Right slot, wrong generation.
+  EXPECT_FALSE(HasFileSystem(id + (1u << 16)));
+  EXPECT_TRUE(HasFileSystem(id));
+}
+
+TEST_F(CodegateFSManagerImplTest, CapsFileSystemCount) {
+  std::vector<uint32_t> ids;
+  for (int i = 0; i < CFS_FILESYSTEMS_MAX; ++i) {
+    uint32_t id = CreateFileSystem();
+    ASSERT_NE(id, 0u);
+    EXPECT_NE(id, 0xFFFFFFFF);
+    ids.push_back(id);
+  }
+  EXPECT_EQ(CreateFileSystem(), 0u);
+
+  ASSERT_TRUE(DeleteFileSystem(ids.back()));
+  uint32_t id = CreateFileSystem();
+  EXPECT_NE(id, 0u);
+  EXPECT_NE(id, ids.back());
+}
+
+// Filesystems backed by a temporary storage directory.
+class CodegateFSManagerImplDiskTest : public testing::Test {
+ protected:
+  void SetUp() override { ASSERT_TRUE(temp_dir_.CreateUniqueTempDir()); }
+
+  mojo::Remote<CodegateFSManager> CreateManager() {
+    mojo::Remote<CodegateFSManager> manager;
+    CodegateFSManagerImpl::Create(temp_dir_.GetPath(),
+                                  manager.BindNewPipeAndPassReceiver());
+    return manager;
+  }
+
+  // Outlives the task environment, so that nothing still writes to it when
+  // it is deleted.
+  base::ScopedTempDir temp_dir_;
+  base::test::TaskEnvironment task_environment_;
+};
+
+TEST_F(CodegateFSManagerImplDiskTest, RestoresFileSystemsOfEarlierManager) {
+  uint32_t id;
+  {
+    mojo::Remote<CodegateFSManager> manager = CreateManager();
+    CreateFileSystemFuture created;
+    manager->CreateFileSystem(created.GetCallback());
+    auto [new_id, root_remote] = created.Take();
+    ASSERT_NE(new_id, 0u);
+    id = new_id;
+    mojo::Remote<CodegateDirectory> root(std::move(root_remote));
+
+    base::test::TestFuture<bool> mkdir;
+    root->CreateDirectories("a", mkdir.GetCallback());
+    ASSERT_TRUE(mkdir.Get());
+    ItemFuture file_created;
+    root->CreateItem("a/file", ITEMTYPE::kFile, file_created.GetCallback());
+    auto [type, response] = file_created.Take();
+    ASSERT_EQ(type, ITEMTYPE::kFile);
+    mojo::Remote<CodegateFile> file(std::move(response->get_remote_file()));
+
+    base::test::TestFuture<bool> written;
+    file->Write({1, 2, 3}, written.GetCallback());
+    // Only replied to once the journal has it.
+    ASSERT_TRUE(written.Get());
+  }
+  // Lets the manager and its filesystems go away.
+  task_environment_.RunUntilIdle();
+  EXPECT_TRUE(base::PathExists(temp_dir_.GetPath()
+                                   .AppendASCII(base::NumberToString(id))
+                                   .AppendASCII("journal")));
+
+  mojo::Remote<CodegateFSManager> manager = CreateManager();
+  base::test::TestFuture<bool, mojo::PendingRemote<CodegateDirectory>> handle;
+  manager->GetFileSystemHandle(id, handle.GetCallback());
+  auto [success, root_remote] = handle.Take();
+  ASSERT_TRUE(success);
+  mojo::Remote<CodegateDirectory> root(std::move(root_remote));
+
+  ItemFuture item;
+  root->GetItemHandle("a/file", item.GetCallback());
+  auto [type, response] = item.Take();
+  ASSERT_EQ(type, ITEMTYPE::kFile);
+  mojo::Remote<CodegateFile> file(std::move(response->get_remote_file()));
+
+  ReadFuture read;
+  file->Read(
+      read.GetCallback<bool, const std::optional<std::vector<uint8_t>>&>());
+  ASSERT_TRUE(read.Get<0>());
+  EXPECT_EQ(read.Get<1>(), std::vector<uint8_t>({1, 2, 3}));
+}
+
+TEST_F(CodegateFSManagerImplDiskTest, RestoresNewestGenerationOfSlot) {
+  // Slot 0 under generations 1 and 2, as a crash can leave it when deleting
+  // the first filesystem was cut off.
+  const uint32_t kStale = 1u << 16;
+  const uint32_t kLive = 2u << 16;
+  base::FilePath stale_dir =
+      temp_dir_.GetPath().AppendASCII(base::NumberToString(kStale));
+  ASSERT_TRUE(base::CreateDirectory(stale_dir));
+  ASSERT_TRUE(base::CreateDirectory(
+      temp_dir_.GetPath().AppendASCII(base::NumberToString(kLive))));
+
+  mojo::Remote<CodegateFSManager> manager = CreateManager();
+  base::test::TestFuture<bool, mojo::PendingRemote<CodegateDirectory>> live;
+  manager->GetFileSystemHandle(kLive, live.GetCallback());
+  EXPECT_TRUE(live.Get<0>());
+  base::test::TestFuture<bool, mojo::PendingRemote<CodegateDirectory>> stale;
+  manager->GetFileSystemHandle(kStale, stale.GetCallback());
+  EXPECT_FALSE(stale.Get<0>());
+  EXPECT_FALSE(base::PathExists(stale_dir));
+
+  // The slot goes on above both.
+  base::test::TestFuture<bool> deleted;
+  manager->DeleteFileSystem(kLive, deleted.GetCallback());
+  ASSERT_TRUE(deleted.Get());
+  CreateFileSystemFuture created;
+  manager->CreateFileSystem(created.GetCallback());
+  EXPECT_EQ(created.Get<0>(), 3u << 16);
+}
+
+TEST_F(CodegateFSManagerImplDiskTest, RefusesSecondManagerOnDirectory) {
+  mojo::Remote<CodegateFSManager> first = CreateManager();
+  mojo::Remote<CodegateFSManager> second = CreateManager();
+
+  base::RunLoop run_loop;
+  second.set_disconnect_handler(run_loop.QuitClosure());
+  run_loop.Run();
+
+  CreateFileSystemFuture created;
+  first->CreateFileSystem(created.GetCallback());
+  EXPECT_NE(created.Get<0>(), 0u);
+}
+
+TEST_F(CodegateFSManagerImplDiskTest, ReleasesDirectoryWithManager) {
+  {
+    mojo::Remote<CodegateFSManager> first = CreateManager();
+    CreateFileSystemFuture created;
+    first->CreateFileSystem(created.GetCallback());
+    ASSERT_NE(created.Get<0>(), 0u);
+  }
+  task_environment_.RunUntilIdle();
+
+  mojo::Remote<CodegateFSManager> second = CreateManager();
+  second.FlushForTesting();
+  EXPECT_TRUE(second.is_connected());
+}
+
+}  // namespace
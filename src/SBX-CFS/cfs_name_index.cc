@@ -0,0 +1,77 @@
+// content/browser/CFS/cfs_name_index.cc
+
+// content
+#include "content/browser/CFS/cfs_name_index.h"
+
+#include "content/browser/CFS/cfs_item.h"
+
+// base
+#include "base/strings/pattern.h"
+#include "base/strings/string_util.h"
+
+namespace {
+
+constexpr char kGlobSpecials[] = "*?\\";
+
+std::string Reversed(const std::string& name) {
+  return std::string(name.rbegin(), name.rend());
+}
+
+}  // namespace
+
+CodegateNameIndex::CodegateNameIndex() = default;
+
+CodegateNameIndex::~CodegateNameIndex() = default;
+
+void CodegateNameIndex::Add(CodegateItem* item) {
+  names_.emplace(item->GetItemName(), item);
+  reversed_names_.emplace(Reversed(item->GetItemName()), item);
+}
+
+void CodegateNameIndex::Remove(CodegateItem* item) {
+  names_.erase(Entry(item->GetItemName(), item));
+  reversed_names_.erase(Entry(Reversed(item->GetItemName()), item));
+}
+
+void CodegateNameIndex::Rename(CodegateItem* item,
+                               const std::string& old_name) {
+  // Items not in the index yet stay out of it.
+  if (!names_.erase(Entry(old_name, item))) {
+    return;
+  }
+  reversed_names_.erase(Entry(Reversed(old_name), item));
+  Add(item);
+}
+
+void CodegateNameIndex::Match(
+    const std::string& pattern,
+    base::FunctionRef<bool(CodegateItem*)> visitor) const {
+  // Whatever comes before the first wildcard or escape, and after the last
+  // one, is matched literally.
+  size_t first = pattern.find_first_of(kGlobSpecials);
+  size_t last = pattern.find_last_of(kGlobSpecials);
+  std::string prefix = pattern.substr(0, first);
+  std::string suffix =
+      last == std::string::npos ? pattern : pattern.substr(last + 1);
+
+  if (!suffix.empty() && suffix.size() > prefix.size()) {
+    MatchRange(reversed_names_, Reversed(suffix), pattern, visitor);
+    return;
+  }
+  MatchRange(names_, prefix, pattern, visitor);
+}
+
+// static
+void CodegateNameIndex::MatchRange(
+    const std::set<Entry>& entries,
+    const std::string& prefix,
+    const std::string& pattern,
+    base::FunctionRef<bool(CodegateItem*)> visitor) {
+  for (auto it = entries.lower_bound(Entry(prefix, nullptr));
+       it != entries.end() && base::StartsWith(it->first, prefix); ++it) {
+    CodegateItem* item = it->second;
+    if (base::MatchPattern(item->GetItemName(), pattern) && !visitor(item)) {
+      return;
+    }
+  }
+}
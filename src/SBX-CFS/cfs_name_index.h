@@ -0,0 +1,58 @@
+#ifndef CONTENT_BROWSER_CFS_CFS_NAME_INDEX_H_
+#define CONTENT_BROWSER_CFS_CFS_NAME_INDEX_H_
+
+// library
+#include <set>
+#include <string>
+#include <utility>
+
+// base
+#include "base/functional/function_ref.h"
+#include "base/memory/raw_ptr.h"
+
+class CodegateItem;
+
+// Every item of one filesystem, sorted by name and by reversed name, so that
+// a glob with a literal prefix or suffix only visits the names that share it.
+//
+// Items join the index when they are first attached to the tree and leave it
+// when they are destroyed, so moving a subtree costs nothing here. Callers
+// that only want part of the tree filter matches by position.
+class CodegateNameIndex {
+ public:
+  CodegateNameIndex();
+  ~CodegateNameIndex();
+
+  CodegateNameIndex(const CodegateNameIndex&) = delete;
+  CodegateNameIndex& operator=(const CodegateNameIndex&) = delete;
+
+  // Add is a no-op for an item already in the index.
+  void Add(CodegateItem* item);
+  void Remove(CodegateItem* item);
+  // Called after |item| was renamed from |old_name|.
+  void Rename(CodegateItem* item, const std::string& old_name);
+
+  size_t size() const { return names_.size(); }
+
+  // Runs |visitor| on every item whose name matches |pattern|, where "*"
+  // matches any run of characters and "?" any single one, in name order
+  // unless only a literal suffix narrows the search. Stops once |visitor|
+  // returns false.
+  void Match(const std::string& pattern,
+             base::FunctionRef<bool(CodegateItem*)> visitor) const;
+
+ private:
+  using Entry = std::pair<std::string, raw_ptr<CodegateItem>>;
+
+  // Visits entries of |entries| whose key starts with |prefix|.
+  static void MatchRange(const std::set<Entry>& entries,
+                         const std::string& prefix,
+                         const std::string& pattern,
+                         base::FunctionRef<bool(CodegateItem*)> visitor);
+
+  std::set<Entry> names_;
+  // Same entries keyed by the reversed name.
+  std::set<Entry> reversed_names_;
+};
+
+#endif  // CONTENT_BROWSER_CFS_CFS_NAME_INDEX_H_
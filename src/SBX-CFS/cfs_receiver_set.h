@@ -0,0 +1,201 @@
+#ifndef CONTENT_BROWSER_CFS_CFS_RECEIVER_SET_H_
+#define CONTENT_BROWSER_CFS_CFS_RECEIVER_SET_H_
+
+// library
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// base
+#include "base/functional/bind.h"
+#include "base/memory/raw_ptr.h"
+#include "base/time/time.h"
+
+// content
+#include "content/browser/CFS/cfs_file_system.h"
+
+// mojo dependency
+#include "mojo/public/cpp/bindings/message.h"
+#include "mojo/public/cpp/bindings/pending_receiver.h"
+#include "mojo/public/cpp/bindings/receiver.h"
+
+// The part of an item's receiver set the filesystem's idle sweep works with.
+class CodegateReceiverTracker {
+ public:
+  virtual ~CodegateReceiverTracker() = default;
+
+  // Drops receivers that have not dispatched a message since |cutoff|, but
+  // always keeps the |keep| most recently used ones. Returns how many were
+  // dropped.
+  virtual size_t ReclaimIdle(base::TimeTicks cutoff, size_t keep) = 0;
+  // Drops every receiver.
+  virtual void CloseAll() = 0;
+};
+
+// The receivers of one CFS item, bounded per item and per filesystem. When
+// the item is at CFS_RECEIVERS_PER_ITEM_MAX, or the filesystem at
+// CFS_RECEIVERS_PER_FS_MAX, a new receiver replaces the item's least recently
+// used one, never the one dispatching the current message. Each receiver
+// carries a message filter that records when it last dispatched, so idle
+// receivers can be told apart without the owner's mojo methods doing
+// anything.
+template <typename Interface>
+class CodegateReceiverSet : public CodegateReceiverTracker {
+ public:
+  explicit CodegateReceiverSet(Interface* impl) : impl_(impl) {}
+
+  ~CodegateReceiverSet() override {
+    if (file_system_) {
+      file_system_->OnTrackerDestroyed(this, entries_.size());
+    }
+  }
+
+  CodegateReceiverSet(const CodegateReceiverSet&) = delete;
+  CodegateReceiverSet& operator=(const CodegateReceiverSet&) = delete;
+
+  // Returns false, dropping |receiver|, only if the filesystem is full and
+  // this item has no receiver to give up for it.
+  bool Add(CodegateFileSystem* file_system,
+           mojo::PendingReceiver<Interface> receiver) {
+    // An item never changes filesystems.
+    if (!file_system_) {
+      file_system_ = file_system;
+    }
+
+    if (entries_.size() >= CFS_RECEIVERS_PER_ITEM_MAX ||
+        (file_system_ && !file_system_->CanAddReceiver())) {
+      if (!RemoveLeastRecentlyUsed()) {
+        if (file_system_) {
+          file_system_->OnReceiverRejected();
+        }
+        return false;
+      }
+    }
+
+    ReceiverId id = next_id_++;
+    auto entry = std::make_unique<Entry>(impl_, std::move(receiver));
+    entry->receiver.SetFilter(std::make_unique<UseRecorder>(this, id));
+    entry->receiver.set_disconnect_handler(
+        base::BindOnce(&CodegateReceiverSet::Remove, base::Unretained(this),
+                       id, /*reclaimed=*/false));
+    entry->last_used = base::TimeTicks::Now();
+    entries_.emplace(id, std::move(entry));
+    if (file_system_) {
+      file_system_->OnReceiverAdded(this);
+    }
+    return true;
+  }
+
+  // Closes the receiver dispatching the current message.
+  void RemoveCurrent() {
+    if (current_ && entries_.count(current_)) {
+      Remove(current_, /*reclaimed=*/false);
+    }
+  }
+
+  size_t size() const { return entries_.size(); }
+
+  size_t ReclaimIdle(base::TimeTicks cutoff, size_t keep) override {
+    if (entries_.size() <= keep) {
+      return 0;
+    }
+
+    std::vector<std::pair<base::TimeTicks, ReceiverId>> by_age;
+    by_age.reserve(entries_.size());
+    for (const auto& [id, entry] : entries_) {
+      by_age.emplace_back(entry->last_used, id);
+    }
+    std::sort(by_age.begin(), by_age.end());
+
+    size_t reclaimed = 0;
+    size_t removable = by_age.size() - keep;
+    for (; reclaimed < removable && by_age[reclaimed].first < cutoff;
+         ++reclaimed) {
+      Remove(by_age[reclaimed].second, /*reclaimed=*/true);
+    }
+    return reclaimed;
+  }
+
+  void CloseAll() override {
+    while (!entries_.empty()) {
+      Remove(entries_.begin()->first, /*reclaimed=*/false);
+    }
+  }
+
+ private:
+  using ReceiverId = uint64_t;
+
+  struct Entry {
+    Entry(Interface* impl, mojo::PendingReceiver<Interface> pending)
+        : receiver(impl, std::move(pending)) {}
+
+    mojo::Receiver<Interface> receiver;
+    base::TimeTicks last_used;
+  };
+
+  // Installed on every receiver; owned by it, so it never outlives the set.
+  class UseRecorder : public mojo::MessageFilter {
+   public:
+    UseRecorder(CodegateReceiverSet* set, ReceiverId id)
+        : set_(set), id_(id) {}
+
+    bool WillDispatch(mojo::Message* message) override {
+      auto it = set_->entries_.find(id_);
+      if (it != set_->entries_.end()) {
+        it->second->last_used = base::TimeTicks::Now();
+      }
+      set_->current_ = id_;
+      return true;
+    }
+
+    // Not called if the receiver was removed while dispatching.
+    void DidDispatchOrReject(mojo::Message* message, bool accepted) override {
+      set_->current_ = 0;
+    }
+
+   private:
+    raw_ptr<CodegateReceiverSet> set_;
+    ReceiverId id_;
+  };
+
+  // Returns false if there is no receiver other than the current one.
+  bool RemoveLeastRecentlyUsed() {
+    auto oldest = entries_.end();
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+      if (it->first != current_ &&
+          (oldest == entries_.end() ||
+           it->second->last_used < oldest->second->last_used)) {
+        oldest = it;
+      }
+    }
+    if (oldest == entries_.end()) {
+      return false;
+    }
+    Remove(oldest->first, /*reclaimed=*/true);
+    return true;
+  }
+
+  void Remove(ReceiverId id, bool reclaimed) {
+    if (id == current_) {
+      current_ = 0;
+    }
+    // Destroys the receiver, closing its pipe.
+    entries_.erase(id);
+    if (file_system_) {
+      file_system_->OnReceiverRemoved(this, entries_.size(), reclaimed);
+    }
+  }
+
+  raw_ptr<Interface> impl_;
+  raw_ptr<CodegateFileSystem> file_system_ = nullptr;
+  std::map<ReceiverId, std::unique_ptr<Entry>> entries_;
+  // Ids start at 1; 0 means no message is being dispatched.
+  ReceiverId next_id_ = 1;
+  ReceiverId current_ = 0;
+};
+
+#endif  // CONTENT_BROWSER_CFS_CFS_RECEIVER_SET_H_
@@ -0,0 +1,193 @@
+// content/browser/CFS/cfs_search.cc
+
+#ifdef UNSAFE_BUFFERS_BUILD
+// The search kernels step through the haystack with raw vector loads.
+#pragma allow_unsafe_buffers
+#endif
+
+// content
+#include "content/browser/CFS/cfs_search.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <vector>
+
+#include "content/browser/CFS/cfs_storage.h"
+
+// base
+#include "build/build_config.h"
+
+#if defined(ARCH_CPU_X86_FAMILY)
+#include <immintrin.h>
+
+#include "base/cpu.h"
+#endif
+
+namespace {
+
+// Bytes of file content searched per window, not counting the overlap.
+constexpr size_t kSearchWindowSize = 64 * 1024;
+
+// Every kernel below returns the first match starting in [from, last], where
+// |last| is the final offset a needle of |needle_size| still fits at. Callers
+// guarantee from <= last and needle_size >= 2.
+
+size_t FindScalar(const uint8_t* haystack,
+                  size_t last,
+                  const uint8_t* needle,
+                  size_t needle_size,
+                  size_t from) {
+  const uint8_t* pos = haystack + from;
+  const uint8_t* end = haystack + last + 1;
+  while (pos < end) {
+    pos = static_cast<const uint8_t*>(
+        memchr(pos, needle[0], static_cast<size_t>(end - pos)));
+    if (!pos) {
+      break;
+    }
+    if (memcmp(pos + 1, needle + 1, needle_size - 1) == 0) {
+      return static_cast<size_t>(pos - haystack);
+    }
+    ++pos;
+  }
+  return last + 1;
+}
+
+#if defined(ARCH_CPU_X86_FAMILY)
+
+// SSE2 is part of every x86 CPU Chrome runs on.
+size_t FindSse2(const uint8_t* haystack,
+                size_t last,
+                const uint8_t* needle,
+                size_t needle_size,
+                size_t from) {
+  const __m128i first_byte = _mm_set1_epi8(static_cast<char>(needle[0]));
+  const __m128i last_byte =
+      _mm_set1_epi8(static_cast<char>(needle[needle_size - 1]));
+  size_t pos = from;
+  // Each step checks the 16 start offsets [pos, pos + 16).
+  for (; pos + 15 <= last; pos += 16) {
+    __m128i block_first =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + pos));
+    __m128i block_last = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(haystack + pos + needle_size - 1));
+    uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(first_byte, block_first),
+                      _mm_cmpeq_epi8(last_byte, block_last))));
+    while (mask) {
+      size_t candidate = pos + std::countr_zero(mask);
+      if (memcmp(haystack + candidate + 1, needle + 1, needle_size - 2) == 0) {
+        return candidate;
+      }
+      mask &= mask - 1;
+    }
+  }
+  return pos <= last ? FindScalar(haystack, last, needle, needle_size, pos)
+                     : last + 1;
+}
+
+__attribute__((target("avx2"))) size_t FindAvx2(const uint8_t* haystack,
+                                                size_t last,
+                                                const uint8_t* needle,
+                                                size_t needle_size,
+                                                size_t from) {
+  const __m256i first_byte = _mm256_set1_epi8(static_cast<char>(needle[0]));
+  const __m256i last_byte =
+      _mm256_set1_epi8(static_cast<char>(needle[needle_size - 1]));
+  size_t pos = from;
+  for (; pos + 31 <= last; pos += 32) {
+    __m256i block_first =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(haystack + pos));
+    __m256i block_last = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(haystack + pos + needle_size - 1));
+    uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_cmpeq_epi8(first_byte, block_first),
+                         _mm256_cmpeq_epi8(last_byte, block_last))));
+    while (mask) {
+      size_t candidate = pos + std::countr_zero(mask);
+      if (memcmp(haystack + candidate + 1, needle + 1, needle_size - 2) == 0) {
+        return candidate;
+      }
+      mask &= mask - 1;
+    }
+  }
+  // The tail is shorter than one AVX2 block but may still fill SSE2 ones.
+  return pos <= last ? FindSse2(haystack, last, needle, needle_size, pos)
+                     : last + 1;
+}
+
+#endif  // defined(ARCH_CPU_X86_FAMILY)
+
+}  // namespace
+
+std::optional<size_t> FindSubstring(base::span<const uint8_t> haystack,
+                                    base::span<const uint8_t> needle,
+                                    size_t from) {
+  CHECK(!needle.empty());
+  if (haystack.size() < needle.size() ||
+      from > haystack.size() - needle.size()) {
+    return std::nullopt;
+  }
+
+  size_t last = haystack.size() - needle.size();
+  if (needle.size() == 1) {
+    const void* pos =
+        memchr(haystack.data() + from, needle[0], last + 1 - from);
+    if (!pos) {
+      return std::nullopt;
+    }
+    return static_cast<size_t>(static_cast<const uint8_t*>(pos) -
+                               haystack.data());
+  }
+
+  size_t found;
+#if defined(ARCH_CPU_X86_FAMILY)
+  static const bool has_avx2 = base::CPU().has_avx2();
+  found = has_avx2 ? FindAvx2(haystack.data(), last, needle.data(),
+                              needle.size(), from)
+                   : FindSse2(haystack.data(), last, needle.data(),
+                              needle.size(), from);
+#else
+  found =
+      FindScalar(haystack.data(), last, needle.data(), needle.size(), from);
+#endif
+  if (found > last) {
+    return std::nullopt;
+  }
+  return found;
+}
+
+void SearchFileStorage(const CodegateFileStorage& storage,
+                       base::span<const uint8_t> needle,
+                       base::FunctionRef<bool(uint64_t)> on_match) {
+  CHECK(!needle.empty());
+  std::vector<uint8_t> window(kSearchWindowSize + needle.size() - 1);
+  // Where the next match may start at the earliest, so that a match in the
+  // overlap is not reported twice.
+  uint64_t next_start = 0;
+
+  for (uint64_t offset = 0;;) {
+    size_t count = storage.Read(offset, window);
+    if (count < needle.size()) {
+      return;
+    }
+
+    base::span<const uint8_t> data = base::span(window).first(count);
+    size_t from = static_cast<size_t>(next_start - offset);
+    for (std::optional<size_t> found = FindSubstring(data, needle, from);
+         found; found = FindSubstring(data, needle, *found + needle.size())) {
+      if (!on_match(offset + *found)) {
+        return;
+      }
+      next_start = offset + *found + needle.size();
+    }
+
+    if (count < window.size()) {
+      return;
+    }
+    // Keep the last needle.size() - 1 bytes for the next window.
+    offset += count - (needle.size() - 1);
+    next_start = std::max(next_start, offset);
+  }
+}
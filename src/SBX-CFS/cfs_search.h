@@ -0,0 +1,33 @@
+#ifndef CONTENT_BROWSER_CFS_CFS_SEARCH_H_
+#define CONTENT_BROWSER_CFS_CFS_SEARCH_H_
+
+// library
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+// base
+#include "base/containers/span.h"
+#include "base/functional/function_ref.h"
+
+class CodegateFileStorage;
+
+// Returns the offset of the first occurrence of |needle|, which must not be
+// empty, in |haystack| at or after |from|. Candidates are found 32 or 16
+// bytes at a time by comparing the needle's first and last byte with AVX2
+// or SSE2, whichever the CPU has; only those are compared in full. Other
+// CPUs use a memchr-driven scalar loop.
+std::optional<size_t> FindSubstring(base::span<const uint8_t> haystack,
+                                    base::span<const uint8_t> needle,
+                                    size_t from = 0);
+
+// Runs |on_match| on the offset of every non-overlapping occurrence of
+// |needle| in |storage|, in order, until it returns false. The storage is
+// read in bounded windows that overlap by less than a needle, so matches
+// across window boundaries are found and memory use does not grow with the
+// file.
+void SearchFileStorage(const CodegateFileStorage& storage,
+                       base::span<const uint8_t> needle,
+                       base::FunctionRef<bool(uint64_t)> on_match);
+
+#endif  // CONTENT_BROWSER_CFS_CFS_SEARCH_H_
@@ -0,0 +1,149 @@
+// content/browser/CFS/cfs_search_unittest.cc
+
+// content
+#include "content/browser/CFS/cfs_search.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "content/browser/CFS/cfs_storage.h"
+
+// base
+#include "base/containers/span.h"
+
+// test
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace {
+
+// What every kernel must agree with.
+std::optional<size_t> FindNaive(base::span<const uint8_t> haystack,
+                                base::span<const uint8_t> needle,
+                                size_t from) {
+  for (size_t i = from; i + needle.size() <= haystack.size(); ++i) {
+    if (haystack.subspan(i, needle.size()) == needle) {
+      return i;
+    }
+  }
+  return std::nullopt;
+}
+
+// Deterministic bytes from a small alphabet, so that first/last byte
+// candidates are frequent and most of them are false positives.
+std::vector<uint8_t> MakeBytes(size_t size, uint32_t seed) {
+  std::vector<uint8_t> bytes(size);
+  for (uint8_t& byte : bytes) {
+    seed = seed * 1103515245 + 12345;
+    byte = static_cast<uint8_t>('a' + (seed >> 16) % 3);
+  }
+  return bytes;
+}
+
+std::vector<uint64_t> SearchAll(const CodegateFileStorage& storage,
+                                base::span<const uint8_t> needle,
+                                size_t max_matches = SIZE_MAX) {
+  std::vector<uint64_t> matches;
+  SearchFileStorage(storage, needle, [&](uint64_t offset) {
+    matches.push_back(offset);
+    return matches.size() < max_matches;
+  });
+  return matches;
+}
+
+TEST(CodegateSearchTest, FindsSingleByte) {
+  std::string haystack = "abcabc";
+  EXPECT_EQ(FindSubstring(base::as_byte_span(haystack),
+                          base::as_byte_span(std::string("c"))),
+            2u);
+  EXPECT_EQ(FindSubstring(base::as_byte_span(haystack),
+                          base::as_byte_span(std::string("c")), 3),
+            5u);
+  EXPECT_EQ(FindSubstring(base::as_byte_span(haystack),
+                          base::as_byte_span(std::string("d"))),
+            std::nullopt);
+}
+
+TEST(CodegateSearchTest, HandlesEdges) {
+  std::string haystack = "abcd";
+  auto find = [&](const std::string& needle, size_t from) {
+    return FindSubstring(base::as_byte_span(haystack),
+                         base::as_byte_span(needle), from);
+  };
+  EXPECT_EQ(find("abcd", 0), 0u);
+  EXPECT_EQ(find("cd", 2), 2u);
+  EXPECT_EQ(find("cd", 3), std::nullopt);
+  EXPECT_EQ(find("abcde", 0), std::nullopt);
+  EXPECT_EQ(find("ab", 100), std::nullopt);
+}
+
+// Needles of every length around the vector widths, at every start offset,
+// so that candidates land on each lane and across block boundaries and the
+// tail handling is exercised.
+TEST(CodegateSearchTest, MatchesNaiveSearch) {
+  for (size_t size : {1u, 2u, 15u, 16u, 17u, 31u, 32u, 33u, 64u, 100u, 257u}) {
+    std::vector<uint8_t> haystack = MakeBytes(size, size);
+    for (size_t needle_size : {1u, 2u, 3u, 4u, 7u, 16u, 33u}) {
+      if (needle_size > size) {
+        continue;
+      }
+      for (size_t start = 0; start + needle_size <= size;
+           start += needle_size) {
+        base::span<const uint8_t> needle =
+            base::span(haystack).subspan(start, needle_size);
+        for (size_t from = 0; from <= size; ++from) {
+          EXPECT_EQ(FindSubstring(haystack, needle, from),
+                    FindNaive(haystack, needle, from))
+              << "size " << size << " needle " << start << "+" << needle_size
+              << " from " << from;
+        }
+      }
+    }
+  }
+}
+
+TEST(CodegateSearchTest, FindsMatchAtEveryOffset) {
+  const std::vector<uint8_t> needle = {'x', 'y', 'z'};
+  for (size_t pos = 0; pos + needle.size() <= 70; ++pos) {
+    std::vector<uint8_t> haystack(70, 'x');
+    std::copy(needle.begin(), needle.end(), haystack.begin() + pos);
+    EXPECT_EQ(FindSubstring(haystack, needle), pos);
+  }
+}
+
+TEST(CodegateSearchTest, StorageMatchesDoNotOverlap) {
+  CodegateMemoryFileStorage storage;
+  ASSERT_TRUE(storage.Assign(base::as_byte_span(std::string("aaaaa"))));
+
+  EXPECT_EQ(SearchAll(storage, base::as_byte_span(std::string("aa"))),
+            (std::vector<uint64_t>{0, 2}));
+  EXPECT_EQ(SearchAll(storage, base::as_byte_span(std::string("aaaaaa"))),
+            std::vector<uint64_t>());
+}
+
+// Files larger than one search window, with matches straddling the window
+// boundaries and in the overlap kept between windows.
+TEST(CodegateSearchTest, StorageFindsMatchesAcrossWindows) {
+  const std::string needle = "needle";
+  std::vector<uint8_t> body(200 * 1024, '.');
+  std::vector<uint64_t> expected;
+  for (uint64_t pos : {uint64_t{0}, uint64_t{64 * 1024 - 3},
+                       uint64_t{64 * 1024 + 2}, uint64_t{128 * 1024 - 6},
+                       uint64_t{128 * 1024 - 5}, uint64_t{200 * 1024 - 6}}) {
+    if (!expected.empty() && pos < expected.back() + needle.size()) {
+      continue;
+    }
+    std::copy(needle.begin(), needle.end(), body.begin() + pos);
+    expected.push_back(pos);
+  }
+  CodegateMemoryFileStorage storage;
+  ASSERT_TRUE(storage.Assign(body));
+
+  EXPECT_EQ(SearchAll(storage, base::as_byte_span(needle)), expected);
+  EXPECT_EQ(SearchAll(storage, base::as_byte_span(needle), 2),
+            std::vector<uint64_t>(expected.begin(), expected.begin() + 2));
+}
+
+}  // namespace
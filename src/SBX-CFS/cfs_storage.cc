@@ -0,0 +1,343 @@
+// content/browser/CFS/cfs_storage.cc
+
+// content
+#include "content/browser/CFS/cfs_storage.h"
+
+#include <algorithm>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// content
+#include "content/browser/CFS/cfs_journal.h"
+
+// base
+#include "base/files/file_enumerator.h"
+#include "base/files/file_util.h"
+#include "base/functional/bind.h"
+#include "base/hash/hash.h"
+#include "base/memory/ptr_util.h"
+#include "base/numerics/safe_conversions.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/task/sequenced_task_runner.h"
+
+namespace {
+
+// Bytes CodegateDiskStorageBackend copies per read and write when cloning.
+constexpr size_t kCloneBufferSize = 64 * 1024;
+
+}  // namespace
+
+CodegateMemoryFileStorage::CodegateMemoryFileStorage(
+    scoped_refptr<CodegateBlobStore> blob_store)
+    : blob_store_(std::move(blob_store)) {}
+
+CodegateMemoryFileStorage::CodegateMemoryFileStorage(
+    const CodegateFileContent& content)
+    : content_(content) {}
+
+CodegateMemoryFileStorage::~CodegateMemoryFileStorage() {
+  ReleaseBlob();
+}
+
+uint64_t CodegateMemoryFileStorage::size() const {
+  return content_.size();
+}
+
+size_t CodegateMemoryFileStorage::Read(uint64_t offset,
+                                       base::span<uint8_t> buffer) const {
+  return content_.Read(offset, buffer);
+}
+
+bool CodegateMemoryFileStorage::Write(uint64_t offset,
+                                      base::span<const uint8_t> data) {
+  // Released first, so chunks no one else shares are written in place.
+  ReleaseBlob();
+  content_.Write(offset, data);
+  return true;
+}
+
+bool CodegateMemoryFileStorage::Assign(base::span<const uint8_t> data) {
+  if (!blob_store_) {
+    content_.Assign(data);
+    return true;
+  }
+
+  // Acquired before the old blob is released, so rewriting a file with its
+  // own body keeps that blob alive.
+  CodegateBlobStore::BlobId old_blob_id = blob_id_;
+  blob_hash_ = base::FastHash(data);
+  blob_id_ = blob_store_->Acquire(data, blob_hash_, &content_);
+  if (old_blob_id) {
+    blob_store_->Release(old_blob_id);
+  }
+  return true;
+}
+
+bool CodegateMemoryFileStorage::Resize(uint64_t size) {
+  if (size == content_.size()) {
+    return true;
+  }
+  ReleaseBlob();
+  content_.Resize(size);
+  return true;
+}
+
+bool CodegateMemoryFileStorage::HasContent(
+    base::span<const uint8_t> data) const {
+  // The size is checked first, so a body of another length is not hashed.
+  return blob_id_ && data.size() == content_.size() &&
+         base::FastHash(data) == blob_hash_ && content_.Equals(data);
+}
+
+std::unique_ptr<CodegateFileStorage> CodegateMemoryFileStorage::CreateReader()
+    const {
+  return std::make_unique<CodegateMemoryFileStorage>(content_);
+}
+
+std::unique_ptr<CodegateMemoryFileStorage> CodegateMemoryFileStorage::Clone()
+    const {
+  auto clone = std::make_unique<CodegateMemoryFileStorage>(content_);
+  clone->blob_store_ = blob_store_;
+  if (blob_id_) {
+    blob_store_->AddReference(blob_id_);
+    clone->blob_id_ = blob_id_;
+  }
+  return clone;
+}
+
+void CodegateMemoryFileStorage::ReleaseBlob() {
+  if (blob_id_) {
+    blob_store_->Release(blob_id_);
+    blob_id_ = 0;
+  }
+}
+
+CodegateDiskFileStorage::CodegateDiskFileStorage(
+    CodegateDiskStorageBackend* backend,
+    uint64_t body_id,
+    base::File file,
+    uint64_t size)
+    : backend_(backend),
+      body_id_(body_id),
+      file_(std::move(file)),
+      size_(size) {}
+
+CodegateDiskFileStorage::~CodegateDiskFileStorage() {
+  if (backend_) {
+    file_.Close();
+    backend_->OnStorageDestroyed(body_id_);
+  }
+}
+
+uint64_t CodegateDiskFileStorage::size() const {
+  return size_;
+}
+
+size_t CodegateDiskFileStorage::Read(uint64_t offset,
+                                     base::span<uint8_t> buffer) const {
+  if (offset >= size_) {
+    return 0;
+  }
+  size_t count =
+      static_cast<size_t>(std::min<uint64_t>(buffer.size(), size_ - offset));
+  std::optional<size_t> read =
+      file_.Read(base::checked_cast<int64_t>(offset), buffer.first(count));
+  return read.value_or(0);
+}
+
+bool CodegateDiskFileStorage::Write(uint64_t offset,
+                                    base::span<const uint8_t> data) {
+  if (data.empty()) {
+    return true;
+  }
+  // Writing past the end leaves a hole that reads back as zeroes.
+  std::optional<size_t> written =
+      file_.Write(base::checked_cast<int64_t>(offset), data);
+  if (written != data.size()) {
+    return false;
+  }
+  size_ = std::max<uint64_t>(size_, offset + data.size());
+  return true;
+}
+
+bool CodegateDiskFileStorage::Assign(base::span<const uint8_t> data) {
+  return Write(0, data) && Resize(data.size());
+}
+
+bool CodegateDiskFileStorage::Resize(uint64_t size) {
+  if (!file_.SetLength(base::checked_cast<int64_t>(size))) {
+    return false;
+  }
+  size_ = size;
+  return true;
+}
+
+bool CodegateDiskFileStorage::Flush() const {
+  return file_.Flush();
+}
+
+uint64_t CodegateDiskFileStorage::body_id() const {
+  return body_id_;
+}
+
+std::unique_ptr<CodegateFileStorage> CodegateDiskFileStorage::CreateReader()
+    const {
+  base::File file = file_.Duplicate();
+  if (!file.IsValid()) {
+    return nullptr;
+  }
+  return base::WrapUnique(
+      new CodegateDiskFileStorage(nullptr, 0, std::move(file), size_));
+}
+
+CodegateMemoryStorageBackend::CodegateMemoryStorageBackend(
+    scoped_refptr<CodegateBlobStore> blob_store)
+    : blob_store_(std::move(blob_store)) {}
+
+CodegateMemoryStorageBackend::~CodegateMemoryStorageBackend() = default;
+
+std::unique_ptr<CodegateFileStorage>
+CodegateMemoryStorageBackend::CreateFileStorage() {
+  return std::make_unique<CodegateMemoryFileStorage>(blob_store_);
+}
+
+std::unique_ptr<CodegateFileStorage>
+CodegateMemoryStorageBackend::CloneFileStorage(
+    const CodegateFileStorage& source) {
+  // This backend only creates memory storages.
+  return static_cast<const CodegateMemoryFileStorage&>(source).Clone();
+}
+
+CodegateDiskStorageBackend::CodegateDiskStorageBackend(
+    const base::FilePath& directory)
+    : directory_(directory) {}
+
+CodegateDiskStorageBackend::~CodegateDiskStorageBackend() = default;
+
+std::unique_ptr<CodegateFileStorage>
+CodegateDiskStorageBackend::CreateFileStorage() {
+  if (!EnsureDirectory()) {
+    return nullptr;
+  }
+  return OpenFileStorage(next_body_id_, true);
+}
+
+std::unique_ptr<CodegateFileStorage>
+CodegateDiskStorageBackend::CloneFileStorage(
+    const CodegateFileStorage& source) {
+  std::unique_ptr<CodegateFileStorage> storage = CreateFileStorage();
+  if (!storage) {
+    return nullptr;
+  }
+
+  std::vector<uint8_t> buffer(
+      static_cast<size_t>(std::min<uint64_t>(source.size(), kCloneBufferSize)));
+  for (uint64_t offset = 0; offset < source.size();) {
+    size_t count = source.Read(offset, buffer);
+    if (count == 0 ||
+        !storage->Write(offset, base::span(buffer).first(count))) {
+      return nullptr;
+    }
+    offset += count;
+  }
+  if (!storage->Flush()) {
+    return nullptr;
+  }
+  return storage;
+}
+
+std::unique_ptr<CodegateFileStorage>
+CodegateDiskStorageBackend::OpenFileStorage(uint64_t body_id, bool truncate) {
+  if (!body_id || open_bodies_.contains(body_id) || !EnsureDirectory()) {
+    return nullptr;
+  }
+
+  base::File file(GetBodyPath(body_id),
+                  (truncate ? base::File::FLAG_CREATE_ALWAYS
+                            : base::File::FLAG_OPEN_ALWAYS) |
+                      base::File::FLAG_READ | base::File::FLAG_WRITE);
+  int64_t length = file.IsValid() ? file.GetLength() : -1;
+  if (length < 0) {
+    return nullptr;
+  }
+  next_body_id_ = std::max(next_body_id_, body_id + 1);
+  open_bodies_.insert(body_id);
+  return base::WrapUnique(new CodegateDiskFileStorage(
+      this, body_id, std::move(file), static_cast<uint64_t>(length)));
+}
+
+void CodegateDiskStorageBackend::SetJournal(CodegateJournal* journal) {
+  journal_ = journal;
+}
+
+void CodegateDiskStorageBackend::DeleteUnusedBodies() {
+  if (!EnsureDirectory()) {
+    return;
+  }
+  base::FileEnumerator enumerator(directory_, false,
+                                  base::FileEnumerator::FILES);
+  for (base::FilePath path = enumerator.Next(); !path.empty();
+       path = enumerator.Next()) {
+    uint64_t body_id;
+    if (!base::StringToUint64(path.BaseName().MaybeAsASCII(), &body_id) ||
+        !open_bodies_.contains(body_id)) {
+      base::DeleteFile(path);
+    }
+  }
+}
+
+bool CodegateDiskStorageBackend::EnsureDirectory() {
+  if (directory_created_) {
+    return true;
+  }
+  if (!base::CreateDirectory(directory_)) {
+    return false;
+  }
+  // Bodies of an earlier session keep their ids, so new ones start above.
+  base::FileEnumerator enumerator(directory_, false,
+                                  base::FileEnumerator::FILES);
+  for (base::FilePath path = enumerator.Next(); !path.empty();
+       path = enumerator.Next()) {
+    uint64_t body_id;
+    if (base::StringToUint64(path.BaseName().MaybeAsASCII(), &body_id)) {
+      next_body_id_ = std::max(next_body_id_, body_id + 1);
+    }
+  }
+  directory_created_ = true;
+  return true;
+}
+
+base::FilePath CodegateDiskStorageBackend::GetBodyPath(
+    uint64_t body_id) const {
+  return directory_.AppendASCII(base::NumberToString(body_id));
+}
+
+void CodegateDiskStorageBackend::OnStorageDestroyed(uint64_t body_id) {
+  open_bodies_.erase(body_id);
+  // Posted, since the mutation dropping the body is logged only after it ran.
+  base::SequencedTaskRunner::GetCurrentDefault()->PostTask(
+      FROM_HERE,
+      base::BindOnce(&CodegateDiskStorageBackend::DeleteBodyWhenCommitted,
+                     weak_factory_.GetWeakPtr(), body_id));
+}
+
+void CodegateDiskStorageBackend::DeleteBodyWhenCommitted(uint64_t body_id) {
+  if (!journal_) {
+    DeleteBody(body_id);
+    return;
+  }
+  // A drop the journal failed to log leaves the body to the next session.
+  journal_->RunWhenCommitted(base::BindOnce(
+      [](base::WeakPtr<CodegateDiskStorageBackend> backend, uint64_t body_id,
+         bool committed) {
+        if (backend && committed) {
+          backend->DeleteBody(body_id);
+        }
+      },
+      weak_factory_.GetWeakPtr(), body_id));
+}
+
+void CodegateDiskStorageBackend::DeleteBody(uint64_t body_id) {
+  base::DeleteFile(GetBodyPath(body_id));
+}
@@ -0,0 +1,221 @@
+#ifndef CONTENT_BROWSER_CFS_CFS_STORAGE_H_
+#define CONTENT_BROWSER_CFS_CFS_STORAGE_H_
+
+// library
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <set>
+
+// base
+#include "base/containers/span.h"
+#include "base/files/file.h"
+#include "base/files/file_path.h"
+#include "base/memory/raw_ptr.h"
+#include "base/memory/scoped_refptr.h"
+#include "base/memory/weak_ptr.h"
+
+// content
+#include "content/browser/CFS/cfs_blob_store.h"
+#include "content/browser/CFS/cfs_file_content.h"
+
+class CodegateDiskStorageBackend;
+class CodegateJournal;
+
+// Body of one CodegateFileImpl. Metadata (name, parent, counters) always
+// stays in memory; only the bytes live behind this interface.
+class CodegateFileStorage {
+ public:
+  virtual ~CodegateFileStorage() = default;
+
+  virtual uint64_t size() const = 0;
+
+  // Copies content starting at |offset| into |buffer| and returns the number
+  // of bytes copied, which is short at the end of the content or on error.
+  virtual size_t Read(uint64_t offset, base::span<uint8_t> buffer) const = 0;
+
+  // Mutators grow the content with zeroes as needed and return false if the
+  // backing store failed. Callers check quotas and CFS_FILESIZE_MAX first.
+  virtual bool Write(uint64_t offset, base::span<const uint8_t> data) = 0;
+  virtual bool Assign(base::span<const uint8_t> data) = 0;
+  virtual bool Resize(uint64_t size) = 0;
+
+  // Returns true if the content is known to be |data| already, so that
+  // assigning it would change nothing. False means different or unknown.
+  virtual bool HasContent(base::span<const uint8_t> data) const {
+    return false;
+  }
+
+  // Makes everything written so far durable. Only storage on disk has
+  // anything to do.
+  virtual bool Flush() const { return true; }
+  // Id of the body file the content is kept in, or 0 for storage without
+  // one. See CodegateDiskStorageBackend.
+  virtual uint64_t body_id() const { return 0; }
+
+  // Returns storage a ReadStream can read from after this one keeps
+  // changing. See the implementations for how much of later writes it sees.
+  virtual std::unique_ptr<CodegateFileStorage> CreateReader() const = 0;
+};
+
+// Default storage: chunks in browser memory. With a blob store, every body
+// set as a whole by Assign is interned there, so files with identical bodies
+// share one set of chunks. The first partial change leaves the blob again
+// and clones just the chunks it touches.
+class CodegateMemoryFileStorage : public CodegateFileStorage {
+ public:
+  explicit CodegateMemoryFileStorage(
+      scoped_refptr<CodegateBlobStore> blob_store = nullptr);
+  explicit CodegateMemoryFileStorage(const CodegateFileContent& content);
+  ~CodegateMemoryFileStorage() override;
+
+  CodegateMemoryFileStorage(const CodegateMemoryFileStorage&) = delete;
+  CodegateMemoryFileStorage& operator=(const CodegateMemoryFileStorage&) =
+      delete;
+
+  uint64_t size() const override;
+  size_t Read(uint64_t offset, base::span<uint8_t> buffer) const override;
+  bool Write(uint64_t offset, base::span<const uint8_t> data) override;
+  bool Assign(base::span<const uint8_t> data) override;
+  bool Resize(uint64_t size) override;
+  // Known only while the content is still the blob of the last Assign.
+  bool HasContent(base::span<const uint8_t> data) const override;
+  // A snapshot sharing this storage's chunks; later writes are not seen.
+  // It holds no blob reference of its own.
+  std::unique_ptr<CodegateFileStorage> CreateReader() const override;
+  // Like CreateReader(), but the copy also holds the blob, if any, so it
+  // keeps being deduplicated.
+  std::unique_ptr<CodegateMemoryFileStorage> Clone() const;
+
+ private:
+  void ReleaseBlob();
+
+  CodegateFileContent content_;
+  scoped_refptr<CodegateBlobStore> blob_store_;
+  // Blob |content_| currently is, or 0 once it changed since the last
+  // Assign.
+  CodegateBlobStore::BlobId blob_id_ = 0;
+  // base::FastHash of the blob, valid while |blob_id_| is set.
+  size_t blob_hash_ = 0;
+};
+
+// Storage in a body file of its own on disk, created and kept by a
+// CodegateDiskStorageBackend. All calls block, so a filesystem using this
+// storage must run on a sequence that allows blocking.
+class CodegateDiskFileStorage : public CodegateFileStorage {
+ public:
+  ~CodegateDiskFileStorage() override;
+
+  uint64_t size() const override;
+  size_t Read(uint64_t offset, base::span<uint8_t> buffer) const override;
+  bool Write(uint64_t offset, base::span<const uint8_t> data) override;
+  bool Assign(base::span<const uint8_t> data) override;
+  bool Resize(uint64_t size) override;
+  bool Flush() const override;
+  uint64_t body_id() const override;
+  // Reads the live file through a second handle, so a stream sees later
+  // writes and ends early if the file is truncated under it.
+  std::unique_ptr<CodegateFileStorage> CreateReader() const override;
+
+ private:
+  friend class CodegateDiskStorageBackend;
+
+  // |backend| is null for readers, which leave the body to the storage.
+  CodegateDiskFileStorage(CodegateDiskStorageBackend* backend,
+                          uint64_t body_id,
+                          base::File file,
+                          uint64_t size);
+
+  raw_ptr<CodegateDiskStorageBackend> backend_;
+  uint64_t body_id_;
+  // base::File reads are not const, but they do not change the content.
+  mutable base::File file_;
+  uint64_t size_;
+};
+
+// Creates the storage for each file of one CodegateFileSystem.
+class CodegateStorageBackend {
+ public:
+  virtual ~CodegateStorageBackend() = default;
+
+  // Returns nullptr if no storage can be created; the file is not created.
+  virtual std::unique_ptr<CodegateFileStorage> CreateFileStorage() = 0;
+  // Returns new storage holding what |source|, which this backend created,
+  // holds now, or nullptr on failure.
+  virtual std::unique_ptr<CodegateFileStorage> CloneFileStorage(
+      const CodegateFileStorage& source) = 0;
+};
+
+class CodegateMemoryStorageBackend : public CodegateStorageBackend {
+ public:
+  // Storages intern their bodies in |blob_store| unless it is null.
+  explicit CodegateMemoryStorageBackend(
+      scoped_refptr<CodegateBlobStore> blob_store = nullptr);
+  ~CodegateMemoryStorageBackend() override;
+
+  std::unique_ptr<CodegateFileStorage> CreateFileStorage() override;
+  // Shares |source|'s chunks; each side clones a chunk when it first writes
+  // to it.
+  std::unique_ptr<CodegateFileStorage> CloneFileStorage(
+      const CodegateFileStorage& source) override;
+
+ private:
+  scoped_refptr<CodegateBlobStore> blob_store_;
+};
+
+// Keeps every file body in |directory|, in a file named after its body id.
+// Body files are the durable copy of the content: a journal only logs which
+// body each file has and the writes made since its last checkpoint, and the
+// checkpoint syncs every body before it trims those writes. Replay then
+// reopens the bodies and applies the writes again on top.
+//
+// A body is not deleted with its storage but once the journal committed
+// whatever dropped it, since until then a crash replays back to it. Bodies
+// left behind by a crash are removed by DeleteUnusedBodies().
+class CodegateDiskStorageBackend : public CodegateStorageBackend {
+ public:
+  explicit CodegateDiskStorageBackend(const base::FilePath& directory);
+  ~CodegateDiskStorageBackend() override;
+
+  CodegateDiskStorageBackend(const CodegateDiskStorageBackend&) = delete;
+  CodegateDiskStorageBackend& operator=(const CodegateDiskStorageBackend&) =
+      delete;
+
+  std::unique_ptr<CodegateFileStorage> CreateFileStorage() override;
+  // Copies the bytes into a new body and syncs it, since a logged copy is
+  // replayed by reopening that body rather than by copying again.
+  std::unique_ptr<CodegateFileStorage> CloneFileStorage(
+      const CodegateFileStorage& source) override;
+
+  // Storage on the body |body_id| as a replay finds it, or emptied first if
+  // |truncate|. A missing body is created empty. Returns nullptr on failure
+  // or if the body is open already.
+  std::unique_ptr<CodegateFileStorage> OpenFileStorage(uint64_t body_id,
+                                                       bool truncate);
+  // A dropped body is deleted from a task posted behind the mutation that
+  // dropped it, once |journal|, if set, committed that mutation. The posted
+  // task dies with the backend, so a tree torn down together with its
+  // backend keeps its bodies.
+  void SetJournal(CodegateJournal* journal);
+  // Deletes every body no storage is open on.
+  void DeleteUnusedBodies();
+
+ private:
+  friend class CodegateDiskFileStorage;
+
+  bool EnsureDirectory();
+  base::FilePath GetBodyPath(uint64_t body_id) const;
+  void OnStorageDestroyed(uint64_t body_id);
+  void DeleteBodyWhenCommitted(uint64_t body_id);
+  void DeleteBody(uint64_t body_id);
+
+  base::FilePath directory_;
+  bool directory_created_ = false;
+  // Above every body id seen, so that no id is ever used twice.
+  uint64_t next_body_id_ = 1;
+  std::set<uint64_t> open_bodies_;
+  raw_ptr<CodegateJournal> journal_ = nullptr;
+  base::WeakPtrFactory<CodegateDiskStorageBackend> weak_factory_{this};
+};
+
+#endif  // CONTENT_BROWSER_CFS_CFS_STORAGE_H_
@@ -0,0 +1,120 @@
+// content/browser/CFS/cfs_storage_unittest.cc
+
+// content
+#include "content/browser/CFS/cfs_storage.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "content/browser/CFS/cfs_journal.h"
+
+// base
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/test/task_environment.h"
+
+// test
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace {
+
+class CodegateDiskStorageBackendTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    directory_ = temp_dir_.GetPath().AppendASCII("bodies");
+    backend_ = std::make_unique<CodegateDiskStorageBackend>(directory_);
+  }
+
+  // Stands for a filesystem closing and the next session opening it.
+  void ReopenBackend() {
+    backend_.reset();
+    task_environment_.RunUntilIdle();
+    backend_ = std::make_unique<CodegateDiskStorageBackend>(directory_);
+  }
+
+  bool BodyExists(uint64_t body_id) {
+    return base::PathExists(
+        directory_.AppendASCII(base::NumberToString(body_id)));
+  }
+
+  static std::vector<uint8_t> ReadAll(const CodegateFileStorage& storage) {
+    std::vector<uint8_t> data(static_cast<size_t>(storage.size()));
+    data.resize(storage.Read(0, data));
+    return data;
+  }
+
+  base::test::TaskEnvironment task_environment_;
+  base::ScopedTempDir temp_dir_;
+  base::FilePath directory_;
+  std::unique_ptr<CodegateDiskStorageBackend> backend_;
+};
+
+TEST_F(CodegateDiskStorageBackendTest, BodiesOutliveTheBackend) {
+  std::unique_ptr<CodegateFileStorage> storage = backend_->CreateFileStorage();
+  ASSERT_TRUE(storage);
+  ASSERT_TRUE(storage->Assign(std::vector<uint8_t>({1, 2, 3})));
+  uint64_t body_id = storage->body_id();
+  ASSERT_NE(body_id, 0u);
+  storage.reset();
+  ReopenBackend();
+
+  storage = backend_->OpenFileStorage(body_id, false);
+  ASSERT_TRUE(storage);
+  EXPECT_EQ(ReadAll(*storage), std::vector<uint8_t>({1, 2, 3}));
+  // One storage per body.
+  EXPECT_FALSE(backend_->OpenFileStorage(body_id, false));
+
+  storage.reset();
+  storage = backend_->OpenFileStorage(body_id, true);
+  ASSERT_TRUE(storage);
+  EXPECT_EQ(storage->size(), 0u);
+}
+
+TEST_F(CodegateDiskStorageBackendTest, DroppedBodyWaitsForCommit) {
+  std::unique_ptr<CodegateJournal> journal =
+      CodegateJournal::Open(temp_dir_.GetPath().AppendASCII("journal"),
+                            [](const CodegateJournalRecord&) {});
+  ASSERT_TRUE(journal);
+  backend_->SetJournal(journal.get());
+
+  std::unique_ptr<CodegateFileStorage> storage = backend_->CreateFileStorage();
+  ASSERT_TRUE(storage);
+  uint64_t body_id = storage->body_id();
+  // Dropped first and logged after, as a delete does it.
+  storage.reset();
+  journal->Append(
+      CodegateJournalRecord(CodegateJournalRecord::Op::kDelete, "/root/f"));
+  EXPECT_TRUE(BodyExists(body_id));
+
+  task_environment_.RunUntilIdle();
+  EXPECT_FALSE(BodyExists(body_id));
+  backend_->SetJournal(nullptr);
+}
+
+TEST_F(CodegateDiskStorageBackendTest, DeletesUnusedBodiesAndSkipsTheirIds) {
+  std::unique_ptr<CodegateFileStorage> kept = backend_->CreateFileStorage();
+  std::unique_ptr<CodegateFileStorage> unused = backend_->CreateFileStorage();
+  ASSERT_TRUE(kept && unused);
+  uint64_t kept_id = kept->body_id();
+  uint64_t unused_id = unused->body_id();
+  kept.reset();
+  unused.reset();
+  ReopenBackend();
+
+  kept = backend_->OpenFileStorage(kept_id, false);
+  ASSERT_TRUE(kept);
+  backend_->DeleteUnusedBodies();
+  EXPECT_TRUE(BodyExists(kept_id));
+  EXPECT_FALSE(BodyExists(unused_id));
+
+  std::unique_ptr<CodegateFileStorage> created = backend_->CreateFileStorage();
+  ASSERT_TRUE(created);
+  EXPECT_GT(created->body_id(), unused_id);
+}
+
+}  // namespace
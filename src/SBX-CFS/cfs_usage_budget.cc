@@ -0,0 +1,37 @@
+// content/browser/CFS/cfs_usage_budget.cc
+
+// content
+#include "content/browser/CFS/cfs_usage_budget.h"
+
+CodegateUsageBudget::CodegateUsageBudget(uint64_t max_bytes,
+                                         uint64_t max_items)
+    : max_bytes_(max_bytes), max_items_(max_items) {}
+
+CodegateUsageBudget::~CodegateUsageBudget() = default;
+
+bool CodegateUsageBudget::CanAddBytes(uint64_t bytes) const {
+  base::AutoLock lock(lock_);
+  return used_bytes_ <= max_bytes_ && bytes <= max_bytes_ - used_bytes_;
+}
+
+bool CodegateUsageBudget::CanAddItems(uint64_t items) const {
+  base::AutoLock lock(lock_);
+  return used_items_ <= max_items_ && items <= max_items_ - used_items_;
+}
+
+void CodegateUsageBudget::Adjust(int64_t bytes, int64_t items) {
+  base::AutoLock lock(lock_);
+  // Unsigned wraparound turns adding a negative delta into a subtraction.
+  used_bytes_ += static_cast<uint64_t>(bytes);
+  used_items_ += static_cast<uint64_t>(items);
+}
+
+uint64_t CodegateUsageBudget::used_bytes() const {
+  base::AutoLock lock(lock_);
+  return used_bytes_;
+}
+
+uint64_t CodegateUsageBudget::used_items() const {
+  base::AutoLock lock(lock_);
+  return used_items_;
+}
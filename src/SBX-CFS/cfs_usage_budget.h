@@ -0,0 +1,47 @@
+#ifndef CONTENT_BROWSER_CFS_CFS_USAGE_BUDGET_H_
+#define CONTENT_BROWSER_CFS_CFS_USAGE_BUDGET_H_
+
+// library
+#include <cstdint>
+
+// base
+#include "base/memory/ref_counted.h"
+#include "base/synchronization/lock.h"
+#include "base/thread_annotations.h"
+
+// Bytes and items used by every filesystem of one CodegateFSManagerImpl
+// together, held to limits the renderer cannot change. Filesystems check it
+// next to their own quotas and report every change to their totals.
+//
+// Filesystems run on sequences of their own, so every method takes a lock.
+// A check and the change it allows are not atomic, so filesystems mutating
+// at the same moment may go past a limit by what each of them added.
+class CodegateUsageBudget
+    : public base::RefCountedThreadSafe<CodegateUsageBudget> {
+ public:
+  CodegateUsageBudget(uint64_t max_bytes, uint64_t max_items);
+
+  CodegateUsageBudget(const CodegateUsageBudget&) = delete;
+  CodegateUsageBudget& operator=(const CodegateUsageBudget&) = delete;
+
+  bool CanAddBytes(uint64_t bytes) const;
+  bool CanAddItems(uint64_t items) const;
+  // Negative deltas give usage back.
+  void Adjust(int64_t bytes, int64_t items);
+
+  uint64_t used_bytes() const;
+  uint64_t used_items() const;
+
+ private:
+  friend class base::RefCountedThreadSafe<CodegateUsageBudget>;
+  ~CodegateUsageBudget();
+
+  const uint64_t max_bytes_;
+  const uint64_t max_items_;
+
+  mutable base::Lock lock_;
+  uint64_t used_bytes_ GUARDED_BY(lock_) = 0;
+  uint64_t used_items_ GUARDED_BY(lock_) = 0;
+};
+
+#endif  // CONTENT_BROWSER_CFS_CFS_USAGE_BUDGET_H_